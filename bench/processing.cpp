@@ -0,0 +1,233 @@
+#include "correlation.hpp"
+#include "processing.hpp"
+#include "stream.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+constexpr size_t INPUT_SIZE = 1 << 20;
+
+// 8-bit ADC codes scaled to volts, the way the scope delivers them.
+template <typename T> std::vector<T> adcNoise(size_t n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> code(-127, 127);
+  std::vector<T> res(n);
+  for (auto &e : res) {
+    e = static_cast<T>(code(gen) * 10. / 127.);
+  }
+  return res;
+}
+
+template <typename T> std::vector<T> filtered(const std::vector<T> &in) {
+  std::vector<T> res(in.size());
+  T prev = 0;
+  for (size_t i = 0; i < in.size(); ++i) {
+    prev = res[i] = 0.25 * in[i] + 0.75 * prev;
+  }
+  return res;
+}
+
+// Windows in WINDOW_MAP order, selected by benchmark argument
+const WindowFunction &windowArg(int64_t index) {
+  return std::next(WINDOW_MAP.begin(), index)->second;
+}
+
+void windowLabel(benchmark::State &state, int64_t index) {
+  state.SetLabel(std::next(WINDOW_MAP.begin(), index)->first);
+}
+
+// Reports `error` as a counter and fails the run when it exceeds
+// `tolerance`, so a fast but wrong variant never passes for a speedup
+void checkError(benchmark::State &state, const std::string &name,
+                double error, double tolerance) {
+  state.counters[name] = error;
+  if (!(error <= tolerance)) {
+    state.SkipWithError((name + " above tolerance").c_str());
+  }
+}
+
+// Single precision rounding grows with the transform length; these hold up
+// to the largest sizes benchmarked
+template <typename T>
+constexpr double FFT_TOLERANCE = std::is_same_v<T, float> ? 1e-5 : 1e-10;
+constexpr double H1_TOLERANCE_DB = 1e-3;
+constexpr double COHERENCE_TOLERANCE = 1e-5;
+constexpr double DELAY_TOLERANCE = 0.5;
+
+// Relative error of the single-sided spectrum against the mean square of
+// the input; the DC and Nyquist bins are not doubled.
+template <typename T>
+double parsevalError(const std::vector<T> &data,
+                     const std::vector<std::complex<T>> &spectrum) {
+  double time = 0.;
+  for (auto e : data) {
+    time += double(e) * e;
+  }
+  time /= data.size();
+  double freq = std::norm(spectrum.front()) + std::norm(spectrum.back());
+  for (size_t i = 1; i + 1 < spectrum.size(); ++i) {
+    freq += std::norm(spectrum[i]) / 2;
+  }
+  return std::abs(freq - time) / time;
+}
+
+template <typename T> void BM_Fft(benchmark::State &state) {
+  auto data = adcNoise<T>(state.range(0), 1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fft(data));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+
+  // A bin-centred tone of amplitude 1 must come out with magnitude 1
+  const size_t n = state.range(0);
+  std::vector<T> tone(n);
+  for (size_t i = 0; i < n; ++i) {
+    tone[i] = std::cos(2 * std::numbers::pi * (n / 8) * i / n);
+  }
+  checkError(state, "parsevalError", parsevalError(data, fft(data)),
+             FFT_TOLERANCE<T>);
+  checkError(state, "toneError", std::abs(std::abs(fft(tone)[n / 8]) - 1),
+             FFT_TOLERANCE<T>);
+}
+
+void BM_ApplyWindow(benchmark::State &state) {
+  auto data = adcNoise<double>(state.range(0), 1);
+  const auto &windowFn = windowArg(state.range(1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(applyWindow(data, windowFn) | ranges::to_vector);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  windowLabel(state, state.range(1));
+}
+
+void BM_WindowedFft(benchmark::State &state) {
+  auto data = adcNoise<double>(state.range(0), 1);
+  const auto &windowFn = windowArg(state.range(1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fft(applyWindow(data, windowFn)));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  windowLabel(state, state.range(1));
+}
+
+template <typename T> void BM_CrossSpectrum(benchmark::State &state) {
+  const size_t windowSize = state.range(0);
+  auto b = adcNoise<T>(INPUT_SIZE, 1);
+  auto a = filtered(b);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(crossSpectrum(a, b, windowSize));
+  }
+  state.SetBytesProcessed(state.iterations() * 2 * INPUT_SIZE * sizeof(T));
+
+  // Accuracy relative to the double path on identical input.
+  auto reference = transferFunction(
+      crossSpectrum(std::vector<double>(a.begin(), a.end()),
+                    std::vector<double>(b.begin(), b.end()), windowSize),
+      1.);
+  auto result = transferFunction(crossSpectrum(a, b, windowSize), 1.);
+  double maxErrorDb = 0., maxErrorCoherence = 0.;
+  for (size_t i = 1; i < result.h1.size(); ++i) {
+    maxErrorDb = std::max(maxErrorDb, std::abs(result.h1[i] - reference.h1[i]));
+    maxErrorCoherence = std::max(
+        maxErrorCoherence,
+        std::abs(result.coherence[i] - reference.coherence[i]));
+  }
+  checkError(state, "maxErrorDb", maxErrorDb, H1_TOLERANCE_DB);
+  checkError(state, "maxErrorCoherence", maxErrorCoherence,
+             COHERENCE_TOLERANCE);
+}
+
+// welch() over a scope history of range(0) seconds with a window of
+// range(1) samples on range(2) threads of the shared scheduler.
+void BM_Welch(benchmark::State &state) {
+  const size_t samples = static_cast<size_t>(state.range(0) * SAMPLE_RATE);
+  const size_t windowSize = state.range(1);
+  auto b = adcNoise<float>(samples, 1);
+  std::vector<float> a(b.size());
+  for (size_t i = 0; i < b.size(); ++i) {
+    a[i] = 0.5f * b[i];
+  }
+
+  auto &scheduler = Scheduler::getInstance();
+  const size_t threads = scheduler.getParallelism();
+  scheduler.setParallelism(state.range(2));
+  std::vector<double> h1;
+  for (auto _ : state) {
+    h1 = welch(a, b, windowSize);
+    benchmark::DoNotOptimize(h1.data());
+  }
+  scheduler.setParallelism(threads);
+  state.SetItemsProcessed(state.iterations() * 2 * samples);
+
+  // A is exactly half of B, so H1 is -6.02 dB in every bin
+  double maxErrorDb = 0.;
+  for (auto e : h1) {
+    maxErrorDb = std::max(maxErrorDb, std::abs(e - 20 * std::log10(0.5)));
+  }
+  checkError(state, "maxErrorDb", maxErrorDb, H1_TOLERANCE_DB);
+}
+
+// Delay estimate over range(0) samples searching +-2^14 lags
+void BM_Correlation(benchmark::State &state) {
+  auto b = adcNoise<float>(state.range(0), 1);
+  std::vector<float> a(b.size());
+  std::copy(b.begin(), b.end() - 5, a.begin() + 5);
+  CrossCorrelator correlator{
+      static_cast<CorrelationWeighting>(state.range(1))};
+  DelayEstimate estimate;
+  for (auto _ : state) {
+    estimate = correlator.estimate(a, b, 1 << 14);
+    benchmark::DoNotOptimize(estimate);
+  }
+  state.SetItemsProcessed(state.iterations() * 2 * state.range(0));
+  checkError(state, "delayError", std::abs(estimate.delay - 5),
+             DELAY_TOLERANCE);
+}
+
+void windowArgs(benchmark::internal::Benchmark *b) {
+  for (int64_t size = 1 << 5; size <= 1 << 19; size <<= 2) {
+    for (int64_t fn = 0; fn < (int64_t)WINDOW_MAP.size(); ++fn) {
+      b->Args({size, fn});
+    }
+  }
+}
+
+void welchArgs(benchmark::internal::Benchmark *b) {
+  const int64_t maxThreads = Scheduler::getInstance().threads() + 1;
+  for (int64_t seconds : {1, 10, (int)WAVEFORM_SECONDS}) {
+    for (int64_t windowSize : {1 << 8, 1 << 12, 1 << 16}) {
+      for (int64_t threads = 1; threads < maxThreads; threads *= 2) {
+        b->Args({seconds, windowSize, threads});
+      }
+      b->Args({seconds, windowSize, maxThreads});
+    }
+  }
+}
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_Fft, double)->RangeMultiplier(4)->Range(1 << 5, 1 << 19);
+BENCHMARK_TEMPLATE(BM_Fft, float)->RangeMultiplier(4)->Range(1 << 5, 1 << 19);
+BENCHMARK(BM_ApplyWindow)->Apply(windowArgs);
+BENCHMARK(BM_WindowedFft)->Apply(windowArgs);
+BENCHMARK_TEMPLATE(BM_CrossSpectrum, double)
+    ->RangeMultiplier(8)
+    ->Range(1 << 8, 1 << 17)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_CrossSpectrum, float)
+    ->RangeMultiplier(8)
+    ->Range(1 << 8, 1 << 17)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Correlation)
+    ->ArgsProduct({{1 << 16, 1 << 20}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Welch)
+    ->ArgNames({"seconds", "window", "threads"})
+    ->Apply(welchArgs)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,42 @@
+#include "libps2000/ps2000.h"
+
+// Stands in for the ps2000 driver in ui-bench, so the benchmark builds and
+// runs without the PicoSDK library or a unit attached. No unit is ever
+// found, so Scope stays closed and every other call fails as it would
+// without one; the scope tab draws from the history the benchmark appends.
+
+int16_t ps2000_open_unit(void) { return 0; }
+
+int16_t ps2000_close_unit(int16_t) { return 0; }
+
+int16_t ps2000_set_channel(int16_t, int16_t, int16_t, int16_t, int16_t) {
+  return 0;
+}
+
+int16_t ps2000_set_trigger(int16_t, int16_t, int16_t, int16_t, int16_t,
+                           int16_t) {
+  return 0;
+}
+
+int16_t ps2000_run_streaming_ns(int16_t, uint32_t, PS2000_TIME_UNITS,
+                                uint32_t, int16_t, uint32_t, uint32_t) {
+  return 0;
+}
+
+int16_t ps2000_get_streaming_last_values(int16_t, GetOverviewBuffersMaxMin) {
+  return 0;
+}
+
+int16_t ps2000_stop(int16_t) { return 0; }
+
+int16_t ps2000_set_sig_gen_arbitrary(int16_t, int32_t, uint32_t, uint32_t,
+                                     uint32_t, uint32_t, uint32_t, uint8_t *,
+                                     int32_t, PS2000_SWEEP_TYPE, uint32_t) {
+  return 0;
+}
+
+int16_t ps2000_set_sig_gen_built_in(int16_t, int32_t, uint32_t,
+                                    PS2000_WAVE_TYPE, float, float, float,
+                                    float, PS2000_SWEEP_TYPE, uint32_t) {
+  return 0;
+}
@@ -0,0 +1,200 @@
+#include "codec.hpp"
+#include "envelope.hpp"
+#include "persistence.hpp"
+#include "resample.hpp"
+#include "stream.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <range/v3/all.hpp>
+#include <vector>
+
+namespace {
+// Samples per channel of the default history
+constexpr auto HISTORY_SAMPLES =
+    static_cast<size_t>(WAVEFORM_SECONDS * SAMPLE_RATE);
+constexpr size_t PLOT_SAMPLES = 10000;
+
+std::vector<float> adcNoise(size_t n) {
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> code(-127, 127);
+  std::vector<float> res(n);
+  for (auto &e : res) {
+    e = code(gen) * 10.f / 127.f;
+  }
+  return res;
+}
+
+// The strided reduction drawScope applies to the visible range of
+// range(0) seconds before handing points to ImPlot.
+void BM_ScopeStride(benchmark::State &state) {
+  namespace rv = ranges::views;
+  auto data = adcNoise(HISTORY_SAMPLES);
+  const size_t size = static_cast<size_t>(state.range(0) * SAMPLE_RATE);
+  const double dt = DELTA_TIME;
+  for (auto _ : state) {
+    auto stride = std::max<size_t>(1, size / PLOT_SAMPLES);
+    auto idxs = rv::iota((size_t)0) | rv::take(size) | rv::stride(stride);
+    auto xs = idxs | rv::transform([dt](auto e) { return e * dt; }) |
+              ranges::to_vector;
+    auto ys = idxs | rv::transform([&data](auto e) { return data[e]; }) |
+              ranges::to_vector;
+    benchmark::DoNotOptimize(xs.data());
+    benchmark::DoNotOptimize(ys.data());
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+}
+
+// The min/max envelope drawScope now draws instead: one bucket per pixel
+// of a 2000 pixel wide plot over range(0) seconds.
+void BM_ScopeEnvelope(benchmark::State &state) {
+  auto data = adcNoise(HISTORY_SAMPLES);
+  EnvelopePyramid pyramid;
+  pyramid.append(data);
+  const size_t size = static_cast<size_t>(state.range(0) * SAMPLE_RATE);
+  std::vector<EnvelopeBucket> buckets;
+  for (auto _ : state) {
+    pyramid.envelope(0, size, 2000, buckets);
+    benchmark::DoNotOptimize(buckets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+}
+
+// Keeping the pyramid current as acquisition blocks arrive
+void BM_EnvelopeAppend(benchmark::State &state) {
+  auto data = adcNoise(HISTORY_SAMPLES);
+  const size_t block = state.range(0);
+  for (auto _ : state) {
+    EnvelopePyramid pyramid;
+    for (size_t at = 0; at + block <= data.size(); at += block) {
+      pyramid.append(std::span(data).subspan(at, block));
+    }
+    benchmark::DoNotOptimize(pyramid.size());
+  }
+  state.SetItemsProcessed(state.iterations() * data.size());
+}
+
+// Peak-preserving reduction of a spectrum of range(0) bins as drawSpectrum
+// does per result (`assign`) and per frame (`reduce`, 2000 pixels)
+void BM_SpectrumPeaks(benchmark::State &state) {
+  const auto noise = adcNoise(state.range(0));
+  const std::vector<double> bins(noise.begin(), noise.end());
+  PeakPyramid pyramid;
+  std::vector<EnvelopeBucket> buckets;
+  for (auto _ : state) {
+    pyramid.assign(bins);
+    pyramid.reduce(0, bins.size(), 2000, buckets);
+    benchmark::DoNotOptimize(buckets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * bins.size());
+}
+
+void BM_SpectrumPeaksFrame(benchmark::State &state) {
+  const auto noise = adcNoise(state.range(0));
+  const std::vector<double> bins(noise.begin(), noise.end());
+  PeakPyramid pyramid;
+  pyramid.assign(bins);
+  std::vector<EnvelopeBucket> buckets;
+  for (auto _ : state) {
+    pyramid.reduce(0, bins.size(), 2000, buckets);
+    benchmark::DoNotOptimize(buckets.data());
+  }
+}
+
+// Accumulating a triggered 1 kHz sine into the persistence histogram with
+// sweeps of range(0) samples; `sweeps` is per second of CPU time
+void BM_PersistencePush(benchmark::State &state) {
+  const size_t n = HISTORY_SAMPLES;
+  std::vector<float> data(n);
+  for (size_t i = 0; i < n; ++i) {
+    data[i] = static_cast<float>(
+        5. * std::sin(2 * std::numbers::pi * 1e3 * i / SAMPLE_RATE));
+  }
+  const size_t length = state.range(0);
+  Persistence persistence{{.length = length, .pretrigger = length / 4},
+                          SAMPLE_RATE};
+  size_t sweeps = 0;
+  for (auto _ : state) {
+    for (size_t at = 0; at < n; at += 1 << 12) {
+      sweeps += persistence.push(
+          std::span(data).subspan(at, std::min<size_t>(1 << 12, n - at)));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.counters["sweeps"] = benchmark::Counter(
+      static_cast<double>(sweeps), benchmark::Counter::kIsRate);
+}
+
+// 8-bit codes scaled to 16 bits as the driver streams them: a sine with
+// range(0) codes of noise, the volts per code of the 10 V range apart
+std::vector<float> adcCodes(size_t n, int noise) {
+  constexpr float step = static_cast<float>(10. / 32767);
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> jitter(-noise, noise);
+  std::vector<float> res(n);
+  for (size_t i = 0; i < n; ++i) {
+    const int code = static_cast<int>(std::round(100 * std::sin(i * 1e-3)));
+    res[i] = (std::clamp(code + jitter(gen), -127, 127) << 8) * step;
+  }
+  return res;
+}
+
+// Packing one sealed history chunk; `ratio` is raw over packed size
+void BM_PackSamples(benchmark::State &state) {
+  const auto data = adcCodes(1 << 16, state.range(0));
+  const float step = static_cast<float>(10. / 32767);
+  std::vector<uint32_t> packed;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(packSamples(data, step, packed));
+  }
+  state.SetBytesProcessed(state.iterations() * data.size() * sizeof(float));
+  state.counters["ratio"] = double(data.size()) / double(packed.size());
+}
+
+// Unpacking it again, as reads of packed history do
+void BM_UnpackSamples(benchmark::State &state) {
+  const auto data = adcCodes(1 << 16, state.range(0));
+  std::vector<uint32_t> packed;
+  packSamples(data, static_cast<float>(10. / 32767), packed);
+  std::vector<float> out(data.size());
+  for (auto _ : state) {
+    unpackSamples(packed.data(), 0, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * data.size());
+  state.SetBytesProcessed(state.iterations() * data.size() * sizeof(float));
+}
+
+// Anti-aliased decimation of the full history by range(0), the path taken
+// when the Decimation control is above 1.
+void BM_DecimationChain(benchmark::State &state) {
+  auto data = adcNoise(HISTORY_SAMPLES);
+  std::vector<float> out;
+  for (auto _ : state) {
+    DecimationChain<float> chain{static_cast<size_t>(state.range(0))};
+    out.clear();
+    chain.process(data, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * data.size());
+}
+} // namespace
+
+BENCHMARK(BM_ScopeStride)->Arg(1)->Arg(10)->Arg(WAVEFORM_SECONDS);
+BENCHMARK(BM_ScopeEnvelope)->Arg(1)->Arg(10)->Arg(WAVEFORM_SECONDS);
+BENCHMARK(BM_EnvelopeAppend)
+    ->Arg(1 << 10)
+    ->Arg(1 << 14)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SpectrumPeaks)->Arg(1 << 12)->Arg(1 << 15)->Arg(1 << 18);
+BENCHMARK(BM_SpectrumPeaksFrame)->Arg(1 << 12)->Arg(1 << 15)->Arg(1 << 18);
+BENCHMARK(BM_PersistencePush)->Arg(32)->Arg(512)->Arg(2048);
+BENCHMARK(BM_PackSamples)->Arg(0)->Arg(3)->Arg(127);
+BENCHMARK(BM_UnpackSamples)->Arg(0)->Arg(3)->Arg(127);
+BENCHMARK(BM_DecimationChain)
+    ->Arg(2)
+    ->Arg(10)
+    ->Arg(100)
+    ->Unit(benchmark::kMillisecond);
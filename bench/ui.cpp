@@ -0,0 +1,235 @@
+#include "pico.hpp"
+#include "ui.hpp"
+
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include <imgui.h>
+#include <implot.h>
+#include <memory>
+#include <numbers>
+#include <random>
+#include <span>
+#include <vector>
+
+// Frames of the scope tab drawn without a window or GPU: ImGui and ImPlot
+// run with no platform or renderer backend, and Render() only builds the
+// draw lists a backend would upload. Each iteration is one frame.
+namespace {
+constexpr ImVec2 DISPLAY_SIZE = {1920.f, 1080.f};
+// Acquisition block appended at a time, as the streaming callback does
+constexpr size_t INGEST_BLOCK = 1 << 14;
+// Blocks posted to the ingest thread before waiting for it to catch up,
+// which bounds the memory they hold while queued
+constexpr size_t INGEST_BATCH = 64;
+// Frames one pass of a zoom or pan script takes
+constexpr size_t SCRIPT_FRAMES = 240;
+// Width of the window the static and panning scripts show
+constexpr double VIEW_SECONDS = 10.;
+constexpr double MIN_VIEW_SECONDS = 1e-3;
+
+enum class Script {
+  // The newest VIEW_SECONDS, unchanged between frames
+  Static,
+  // A VIEW_SECONDS window moving across the whole history
+  Pan,
+  // From MIN_VIEW_SECONDS out to the whole history and back, anchored at
+  // the newest sample
+  Zoom,
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+struct Headless {
+  Headless() {
+    ImGui::CreateContext();
+    ImPlot::CreateContext();
+    auto &io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = DISPLAY_SIZE;
+    io.DeltaTime = 1.f / 60.f;
+    // Normally the renderer backend builds the font atlas
+    unsigned char *pixels;
+    int width;
+    int height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+  }
+
+  ~Headless() {
+    ImPlot::DestroyContext();
+    ImGui::DestroyContext();
+  }
+};
+
+// A sine of about a third of full scale with a few codes of noise, in
+// whole ADC codes so the history packs as it does when streaming
+std::unique_ptr<ScopeSettings> makeSettings(size_t samples) {
+  auto settings = std::make_unique<ScopeSettings>();
+  const double seconds = samples * DELTA_TIME;
+  // Everything is retained; what exceeds the RAM budget spills to disk
+  settings->setHistory(seconds + 1.,
+                       2. * samples * sizeof(Sample) / (1 << 20) + 1.);
+
+  const Sample step = adcStep(settings->voltageRange);
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> noise(-3, 3);
+  // 25 blocks hold whole periods of 1 kHz at 50 kS/s, so the pattern
+  // repeats without a seam
+  std::vector<Sample> pattern(INGEST_BLOCK * 25);
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    const double code =
+        std::round(10000. * std::sin(2 * std::numbers::pi * 1000. * i *
+                                     DELTA_TIME)) +
+        noise(gen);
+    pattern[i] = static_cast<Sample>(code) * step;
+  }
+  for (size_t at = 0, blocks = 0; at < samples; at += INGEST_BLOCK) {
+    const size_t n = std::min(INGEST_BLOCK, samples - at);
+    const std::span block{pattern.data() + at % pattern.size(), n};
+    settings->ingest.append({block.begin(), block.end()},
+                            {block.begin(), block.end()});
+    if (++blocks % INGEST_BATCH == 0) {
+      settings->ingest.sync();
+    }
+  }
+  settings->ingest.sync();
+  return settings;
+}
+
+// Visible time range of the given frame of a script
+ImPlotRange view(Script script, size_t frame, double seconds) {
+  const double phase =
+      static_cast<double>(frame % SCRIPT_FRAMES) / (SCRIPT_FRAMES - 1);
+  switch (script) {
+  case Script::Static:
+    return {std::max(seconds - VIEW_SECONDS, 0.), seconds};
+  case Script::Pan: {
+    const double start = std::max(seconds - VIEW_SECONDS, 0.) * phase;
+    return {start, start + VIEW_SECONDS};
+  }
+  case Script::Zoom: {
+    // Log-spaced widths, out and back in
+    const double t = 1. - std::abs(2. * phase - 1.);
+    const double width =
+        MIN_VIEW_SECONDS * std::pow(seconds / MIN_VIEW_SECONDS, t);
+    return {seconds - width, seconds};
+  }
+  }
+  return {0., seconds};
+}
+
+// CPU time of the parts of one frame and the size of what it draws
+struct FrameCost {
+  double scopeMs = 0.;
+  double spectrumMs = 0.;
+  double renderMs = 0.;
+  double frameMs = 0.;
+  // Waiting for the ingest thread to answer the frame's view
+  double ingestMs = 0.;
+  double vertices = 0.;
+  double indices = 0.;
+
+  void add(const FrameCost &other) {
+    scopeMs += other.scopeMs;
+    spectrumMs += other.spectrumMs;
+    renderMs += other.renderMs;
+    frameMs += other.frameMs;
+    ingestMs += other.ingestMs;
+    vertices += other.vertices;
+    indices += other.indices;
+  }
+};
+
+FrameCost drawFrame(ScopeSettings &settings, ImPlotRange limits) {
+  FrameCost res;
+  const auto start = std::chrono::steady_clock::now();
+  ImGui::NewFrame();
+  ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize);
+  ImGui::SetNextWindowPos({0.f, 0.f});
+  ImGui::Begin("Scope", nullptr,
+               ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove |
+                   ImGuiWindowFlags_NoResize);
+  // The oscilloscope is the first plot of the tab
+  ImPlot::SetNextAxisLimits(ImAxis_X1, limits.Min, limits.Max,
+                            ImPlotCond_Always);
+  // The driver is stubbed, so the scope finds no unit and stays closed
+  drawScopeTab(settings, Scope::getInstance());
+  ImGui::End();
+
+  const auto render = std::chrono::steady_clock::now();
+  ImGui::Render();
+  res.renderMs = elapsedMs(render);
+  res.frameMs = elapsedMs(start);
+  res.scopeMs = settings.viewTimes.scopeMs;
+  res.spectrumMs = settings.viewTimes.spectrumMs;
+  const auto *draw = ImGui::GetDrawData();
+  res.vertices = draw->TotalVtxCount;
+  res.indices = draw->TotalIdxCount;
+
+  // A live frame draws whatever was published last, but every scripted
+  // frame should show the view it asked for
+  const auto ingest = std::chrono::steady_clock::now();
+  settings.ingest.sync();
+  res.ingestMs = elapsedMs(ingest);
+  return res;
+}
+
+// Frames of the scope tab over range(0) samples per channel following
+// script range(1). Counters are per frame; `frame_ms` includes building
+// the UI, which the iteration time also covers. The iteration time also
+// covers `ingest_ms`, the wait for the ingest thread to build the traces of
+// the frame's view, which a live frame never waits for.
+void BM_ScopeTabFrame(benchmark::State &state) {
+  static Headless headless;
+  // Filling large histories dominates, so they are kept across scripts
+  static std::unique_ptr<ScopeSettings> settings;
+  static size_t samples = 0;
+  if (!settings || samples != static_cast<size_t>(state.range(0))) {
+    settings.reset();
+    samples = state.range(0);
+    settings = makeSettings(samples);
+  }
+  const auto script = static_cast<Script>(state.range(1));
+  const double seconds = samples * DELTA_TIME;
+  // A spectrum job copies the visible range, which zoomed out to the
+  // largest histories is more memory than the frames being measured, so
+  // it is capped at what the other scripts show
+  settings->showSpectrum = true;
+  settings->spectrumSeconds = VIEW_SECONDS;
+  settings->resetScopeWindow = true;
+  // Lets window and plot sizes settle before timing
+  for (size_t i = 0; i < 3; ++i) {
+    drawFrame(*settings, view(script, 0, seconds));
+  }
+
+  FrameCost total;
+  size_t frame = 0;
+  for (auto _ : state) {
+    total.add(drawFrame(*settings, view(script, frame++, seconds)));
+  }
+  const auto perFrame = benchmark::Counter::kAvgIterations;
+  state.counters["scope_ms"] = benchmark::Counter(total.scopeMs, perFrame);
+  state.counters["spectrum_ms"] =
+      benchmark::Counter(total.spectrumMs, perFrame);
+  state.counters["render_ms"] = benchmark::Counter(total.renderMs, perFrame);
+  state.counters["frame_ms"] = benchmark::Counter(total.frameMs, perFrame);
+  state.counters["ingest_ms"] = benchmark::Counter(total.ingestMs, perFrame);
+  state.counters["vertices"] = benchmark::Counter(total.vertices, perFrame);
+  state.counters["indices"] = benchmark::Counter(total.indices, perFrame);
+}
+} // namespace
+
+// 1e9 samples takes several GB of spill file in the system temporary
+// directory and a while to fill; --benchmark_filter selects smaller runs.
+BENCHMARK(BM_ScopeTabFrame)
+    ->ArgNames({"samples", "script"})
+    ->ArgsProduct({{100000, 1000000, 10000000, 100000000, 1000000000},
+                   {static_cast<int64_t>(Script::Static),
+                    static_cast<int64_t>(Script::Pan),
+                    static_cast<int64_t>(Script::Zoom)}})
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,50 @@
+#ifndef AVERAGE_HPP
+#define AVERAGE_HPP
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+enum class AveragingMode { None, Linear, Exponential, PeakHold, MinHold };
+
+inline constexpr size_t DEFAULT_AVERAGE_LENGTH = 16;
+inline constexpr double DEFAULT_AVERAGE_ALPHA = 0.1;
+
+// Persistent accumulator over successive spectrum estimates in dB.
+// Linear and exponential averaging run on power so the noise floor settles
+// to its mean rather than the mean of its logarithm; the holds compare dB
+// directly. Every update is one pass over the bins and the trace is resized
+// (and restarted) only when the bin count changes.
+class SpectrumAverager {
+  AveragingMode mode;
+  size_t length;
+  double alpha;
+  size_t count = 0;
+  std::vector<double> accumulator;
+  std::vector<double> trace;
+
+public:
+  explicit SpectrumAverager(AveragingMode mode = AveragingMode::None,
+                            size_t length = DEFAULT_AVERAGE_LENGTH,
+                            double alpha = DEFAULT_AVERAGE_ALPHA);
+
+  void update(std::span<const double> db);
+  void reset();
+  void setMode(AveragingMode mode);
+  // Linear mode averages the first `length` estimates equally, then keeps
+  // weighting new ones by 1 / length
+  void setLength(size_t length);
+  void setAlpha(double alpha);
+
+  AveragingMode getMode() const { return mode; }
+  size_t getLength() const { return length; }
+  double getAlpha() const { return alpha; }
+  size_t updates() const { return count; }
+  // Averaged spectrum in dB
+  const std::vector<double> &values() const { return trace; }
+};
+
+std::string to_string(AveragingMode mode);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CODEC_HPP
+#define CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Samples per independently decodable frame of a packed buffer
+inline constexpr size_t CODEC_FRAME = 128;
+
+// Lossless packing of samples that are whole multiples of a quantum, such
+// as scaled ADC codes. Each frame stores either the zigzagged differences
+// of consecutive codes (delta) or the codes less their minimum (frame of
+// reference), whichever needs fewer bits, divided by their common factor
+// and bit-packed in four interleaved lanes so packing and unpacking
+// vectorise.
+//
+// The packed buffer is flat and position independent: its size, the
+// quantum and a frame offset table, followed by the frames. It can be
+// copied or mapped from a file as it is.
+
+// Packs samples into out. Returns false, leaving out unspecified, when a
+// sample is not exactly code * quantum or packing would not save space.
+bool packSamples(std::span<const float> samples, float quantum,
+                 std::vector<uint32_t> &out);
+
+// Number of samples held by a packed buffer
+size_t packedCount(const uint32_t *packed);
+
+// Unpacks the samples [first, first + out.size()) of a packed buffer,
+// decoding only the frames they fall in
+void unpackSamples(const uint32_t *packed, size_t first, std::span<float> out);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef CORRELATION_HPP
+#define CORRELATION_HPP
+
+#include "processing.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+enum class CorrelationWeighting { None, Phat };
+
+struct DelayEstimate {
+  // Delay of A relative to B in samples, positive when A lags B, refined
+  // to a fraction of a sample by a parabola through the peak
+  double delay = 0.;
+  // Correlation coefficient at the peak for None, peak of the whitened
+  // correlation (1 for a pure delay) for Phat
+  double peak = 0.;
+  ptrdiff_t lag = 0;
+  bool valid = false;
+};
+
+// FFT cross-correlation of two channels. Inputs are zero padded only as
+// far as the searched lag range requires, and the plan and buffers are kept
+// between calls, so a steady window size costs two forward and one inverse
+// transform per estimate. The size follows the visible samples, so the
+// plan is owned and replanned here rather than kept in the realFft cache,
+// which would hold one for every size ever seen.
+class CrossCorrelator {
+  CorrelationWeighting weighting;
+  size_t fftSize = 0;
+  std::unique_ptr<RealFft<float>> plan;
+  FftwBuffer<float> bufferA;
+  FftwBuffer<float> bufferB;
+  // Lags -maxLag..maxLag of the last estimate
+  std::vector<float> values;
+  ptrdiff_t maxLag = 0;
+
+public:
+  explicit CrossCorrelator(
+      CorrelationWeighting weighting = CorrelationWeighting::None);
+
+  // maxLag = 0 searches every lag the inputs allow
+  DelayEstimate estimate(std::span<const float> a, std::span<const float> b,
+                         size_t maxLag = 0);
+  void setWeighting(CorrelationWeighting weighting);
+  CorrelationWeighting getWeighting() const { return weighting; }
+  std::span<const float> correlation() const { return values; }
+  ptrdiff_t firstLag() const { return -maxLag; }
+};
+
+std::string to_string(CorrelationWeighting weighting);
+
+#endif
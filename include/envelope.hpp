@@ -0,0 +1,96 @@
+#ifndef ENVELOPE_HPP
+#define ENVELOPE_HPP
+
+#include <cstddef>
+#include <deque>
+#include <span>
+#include <vector>
+
+// Samples summarised by one entry of the finest level
+inline constexpr size_t ENVELOPE_BLOCK = 16;
+// Entries of one level merged into one entry of the next
+inline constexpr size_t ENVELOPE_FACTOR = 4;
+
+// Minimum and maximum of the samples [first, first + count)
+struct EnvelopeBucket {
+  size_t first;
+  size_t count;
+  float min;
+  float max;
+};
+
+// Min/max mipmap of a growing channel. Level k holds the extremes of
+// consecutive blocks of ENVELOPE_BLOCK * ENVELOPE_FACTOR^k samples and is
+// extended as samples are appended, so no rebuild is ever needed. The
+// incomplete block at the end of every level is kept as a running extreme,
+// which lets queries cover the newest samples without the raw data.
+// Samples are addressed by index like SampleStore, starting at the index
+// given to clear(), and entries older than a retained range can be dropped.
+class EnvelopePyramid {
+  struct Level {
+    std::deque<float> min;
+    std::deque<float> max;
+    // Entries dropped from the front by discard()
+    size_t dropped = 0;
+    float pendingMin = 0.f;
+    float pendingMax = 0.f;
+    // Entries of the level below (or samples) in the incomplete block
+    size_t pending = 0;
+  };
+  std::vector<Level> levels;
+  size_t origin = 0;
+  size_t count = 0;
+
+  void push(size_t level, float min, float max);
+
+public:
+  void append(std::span<const float> samples);
+  // Drops everything; the next sample appended gets index `start`
+  void clear(size_t start = 0);
+  // Releases entries that only cover samples before `index`
+  void discard(size_t index);
+
+  // Samples appended since the last clear
+  size_t size() const { return count; }
+  size_t endIndex() const { return origin + count; }
+  size_t levelCount() const { return levels.size(); }
+  static size_t blockSize(size_t level);
+
+  // Envelope of [first, last) in about `buckets` buckets (at most two more),
+  // written to out. Buckets are made of whole blocks of the coarsest level
+  // that still fits the requested resolution, so every sample's extreme
+  // shows at every zoom level; the first and last bucket may reach past the
+  // range. Returns
+  // false, leaving out empty, when fewer than ENVELOPE_BLOCK samples fall in
+  // a bucket and the raw samples should be drawn instead.
+  bool envelope(size_t first, size_t last, size_t buckets,
+                std::vector<EnvelopeBucket> &out) const;
+};
+
+// Min/max mipmap of a fixed series such as one spectrum, built once when
+// the series is replaced. Level k holds the extremes of consecutive blocks
+// of ENVELOPE_FACTOR^k values, the last block of every level being
+// whatever is left, so reducing a range to a bucket per pixel reads only a
+// few entries per bucket however long the series is.
+class PeakPyramid {
+  struct Level {
+    std::vector<float> min;
+    std::vector<float> max;
+  };
+  // Level 0 holds the values themselves in both min and max
+  std::vector<Level> levels;
+
+public:
+  void assign(std::span<const double> series);
+  size_t size() const { return levels.empty() ? 0 : levels[0].min.size(); }
+  size_t levelCount() const { return levels.size(); }
+
+  // Extremes of [first, last) in at most `buckets` buckets (one more where
+  // the first is cut by the range), written to out. Buckets are made of
+  // whole blocks of the coarsest level that fits, so no value's extreme is
+  // ever left out; with fewer values than buckets each value is a bucket.
+  void reduce(size_t first, size_t last, size_t buckets,
+              std::vector<EnvelopeBucket> &out) const;
+};
+
+#endif
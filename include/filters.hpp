@@ -0,0 +1,125 @@
+#ifndef FILTERS_HPP
+#define FILTERS_HPP
+
+#include "processing.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Kernels up to this length are run directly, longer ones by overlap-save
+inline constexpr size_t DIRECT_FIR_TAPS = 64;
+
+enum class FilterType { LowPass, HighPass, BandPass, Notch, FirLowPass, DcBlock };
+
+struct Biquad {
+  double b0, b1, b2, a1, a2;
+};
+
+// RBJ cookbook section normalised so a0 = 1
+Biquad designBiquad(FilterType type, double freq, double q, double sampleRate);
+// Butterworth low/high pass of even order as a cascade of order / 2 sections
+std::vector<Biquad> butterworth(FilterType type, size_t order, double freq,
+                                double sampleRate);
+
+// One stage of a channel's filter chain. State persists across calls so a
+// stream can be filtered block by block; process() keeps the sample count.
+class FilterStage {
+public:
+  virtual ~FilterStage() = default;
+  virtual void process(std::span<float> samples) = 0;
+  virtual void reset() = 0;
+  // Samples of delay added on top of the filter's own group delay
+  virtual size_t latency() const { return 0; }
+};
+
+// Transposed direct form II with double state; one section at a time over
+// the whole block so the coefficients stay in registers.
+class BiquadCascade : public FilterStage {
+  struct Section {
+    Biquad coefficients;
+    double z1 = 0.;
+    double z2 = 0.;
+  };
+  std::vector<Section> sections;
+
+public:
+  explicit BiquadCascade(std::span<const Biquad> coefficients);
+  void process(std::span<float> samples) override;
+  void reset() override;
+};
+
+class FirFilter : public FilterStage {
+  size_t taps;
+  std::vector<float> reversed;
+  std::vector<float> input;
+
+  // Overlap-save state, only used for kernels longer than DIRECT_FIR_TAPS
+  size_t block = 0;
+  FftwBuffer<float> kernelSpectrum;
+  FftwBuffer<float> buffer;
+  std::vector<float> output;
+  size_t outputStart = 0;
+
+  void processDirect(std::span<float> samples);
+  void processOverlapSave(std::span<float> samples);
+
+public:
+  explicit FirFilter(std::span<const double> kernel);
+  void process(std::span<float> samples) override;
+  void reset() override;
+  size_t latency() const override { return block; }
+};
+
+class DcBlocker : public FilterStage {
+  double pole;
+  double x1 = 0.;
+  double y1 = 0.;
+
+public:
+  DcBlocker(double cutoff, double sampleRate);
+  void process(std::span<float> samples) override;
+  void reset() override;
+};
+
+struct FilterSpec {
+  FilterType type = FilterType::LowPass;
+  double freq = 1000.;
+  double q = 0.707;
+  size_t order = 2;
+  size_t taps = 255;
+};
+
+std::string to_string(FilterType type);
+std::unique_ptr<FilterStage> makeFilter(const FilterSpec &spec,
+                                        double sampleRate);
+
+struct FilterStats {
+  double nsPerSample;
+  // Fraction of the real-time budget (one sample period per sample)
+  double load;
+  size_t latency;
+};
+
+class FilterChain {
+  struct Stage {
+    std::unique_ptr<FilterStage> filter;
+    std::chrono::nanoseconds elapsed{0};
+    uint64_t samples = 0;
+  };
+  std::vector<Stage> stages;
+
+public:
+  FilterChain() = default;
+  FilterChain(std::span<const FilterSpec> specs, double sampleRate);
+
+  bool empty() const { return stages.empty(); }
+  void process(std::span<float> samples);
+  void reset();
+  std::vector<FilterStats> stats(double sampleRate) const;
+};
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef INGEST_HPP
+#define INGEST_HPP
+
+#include "envelope.hpp"
+#include "filters.hpp"
+#include "measure.hpp"
+#include "mpsc.hpp"
+#include "persistence.hpp"
+#include "resample.hpp"
+#include "spectrogram.hpp"
+#include "store.hpp"
+#include "stream.hpp"
+#include "sweep.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+// Longest the ingest thread sleeps while a stream is attached, which is as
+// often as the driver is polled for new blocks
+inline constexpr std::chrono::milliseconds INGEST_POLL_INTERVAL{1};
+// New samples are published at most this often; requests from the UI are
+// answered at once
+inline constexpr std::chrono::milliseconds INGEST_PUBLISH_INTERVAL{8};
+
+// What the UI shows, which decides what published snapshots carry
+struct ViewRequest {
+  // Visible time range in seconds
+  double start = 0.;
+  double end = 0.;
+  // Plot width; traces carry about one min/max pair per pixel
+  size_t pixels = 1;
+  bool spectrogram = false;
+
+  bool operator==(const ViewRequest &) const = default;
+};
+
+// Points of one channel over a requested view: either envelope buckets,
+// each drawn as a min/max pair, or the raw samples from `first` on
+struct ChannelTrace {
+  // What the points were built from; they are reused while it is unchanged
+  struct Key {
+    uint64_t version = 0;
+    size_t first = 0;
+    size_t last = 0;
+    size_t pixels = 0;
+
+    bool operator==(const Key &) const = default;
+  };
+  Key key;
+  bool envelope = false;
+  std::vector<EnvelopeBucket> buckets;
+  std::vector<Sample> samples;
+  size_t first = 0;
+
+  size_t points() const {
+    return envelope ? 2 * buckets.size() : samples.size();
+  }
+};
+
+// Spectrogram columns copied out in chronological order, column-major from
+// the highest bin down like Spectrogram keeps them
+struct SpectrogramImage {
+  std::vector<float> data;
+  size_t bins = 0;
+  size_t columns = 0;
+  // Centres of the first and last column in seconds
+  double firstTime = 0.;
+  double lastTime = 0.;
+  double hopSeconds = 0.;
+  double nyquist = 0.;
+};
+
+// Persistence histogram as of the newest sample, row-major from the
+// highest voltage down
+struct PersistenceImage {
+  std::vector<float> data;
+  size_t rows = 0;
+  size_t columns = 0;
+  // Seconds from the trigger to the first column, and between columns
+  double startTime = 0.;
+  double sampleInterval = 0.;
+  double minVolts = 0.;
+  double maxVolts = 0.;
+  // Largest cell, for scaling the colours
+  float peak = 0.f;
+  uint64_t sweeps = 0;
+};
+
+// Everything the UI draws from, as of one moment of the ingest thread
+struct IngestSnapshot {
+  // Request the view-dependent parts were built for
+  ViewRequest view;
+  // Bumped whenever the stored samples change
+  uint64_t version = 0;
+  size_t decimation = 1;
+  // Spacing of the displayed (possibly decimated) samples in seconds
+  double sampleInterval = 0.;
+  // Raw samples retained per channel
+  size_t firstIndex = 0;
+  size_t endIndex = 0;
+  std::array<ChannelTrace, 2> traces;
+  // Displayed samples within the view, answering the requestVisible() call
+  // that returned visibleRequest; a spectrum job can hold them as long as
+  // it needs
+  std::array<SampleSnapshot, 2> visible;
+  uint64_t visibleRequest = 0;
+  // Of the raw (filtered) channels, over the view and over the stream
+  std::array<Measurements, 2> window;
+  std::array<Measurements, 2> stream;
+  std::array<std::vector<FilterStats>, 2> filters;
+  StoreStats history;
+  // Only while view.spectrogram is set; shared until new columns arrive
+  std::shared_ptr<const SpectrogramImage> spectrogram;
+  // Only while persistence is on; shared until new samples arrive
+  std::shared_ptr<const PersistenceImage> persistence;
+  bool sweeping = false;
+  std::vector<BodePoint> bode;
+  double sweepFrequency = 0.;
+};
+
+// Owns the channel history and everything derived from it on a thread of
+// its own. Blocks are filtered, stored, decimated and measured there, and
+// the UI only reads the snapshots it publishes, so a slow frame no longer
+// holds up acquisition and a large append never stalls a frame.
+//
+// Snapshots go through a triple buffer: publishing one and taking the
+// newest are a single atomic exchange each, neither side ever waits for
+// the other, and snapshots the UI was too slow to see are skipped. Changes
+// to the history are posted to the thread and applied in order between
+// blocks.
+class Ingest {
+public:
+  // `retention` and `memoryLimit` are per raw channel, as in SampleStore;
+  // decimated copies keep proportionally less
+  explicit Ingest(double sampleRate,
+                  size_t retention = std::numeric_limits<size_t>::max(),
+                  size_t memoryLimit = std::numeric_limits<size_t>::max());
+  ~Ingest();
+
+  // Takes blocks from `recv` as they arrive, until detached
+  void attach(mpsc::Recv<StreamResult> recv);
+  void detach();
+  // Handled as if the blocks had been streamed
+  void append(std::vector<Sample> a, std::vector<Sample> b);
+  void clear();
+  void setView(const ViewRequest &view);
+  void setDecimation(size_t factor);
+  void setRetention(size_t samples);
+  void setMemoryLimit(size_t bytes);
+  // Step of unfiltered samples, which are stored packed; 0 stores them raw
+  void setQuantum(float step);
+  void setHysteresis(double volts);
+  void setFilters(size_t channel, std::vector<FilterSpec> specs);
+  // Restarts the spectrogram with the given window, hopping half of it
+  void setSpectrogram(size_t windowSize);
+  // Follows the given sweep from its first sample on, or stops following
+  // one and drops its points
+  void trackSweep(std::optional<SweepSchedule> schedule);
+  // Restarts accumulating sweeps with the given settings, or stops
+  // accumulating them; unchanged settings keep what was accumulated
+  void setPersistence(std::optional<PersistenceSettings> settings);
+  // For the thread reading snapshots. Shares the displayed samples within
+  // the view, at most the newest `limit` of them, in the next snapshot and
+  // in every one after until the next request; the returned number tags
+  // the snapshots that carry them. Only taken on request, since a snapshot
+  // pins the chunk being filled, which then cannot be recycled once it is
+  // sealed.
+  uint64_t
+  requestVisible(size_t limit = std::numeric_limits<size_t>::max());
+  // Returns once everything posted before has been applied and published
+  void sync();
+
+  // For the one thread reading snapshots. Moves on to the newest published
+  // snapshot, or returns false if there is none newer than current().
+  bool acquire();
+  const IngestSnapshot &current() const { return slots[front]; }
+
+  Ingest(const Ingest &other) = delete;
+
+private:
+  using Command = std::move_only_function<void()>;
+  static constexpr uint8_t FRESH = 1 << 7;
+
+  double sampleRate;
+
+  // Owned by the ingest thread
+  std::optional<mpsc::Recv<StreamResult>> recv;
+  ViewRequest view;
+  // Starts above any trace key, so every trace is built once
+  uint64_t version = 1;
+  size_t decimation = 1;
+  size_t retention;
+  size_t memoryLimit;
+  float quantum = 0.f;
+  std::array<SampleStore, 2> raw;
+  // Reduced-rate copies, kept only while decimation > 1
+  std::array<DecimationChain<Sample>, 2> decimators;
+  std::array<SampleStore, 2> decimated;
+  // Min/max pyramids of the displayed (possibly decimated) channels
+  std::array<EnvelopePyramid, 2> envelopes;
+  std::array<FilterChain, 2> filters;
+  std::array<ChannelStats, 2> stats;
+  // Incoming blocks after filtering and decimation
+  std::array<std::vector<Sample>, 2> incoming;
+  std::vector<Sample> incomingDecimated;
+  // Stream index after the last block; appended blocks continue from it
+  uint64_t streamEnd = 0;
+  Spectrogram spectrogram;
+  std::shared_ptr<const SpectrogramImage> image;
+  // Columns the spectrogram had produced when the image was copied
+  uint64_t imageEnd = 0;
+  std::optional<SweepTracker> sweepTracker;
+  std::optional<Persistence> persistence;
+  std::shared_ptr<const PersistenceImage> persistenceImage;
+  // Every image copied so far, refilled once no snapshot holds it
+  std::vector<std::shared_ptr<PersistenceImage>> persistenceImages;
+  // Samples were accumulated since the image was copied
+  bool persistenceStale = false;
+  // Samples answering the last visible request, rebuilt when it is new
+  std::array<SampleSnapshot, 2> visible;
+  uint64_t visibleRequest = 0;
+  size_t visibleLimit = 0;
+  bool visibleStale = false;
+  // Something changed since the last snapshot was published
+  bool changed = true;
+  std::vector<std::promise<void>> synced;
+
+  // The writer fills slots[back] and the reader reads slots[front]; middle
+  // holds the third, with FRESH set until the reader takes it
+  std::array<IngestSnapshot, 3> slots;
+  uint8_t back = 0;
+  uint8_t front = 2;
+  std::atomic<uint8_t> middle = 1;
+  // Owned by the reader
+  uint64_t visibleRequests = 0;
+
+  std::mutex inboxLock;
+  std::condition_variable wake;
+  std::vector<Command> inbox;
+  bool stopping = false;
+  // Last, so it starts once everything it uses is constructed
+  std::thread thread;
+
+  void post(Command command);
+  void run();
+  // `first` is the stream index of the block's first sample
+  void ingest(std::span<const Sample> a, std::span<const Sample> b,
+              uint64_t first);
+  const SampleStore &displayed(size_t channel) const;
+  void publish();
+};
+
+#endif
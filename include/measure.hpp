@@ -0,0 +1,103 @@
+#ifndef MEASURE_HPP
+#define MEASURE_HPP
+
+#include "store.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <span>
+#include <vector>
+
+struct Measurements {
+  size_t count = 0;
+  double mean = 0.;
+  double rms = 0.;
+  double min = 0.;
+  double max = 0.;
+  double pkToPk = 0.;
+  // Rising zero crossings; both 0 when fewer than two were seen
+  double frequency = 0.;
+  double period = 0.;
+};
+
+// Incrementally maintained statistics of one channel. Every BLOCK samples
+// the running sums and extremes are folded into prefix arrays, so any
+// window is measured from its whole blocks in O(blocks) plus at most two
+// partial blocks of raw samples, rather than by rescanning the history.
+class ChannelStats {
+public:
+  static constexpr size_t BLOCK = 4096;
+
+  struct Summary {
+    double sum = 0.;
+    double sumSq = 0.;
+    float min = std::numeric_limits<float>::max();
+    float max = std::numeric_limits<float>::lowest();
+
+    void merge(const Summary &other);
+  };
+
+private:
+  double hysteresis;
+  double sampleInterval;
+
+  // Entry k - droppedBlocks describes block k (prefix sums: up to block k)
+  std::deque<double> prefixSum{0.};
+  std::deque<double> prefixSq{0.};
+  std::deque<float> blockMin;
+  std::deque<float> blockMax;
+  // Blocks dropped from the front by discard()
+  size_t droppedBlocks = 0;
+  Summary current;
+  Summary total;
+  size_t count = 0;
+
+  // Sub-sample positions of rising zero crossings, in stream order
+  std::deque<double> crossings;
+  bool armed = false;
+  float previous = 0.f;
+
+  Measurements finish(const Summary &summary, size_t n, double firstCrossing,
+                      double lastCrossing, size_t crossingCount) const;
+  // `partial` summarises raw samples of the ends not covered by blocks
+  Measurements
+  window(size_t left, size_t right,
+         const std::function<Summary(size_t, size_t)> &partial) const;
+
+public:
+  ChannelStats(double hysteresis, double sampleInterval);
+
+  void setHysteresis(double volts) { hysteresis = volts; }
+  void append(std::span<const float> samples);
+  void clear();
+  // Releases blocks and crossings before sample `index`, which windows
+  // then no longer reach back to
+  void discard(size_t index);
+
+  // `data` is the channel the samples were appended to
+  Measurements window(std::span<const float> data, size_t left,
+                      size_t right) const;
+  // Only the retained part of the window is measured
+  Measurements window(const SampleStore &data, size_t left,
+                      size_t right) const;
+  Measurements stream() const;
+};
+
+ChannelStats::Summary summarize(std::span<const float> samples);
+
+struct SpectralMetrics {
+  double fundamental = 0.; // Hz
+  double thd = 0.;         // dB
+  double sinad = 0.;       // dB
+  double snr = 0.;         // dB
+};
+
+// Tone metrics from a one-sided power spectrum. Power within `leakage` bins
+// of the fundamental and of each harmonic is attributed to that component;
+// the DC region is excluded.
+SpectralMetrics spectralMetrics(std::span<const double> power, double binWidth,
+                                size_t harmonics = 5, size_t leakage = 3);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef PERSISTENCE_HPP
+#define PERSISTENCE_HPP
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+inline constexpr size_t DEFAULT_PERSISTENCE_ROWS = 256;
+inline constexpr size_t DEFAULT_PERSISTENCE_LENGTH = 512;
+
+struct PersistenceSettings {
+  size_t channel = 0;
+  // Sweeps start at rising crossings of `level` volts, each one armed by
+  // the signal first dropping `hysteresis` below it
+  double level = 0.;
+  double hysteresis = 0.2;
+  // Samples per sweep, `pretrigger` of them before the crossing
+  size_t length = DEFAULT_PERSISTENCE_LENGTH;
+  size_t pretrigger = DEFAULT_PERSISTENCE_LENGTH / 4;
+  // Voltage bins spanning [minVolts, maxVolts)
+  size_t rows = DEFAULT_PERSISTENCE_ROWS;
+  double minVolts = -10.;
+  double maxVolts = 10.;
+  // Seconds for a sweep's hits to fade to half; 0 keeps every sweep
+  double halfLife = 0.5;
+
+  bool operator==(const PersistenceSettings &) const = default;
+};
+
+// Digital-phosphor view of a live stream: every sweep aligned on a trigger
+// is binned into a rows x length histogram of voltage against time from
+// the trigger, and then dropped, so any number of sweeps costs the same
+// memory. Older hits fade exponentially with stream time. Rather than
+// scaling the whole histogram on every sweep, new hits are weighted ever
+// more heavily and the histogram is rescaled only when the weight grows
+// large, so a sweep costs O(length).
+class Persistence {
+  PersistenceSettings settings;
+  double sampleRate;
+
+  // Row-major from the highest voltage down, plus a last row collecting
+  // the samples outside the voltage range, one cell per column, so the
+  // hits of a sweep never share a cell
+  std::vector<float> histogram;
+  std::vector<int32_t> cells;
+  // Samples that may still start or complete a sweep; scanning for
+  // triggers resumes at `scan`
+  std::vector<float> pending;
+  size_t scan = 0;
+  bool armed = false;
+  // Stream position of the end of pending, and of the last rescale
+  uint64_t position = 0;
+  uint64_t base = 0;
+  uint64_t sweeps = 0;
+
+  // Weight of a hit at stream position `at`, relative to the last rescale
+  float weight(uint64_t at) const;
+  void accumulate(const float *sweep, uint64_t at);
+
+public:
+  Persistence(const PersistenceSettings &settings, double sampleRate);
+
+  // Returns the number of sweeps accumulated from `samples`
+  size_t push(std::span<const float> samples);
+  void clear();
+
+  const PersistenceSettings &getSettings() const { return settings; }
+  size_t rows() const { return settings.rows; }
+  size_t columns() const { return settings.length; }
+  uint64_t sweepCount() const { return sweeps; }
+  // Seconds from the trigger to the first column
+  double startTime() const { return -(settings.pretrigger / sampleRate); }
+  double sampleInterval() const { return 1. / sampleRate; }
+
+  // Hits per cell faded to the newest sample, in the layout ImPlot's
+  // heatmap draws row-major, written to out. Returns the largest.
+  float copyTo(std::vector<float> &out) const;
+};
+
+#endif
@@ -3,16 +3,20 @@
 
 #include "libps2000/ps2000.h"
 #include "mpsc.hpp"
+#include "scheduler.hpp"
+#include "stream.hpp"
+#include "sweep.hpp"
 
 #include <array>
 #include <atomic>
-#include <thread>
+#include <chrono>
 #include <vector>
 
 inline constexpr enPS2000Range DEFAULT_VOLTAGE_RANGE = PS2000_10V;
 inline constexpr enPS2000TimeUnits TIME_UNITS = PS2000_US;
 inline constexpr double DWELL_TIME = 0.02;
-inline constexpr size_t SAMPLE_INTERVAL = 20;
+// How often the driver is asked for new streaming values
+inline constexpr std::chrono::milliseconds STREAM_POLL_INTERVAL{1};
 
 constexpr double timeUnitToSecs() {
   switch (TIME_UNITS) {
@@ -32,10 +36,10 @@ constexpr double timeUnitToSecs() {
     return 1.0;
   }
 }
-inline constexpr double DELTA_TIME = timeUnitToSecs() * SAMPLE_INTERVAL;
-inline constexpr double SAMPLE_RATE = 1. / DELTA_TIME;
+// DELTA_TIME in stream.hpp is kept free of the driver headers
+static_assert(timeUnitToSecs() * SAMPLE_INTERVAL == DELTA_TIME,
+              "SAMPLE_INTERVAL is in TIME_UNITS");
 inline constexpr size_t OVERVIEW_BUFFER_SIZE = 1e6;
-inline constexpr size_t WAVEFORM_SECONDS = 30;
 inline constexpr size_t PHASE_ACC_SIZE = (size_t)1 << 32;
 inline constexpr size_t AWG_BUF_SIZE = 4096;
 inline constexpr size_t DDS_FREQ = 48e6;
@@ -45,10 +49,8 @@ std::array<uint8_t, AWG_BUF_SIZE> getNoiseWaveform();
 inline const std::array<uint8_t, AWG_BUF_SIZE> NOISE_WAVEFORM =
     getNoiseWaveform();
 
-struct StreamResult {
-  std::vector<double> dataA;
-  std::vector<double> dataB;
-};
+// Volts per ADC code; every streamed sample is a whole multiple of it
+Sample adcStep(enPS2000Range range);
 
 class Scope {
   int16_t handle = 0;
@@ -56,12 +58,14 @@ class Scope {
   bool open = false;
   std::atomic<bool> streaming = false;
   bool generating = false;
-  std::thread streamTask;
+  PeriodicTask streamTask;
   bool dc = true;
 
   enPS2000Range voltageRange = DEFAULT_VOLTAGE_RANGE;
+  SweepSchedule sweepSchedule;
 
   void restartStream(bool settingsChanged = true);
+  void startPolling();
   Scope();
   ~Scope();
 
@@ -82,6 +86,8 @@ public:
   bool startFreqSweep(double start, double end, double pkToPkV, uint32_t sweeps,
                       double sweepDuration, PS2000_SWEEP_TYPE sweepType);
   void stopSigGen();
+  // Schedule of the last frequency sweep handed to the generator
+  const SweepSchedule &getSweepSchedule() const;
 
   // Scope object cannot be copied
   Scope(const Scope &other) = delete;
@@ -1,13 +1,20 @@
 #ifndef PROCESSING_HPP
 #define PROCESSING_HPP
 
+#include "profiler.hpp"
+#include "scheduler.hpp"
+
+#include <algorithm>
 #include <complex>
 #include <concepts>
 #include <fftw3.h>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <range/v3/all.hpp>
 #include <ranges>
+#include <span>
+#include <stop_token>
 #include <unordered_map>
 #include <vector>
 
@@ -27,6 +34,235 @@ inline constexpr std::array AVAILABLE_WINDOWS{hann, hamming, blackman};
 inline const std::unordered_map<std::string, WindowFunction> WINDOW_MAP{
     {"Hann", hann}, {"Hamming", hamming}, {"Blackman", blackman}};
 
+// Narrowest floating point type that represents the samples of R exactly
+// enough; float input stays float through the whole pipeline.
+template <typename R>
+using SampleType = std::conditional_t<
+    std::same_as<std::remove_cvref_t<std::ranges::range_value_t<R>>, float>,
+    float, double>;
+
+std::mutex &fftwPlannerLock();
+
+template <std::floating_point T> struct Fftw;
+
+template <> struct Fftw<double> {
+  using Complex = fftw_complex;
+  using Plan = fftw_plan;
+  static double *allocReal(size_t n) { return fftw_alloc_real(n); }
+  static Complex *allocComplex(size_t n) { return fftw_alloc_complex(n); }
+  static void free(void *p) { fftw_free(p); }
+  static Plan planR2C(size_t n, double *in, Complex *out) {
+    return fftw_plan_dft_r2c_1d(n, in, out, FFTW_ESTIMATE);
+  }
+  static Plan planC2R(size_t n, Complex *in, double *out) {
+    return fftw_plan_dft_c2r_1d(n, in, out, FFTW_ESTIMATE);
+  }
+  static void execute(Plan p, double *in, Complex *out) {
+    fftw_execute_dft_r2c(p, in, out);
+  }
+  static void execute(Plan p, Complex *in, double *out) {
+    fftw_execute_dft_c2r(p, in, out);
+  }
+  static Plan planDft(size_t n, Complex *in, Complex *out) {
+    return fftw_plan_dft_1d(n, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
+  }
+  static void execute(Plan p, Complex *in, Complex *out) {
+    fftw_execute_dft(p, in, out);
+  }
+  static void destroy(Plan p) { fftw_destroy_plan(p); }
+};
+
+template <> struct Fftw<float> {
+  using Complex = fftwf_complex;
+  using Plan = fftwf_plan;
+  static float *allocReal(size_t n) { return fftwf_alloc_real(n); }
+  static Complex *allocComplex(size_t n) { return fftwf_alloc_complex(n); }
+  static void free(void *p) { fftwf_free(p); }
+  static Plan planR2C(size_t n, float *in, Complex *out) {
+    return fftwf_plan_dft_r2c_1d(n, in, out, FFTW_ESTIMATE);
+  }
+  static Plan planC2R(size_t n, Complex *in, float *out) {
+    return fftwf_plan_dft_c2r_1d(n, in, out, FFTW_ESTIMATE);
+  }
+  static void execute(Plan p, float *in, Complex *out) {
+    fftwf_execute_dft_r2c(p, in, out);
+  }
+  static void execute(Plan p, Complex *in, float *out) {
+    fftwf_execute_dft_c2r(p, in, out);
+  }
+  static Plan planDft(size_t n, Complex *in, Complex *out) {
+    return fftwf_plan_dft_1d(n, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
+  }
+  static void execute(Plan p, Complex *in, Complex *out) {
+    fftwf_execute_dft(p, in, out);
+  }
+  static void destroy(Plan p) { fftwf_destroy_plan(p); }
+};
+
+// SIMD-aligned buffer from the FFTW allocator. Every buffer handed to a cached
+// plan must come from here so the plan's alignment assumptions hold.
+template <std::floating_point T> struct FftwBuffer {
+  struct Deleter {
+    void operator()(void *p) const { Fftw<T>::free(p); }
+  };
+
+  std::unique_ptr<T[], Deleter> real;
+  std::unique_ptr<typename Fftw<T>::Complex[], Deleter> complex;
+  size_t size = 0;
+
+  FftwBuffer() = default;
+  explicit FftwBuffer(size_t n)
+      : real(Fftw<T>::allocReal(n)),
+        complex(Fftw<T>::allocComplex(n / 2 + 1)), size(n) {}
+
+  std::complex<T> *out() {
+    return reinterpret_cast<std::complex<T> *>(complex.get());
+  }
+};
+
+// Real-to-complex plan of a fixed size and its inverse, executed on caller
+// buffers. Planning happens once per size; executing a plan is thread safe in
+// FFTW.
+template <std::floating_point T> class RealFft {
+  typename Fftw<T>::Plan plan;
+  typename Fftw<T>::Plan inversePlan;
+
+public:
+  const size_t size;
+
+  explicit RealFft(size_t n) : size(n) {
+    FftwBuffer<T> scratch{n};
+    std::unique_lock temp{fftwPlannerLock()};
+    plan = Fftw<T>::planR2C(n, scratch.real.get(), scratch.complex.get());
+    inversePlan =
+        Fftw<T>::planC2R(n, scratch.complex.get(), scratch.real.get());
+  }
+  ~RealFft() {
+    std::unique_lock temp{fftwPlannerLock()};
+    Fftw<T>::destroy(plan);
+    Fftw<T>::destroy(inversePlan);
+  }
+  RealFft(const RealFft &other) = delete;
+
+  void execute(FftwBuffer<T> &buffer) const {
+    Fftw<T>::execute(plan, buffer.real.get(), buffer.complex.get());
+  }
+  // Unnormalised: the result is scaled by size. Overwrites the complex half.
+  void inverse(FftwBuffer<T> &buffer) const {
+    Fftw<T>::execute(inversePlan, buffer.complex.get(), buffer.real.get());
+  }
+};
+
+// Plans are never destroyed: scheduler workers may still be running jobs on
+// them while statics are torn down at exit
+template <std::floating_point T> const RealFft<T> &realFft(size_t n) {
+  static auto &lock = *new std::mutex;
+  static auto &plans = *new std::unordered_map<size_t, RealFft<T>>;
+  std::unique_lock temp{lock};
+  return plans.try_emplace(n, n).first->second;
+}
+
+// Forward complex-to-complex plan of a fixed size, executed out of place on
+// caller buffers from Fftw<T>::allocComplex.
+template <std::floating_point T> class ComplexFft {
+  typename Fftw<T>::Plan plan;
+
+public:
+  const size_t size;
+
+  explicit ComplexFft(size_t n) : size(n) {
+    std::unique_ptr<typename Fftw<T>::Complex[],
+                    typename FftwBuffer<T>::Deleter>
+        in(Fftw<T>::allocComplex(n)), out(Fftw<T>::allocComplex(n));
+    std::unique_lock temp{fftwPlannerLock()};
+    plan = Fftw<T>::planDft(n, in.get(), out.get());
+  }
+  ~ComplexFft() {
+    std::unique_lock temp{fftwPlannerLock()};
+    Fftw<T>::destroy(plan);
+  }
+  ComplexFft(const ComplexFft &other) = delete;
+
+  void execute(typename Fftw<T>::Complex *in,
+               typename Fftw<T>::Complex *out) const {
+    Fftw<T>::execute(plan, in, out);
+  }
+};
+
+// Never destroyed, like the realFft cache
+template <std::floating_point T> const ComplexFft<T> &complexFft(size_t n) {
+  static auto &lock = *new std::mutex;
+  static auto &plans = *new std::unordered_map<size_t, ComplexFft<T>>;
+  std::unique_lock temp{lock};
+  return plans.try_emplace(n, n).first->second;
+}
+
+// Per-thread FFTW buffer of n samples kept between calls, so repeated
+// transforms of one size never allocate. Slot separates buffers that are live
+// at the same time.
+template <std::floating_point T, int Slot = 0>
+FftwBuffer<T> &scratchBuffer(size_t n) {
+  thread_local FftwBuffer<T> buffer;
+  if (buffer.size != n) {
+    buffer = FftwBuffer<T>{n};
+  }
+  return buffer;
+}
+
+// Per-thread complex FFTW buffer of n bins kept between calls, like
+// scratchBuffer
+template <std::floating_point T, int Slot = 0>
+typename Fftw<T>::Complex *complexScratch(size_t n) {
+  thread_local std::unique_ptr<typename Fftw<T>::Complex[],
+                               typename FftwBuffer<T>::Deleter>
+      buffer;
+  thread_local size_t size = 0;
+  if (size != n) {
+    buffer.reset(Fftw<T>::allocComplex(n));
+    size = n;
+  }
+  return buffer.get();
+}
+
+template <std::floating_point T>
+std::vector<T> windowCoefficients(const WindowFunction &f, size_t N) {
+  std::vector<T> res(N);
+  for (size_t i = 0; i < N; ++i) {
+    res[i] = f(i, N);
+  }
+  return res;
+}
+
+// View of the input as contiguous T, copying only when the range is lazy or
+// of a different sample type.
+template <std::floating_point T, DoubleRange R>
+std::span<const T> contiguousSamples(R &&in, std::vector<T> &storage) {
+  using V = std::remove_cvref_t<std::ranges::range_value_t<R>>;
+  if constexpr (std::ranges::contiguous_range<R> &&
+                std::ranges::sized_range<R> && std::same_as<V, T>) {
+    return {std::ranges::data(in), std::ranges::size(in)};
+  } else {
+    storage.clear();
+    for (auto &&e : in) {
+      storage.push_back(static_cast<T>(e));
+    }
+    return storage;
+  }
+}
+
+// Element-wise product of contiguous samples and precomputed window
+// coefficients; all three spans have the same length.
+template <std::floating_point T>
+void applyWindow(std::span<const T> in, std::span<const T> window,
+                 std::span<T> out) {
+  const T *__restrict x = in.data();
+  const T *__restrict w = window.data();
+  T *__restrict y = out.data();
+  for (size_t i = 0; i < in.size(); ++i) {
+    y[i] = w[i] * x[i];
+  }
+}
+
 auto applyWindow(DoubleRange auto &&in, WindowFunction f = hann) {
   size_t N = ranges::distance(in);
   return ranges::views::enumerate(in) |
@@ -36,118 +272,239 @@ auto applyWindow(DoubleRange auto &&in, WindowFunction f = hann) {
          });
 }
 
-std::vector<std::complex<double>> fft(DoubleRange auto &&input,
-                                      std::mutex *lock = nullptr) {
+// Single-sided amplitude spectrum of contiguous samples written to out, which
+// holds input.size() / 2 + 1 bins. Allocation free once a size has been seen.
+template <std::floating_point T>
+void fft(std::span<const T> input, std::span<std::complex<T>> out) {
+  const size_t N = input.size();
+  auto &buffer = scratchBuffer<T>(N);
+  std::ranges::copy(input, buffer.real.get());
+
+  realFft<T>(N).execute(buffer);
+
+  const T scale = T(2) / N;
+  const auto *bins = buffer.out();
+  for (size_t i = 0; i < N / 2 + 1; ++i) {
+    out[i] = bins[i] * scale;
+  }
+  out[0] /= 2;
+  if (N % 2 == 0) {
+    out[N / 2] /= 2;
+  }
+}
 
+template <DoubleRange R, typename T = SampleType<R>>
+std::vector<std::complex<T>> fft(R &&input) {
   const size_t N = std::ranges::distance(input);
   if (N < 10) {
     return {};
   }
-  const size_t N_out = N / 2 + 1;
-  double *in = fftw_alloc_real(N);
-  fftw_complex *out = fftw_alloc_complex(N_out);
-  fftw_plan p;
+  std::vector<T> storage;
+  std::vector<std::complex<T>> outComplex(N / 2 + 1);
+  fft<T>(contiguousSamples<T>(input, storage), outComplex);
+  return outComplex;
+}
 
-  if (lock) {
-    std::unique_lock temp{*lock};
-    p = fftw_plan_dft_r2c_1d(N, in, out, FFTW_ESTIMATE);
-  } else {
-    p = fftw_plan_dft_r2c_1d(N, in, out, FFTW_ESTIMATE);
-  }
+// Averaged auto- and cross-spectra of channel A (response) against channel B
+// (reference). Sab accumulates A * conj(B) so that H1 = Sab / Sbb.
+struct CrossSpectrum {
+  std::vector<double> saa;
+  std::vector<double> sbb;
+  std::vector<std::complex<double>> sab;
+  size_t windowSize = 0;
+  size_t segments = 0;
+  // Frequency of the first bin; non-zero only for zoomed spectra
+  double startFrequency = 0.;
+};
 
-  std::ranges::copy(input, in);
+struct TransferFunction {
+  std::vector<double> h1;         // dB
+  std::vector<double> h2;         // dB
+  std::vector<double> phase;      // unwrapped arg(H1), radians
+  std::vector<double> groupDelay; // seconds
+  std::vector<double> coherence;  // magnitude-squared, 0..1
+  double binWidth = 0.;           // Hz
+  double startFrequency = 0.;     // Hz, frequency of bin 0
+};
 
-  fftw_execute(p);
+TransferFunction transferFunction(const CrossSpectrum &spectrum,
+                                  double sampleRate);
 
-  auto outComplex = std::span(out, N_out) |
-                    std::views::transform([N](auto &&e) {
-                      return std::complex<double>{e[0] / N, e[1] / N} * 2.;
-                    }) |
-                    ranges::to_vector;
-  outComplex[0] /= 2;
-  if (N % 2 == 0) {
-    outComplex[N / 2] /= 2;
-  }
+// Called with the spectrum accumulated so far after each refinement pass
+using SpectrumProgress = std::function<void(const CrossSpectrum &)>;
 
-  if (lock) {
-    std::unique_lock temp{*lock};
-    fftw_destroy_plan(p);
-  } else {
-    fftw_destroy_plan(p);
+// Passes the segments are spread over when progress is reported. Each pass
+// halves the spacing between processed segments, so every preview covers
+// the whole record: 1/8, 1/4, 1/2 and finally all segments.
+inline constexpr size_t SPECTRUM_PASSES = 4;
+
+// Runs the `count` segments of a cross spectrum accumulating into res on
+// the scheduler's threads. Each pass visits segments offset, offset +
+// spacing, ...; without progress there is a single pass over all of them.
+// A pass is split into a few chunks per thread, and chunk(offset, spacing,
+// first, last) handles its segments offset + i * spacing for i in [first,
+// last), accumulating privately and merging into res once. progress(res)
+// follows every pass but the last, unless stopped.
+template <typename Chunk>
+void spectrumPasses(size_t count, CrossSpectrum &res, std::stop_token stop,
+                    const SpectrumProgress &progress, const Chunk &chunk) {
+  const size_t coarsest = progress ? size_t{1} << (SPECTRUM_PASSES - 1) : 1;
+  std::vector<std::pair<size_t, size_t>> passes{{0, coarsest}};
+  for (size_t spacing = coarsest; spacing > 1; spacing /= 2) {
+    passes.emplace_back(spacing / 2, spacing);
   }
-  fftw_free(in);
-  fftw_free(out);
 
-  return outComplex;
+  auto &scheduler = Scheduler::getInstance();
+  for (size_t p = 0; p < passes.size(); ++p) {
+    const auto [offset, spacing] = passes[p];
+    if (offset >= count) {
+      continue;
+    }
+    const size_t n = (count - offset + spacing - 1) / spacing;
+    const size_t grain =
+        std::max<size_t>(1, n / (4 * scheduler.getParallelism()));
+    scheduler.parallelFor(Priority::Interactive, "crossSpectrum", n, grain,
+                          [&](size_t first, size_t last) {
+                            chunk(offset, spacing, first, last);
+                          });
+
+    if (stop.stop_requested()) {
+      return;
+    }
+    if (progress && p + 1 < passes.size()) {
+      progress(res);
+    }
+  }
 }
 
-std::vector<double> welch(DoubleRange auto &&dataA, DoubleRange auto &&dataB,
-                          size_t windowSize = 1024, WindowFunction windowFn = hann) {
-  namespace rv = ranges::views;
-  const size_t N = ranges::distance(dataA);
-  if (N < 10 || ranges::distance(dataB) != N) {
-    return {};
+// Cross spectrum of contiguous channels into res, reusing its storage. The
+// per-thread FFT buffers and accumulators persist between calls.
+// `stop` is checked between segments; once requested, res holds the
+// segments finished so far. `progress`, if set, is called after every
+// refinement pass but the last.
+template <std::floating_point T>
+void crossSpectrum(std::span<const T> a, std::span<const T> b,
+                   CrossSpectrum &res, size_t windowSize = 1024,
+                   const WindowFunction &windowFn = hann,
+                   std::stop_token stop = {},
+                   const SpectrumProgress &progress = {}) {
+  const size_t N = a.size();
+  ProfileScope profile{Stage::Welch, N};
+  res.segments = 0;
+  res.startFrequency = 0.;
+  if (N < 10 || b.size() != N) {
+    res.windowSize = 0;
+    res.saa.clear();
+    res.sbb.clear();
+    res.sab.clear();
+    return;
   }
 
-  size_t stride = windowSize * OVERLAP;
-  auto limit = N - windowSize + stride;
+  windowSize = std::min(windowSize, N);
+  const size_t stride = std::max<size_t>(windowSize * OVERLAP, 1);
+  const size_t limit = N - windowSize + stride;
+  const size_t bins = windowSize / 2 + 1;
+  const auto window = windowCoefficients<T>(windowFn, windowSize);
+  const auto &plan = realFft<T>(windowSize);
 
-  size_t count = 0;
-  std::vector<std::complex<double>> total(windowSize / 2 + 1, {0., 0.});
+  res.windowSize = windowSize;
+  res.saa.assign(bins, 0.);
+  res.sbb.assign(bins, 0.);
+  res.sab.assign(bins, {0., 0.});
 
-  if (N <= windowSize) {
-    auto a = fft(applyWindow(dataA, windowFn));
-    auto b = fft(applyWindow(dataB, windowFn));
-    auto tnsf = rv::zip(a, b) | rv::transform([](auto &&p) {
-                  return std::pow(p.first / p.second, 2);
-                });
-    total = tnsf | ranges::to_vector;
-    count = 1;
-  } else {
+  const size_t segmentCount = (limit + stride - 1) / stride;
+  std::mutex mergeLock;
+  spectrumPasses(
+      segmentCount, res, stop, progress,
+      [&](size_t offset, size_t spacing, size_t first, size_t last) {
+        auto &bufA = scratchBuffer<T, 0>(windowSize);
+        auto &bufB = scratchBuffer<T, 1>(windowSize);
+        // Split re/im accumulators keep the per-bin update a plain
+        // multiply-add the compiler can vectorise, unlike std::complex
+        // multiplication.
+        thread_local std::vector<T> accumulators;
+        accumulators.assign(4 * bins, 0);
+        T *__restrict saa = accumulators.data();
+        T *__restrict sbb = saa + bins;
+        T *__restrict sabRe = sbb + bins;
+        T *__restrict sabIm = sabRe + bins;
 
-    std::mutex lock;
-
-#pragma omp parallel for
-    for (int left = 0; left < limit; left += stride) {
-      int right = left + windowSize;
-      auto a = dataA | rv::slice(left, right > N ? static_cast<int>(N) : right);
-      auto b = dataB | rv::slice(left, right > N ? static_cast<int>(N) : right);
-
-      size_t pad = right > N ? right - N : 0;
-      auto padrng = rv::repeat_n(0., pad);
-      auto aPadded = rv::concat(a, padrng);
-      auto bPadded = rv::concat(b, padrng);
-
-      auto aHanned = applyWindow(aPadded, windowFn);
-      auto bHanned = applyWindow(bPadded, windowFn);
-
-      auto aTrans = fft(aHanned, &lock);
-      auto bTrans = fft(bHanned, &lock);
-
-      auto tnsf = rv::zip(aTrans, bTrans) | rv::transform([](auto &&p) {
-                    auto &&[a, b] = std::forward<decltype(p)>(p);
-                    auto temp = a / b;
-                    return temp * temp;
-                  });
-
-#pragma omp critical
-      {
-        ranges::for_each(rv::enumerate(tnsf), [&total](auto &&p) {
-          auto &&[i, e] = std::forward<decltype(p)>(p);
-          total[i] += e;
-        });
-      }
-#pragma omp atomic
-      ++count;
-    }
-  }
+        size_t done = 0;
+        for (size_t index = first; index < last; ++index, ++done) {
+          if (stop.stop_requested()) {
+            break;
+          }
+          const size_t left = (offset + index * spacing) * stride;
+          const size_t valid = std::min(windowSize, N - left);
+          T *__restrict inA = bufA.real.get();
+          T *__restrict inB = bufB.real.get();
+          const T *__restrict w = window.data();
+          for (size_t i = 0; i < valid; ++i) {
+            inA[i] = w[i] * a[left + i];
+            inB[i] = w[i] * b[left + i];
+          }
+          std::fill(inA + valid, inA + windowSize, T(0));
+          std::fill(inB + valid, inB + windowSize, T(0));
+
+          plan.execute(bufA);
+          plan.execute(bufB);
+
+          const T *__restrict outA = bufA.complex.get()[0];
+          const T *__restrict outB = bufB.complex.get()[0];
+          for (size_t i = 0; i < bins; ++i) {
+            const T ar = outA[2 * i], ai = outA[2 * i + 1];
+            const T br = outB[2 * i], bi = outB[2 * i + 1];
+            saa[i] += ar * ar + ai * ai;
+            sbb[i] += br * br + bi * bi;
+            sabRe[i] += ar * br + ai * bi;
+            sabIm[i] += ai * br - ar * bi;
+          }
+        }
 
-  auto ret =
-      total | rv::transform([count](auto &&e) { return e / (double)count; }) |
-      rv::transform([](auto &&e) { return 10 * std::log10(std::abs(e)); }) |
-      ranges::to_vector;
+        std::unique_lock temp{mergeLock};
+        for (size_t i = 0; i < bins; ++i) {
+          res.saa[i] += saa[i];
+          res.sbb[i] += sbb[i];
+          res.sab[i] += std::complex<double>(sabRe[i], sabIm[i]);
+        }
+        res.segments += done;
+      });
+}
+
+template <DoubleRange RA, DoubleRange RB, typename T = SampleType<RA>>
+CrossSpectrum crossSpectrum(RA &&dataA, RB &&dataB, size_t windowSize = 1024,
+                            WindowFunction windowFn = hann) {
+  std::vector<T> storageA, storageB;
+  CrossSpectrum res;
+  crossSpectrum<T>(contiguousSamples<T>(dataA, storageA),
+                   contiguousSamples<T>(dataB, storageB), res, windowSize,
+                   windowFn);
+  return res;
+}
+
+// H1 magnitude of A relative to B in dB, written to h1. A requested stop
+// leaves h1 averaged over the segments finished so far.
+template <std::floating_point T>
+void welch(std::span<const T> a, std::span<const T> b, std::vector<double> &h1,
+           size_t windowSize = 1024, const WindowFunction &windowFn = hann,
+           std::stop_token stop = {}) {
+  thread_local CrossSpectrum spectrum;
+  crossSpectrum<T>(a, b, spectrum, windowSize, windowFn, stop);
+  h1.resize(spectrum.segments > 0 ? spectrum.sab.size() : 0);
+  for (size_t i = 0; i < h1.size(); ++i) {
+    const auto sbb = spectrum.sbb[i];
+    h1[i] = 10 * std::log10(std::norm(spectrum.sab[i]) / (sbb * sbb));
+  }
+}
 
-  return ret;
+template <DoubleRange RA, DoubleRange RB, typename T = SampleType<RA>>
+std::vector<double> welch(RA &&dataA, RB &&dataB, size_t windowSize = 1024,
+                          WindowFunction windowFn = hann) {
+  std::vector<T> storageA, storageB;
+  std::vector<double> h1;
+  welch<T>(contiguousSamples<T>(dataA, storageA),
+           contiguousSamples<T>(dataB, storageB), h1, windowSize, windowFn);
+  return h1;
 }
 
 #endif
@@ -0,0 +1,93 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include "rings.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Pipeline stages timed by ProfileScope, from the driver callback to the
+// frame being drawn
+enum class Stage { Callback, ChannelHop, Ingest, Decimation, Welch, Render };
+inline constexpr size_t STAGES = 6;
+// Channels whose backlog the profiler counts
+enum class Queue { Stream, Spectrum };
+inline constexpr size_t QUEUES = 2;
+// Events each thread keeps; the oldest are overwritten
+inline constexpr size_t PROFILE_RING = 1 << 12;
+
+const char *to_string(Stage stage);
+const char *to_string(Queue queue);
+
+// Events of one stage that ended within the window asked for
+struct StageStats {
+  size_t count = 0;
+  double p50Ms = 0.;
+  double p99Ms = 0.;
+  double maxMs = 0.;
+  double perSecond = 0.;
+  // Samples (or other units) the events reported handling, per second
+  double itemsPerSecond = 0.;
+};
+
+// Timings of the pipeline stages, which every thread records into a ring
+// of its own (see ThreadRings)
+class Profiler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  Profiler();
+  static Profiler &getInstance();
+
+  void record(Stage stage, Clock::time_point start, Clock::time_point end,
+              size_t items = 0);
+  // Counts items put on (n > 0) or taken off (n < 0) a queue
+  void addQueued(Queue queue, ptrdiff_t n) {
+    depth[static_cast<size_t>(queue)].fetch_add(n, std::memory_order_relaxed);
+  }
+  size_t queued(Queue queue) const;
+
+  // Percentiles and rates of the events that ended in the last `window`
+  std::array<StageStats, STAGES>
+  stats(Clock::duration window = std::chrono::seconds{1}) const;
+
+  Profiler(const Profiler &other) = delete;
+
+private:
+  struct Event {
+    // Nanoseconds since the profiler was created
+    std::atomic<int64_t> end;
+    std::atomic<int64_t> duration;
+    // Stage in the top byte, items below
+    std::atomic<uint64_t> stageItems;
+  };
+  using Ring = EventRing<Event, PROFILE_RING>;
+
+  Clock::time_point epoch;
+  ThreadRings<Ring> rings;
+  std::array<std::atomic<ptrdiff_t>, QUEUES> depth{};
+};
+
+// Times its own lifetime as one event of `stage`
+class ProfileScope {
+  Stage stage;
+  size_t items;
+  Profiler::Clock::time_point start = Profiler::Clock::now();
+
+public:
+  explicit ProfileScope(Stage stage, size_t items = 0)
+      : stage(stage), items(items) {}
+  ~ProfileScope() {
+    Profiler::getInstance().record(stage, start, Profiler::Clock::now(),
+                                   items);
+  }
+
+  void setItems(size_t n) { items = n; }
+
+  ProfileScope(const ProfileScope &other) = delete;
+};
+
+#endif
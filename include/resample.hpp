@@ -0,0 +1,184 @@
+#ifndef RESAMPLE_HPP
+#define RESAMPLE_HPP
+
+#include "processing.hpp"
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <numeric>
+#include <span>
+#include <vector>
+
+// Windowed-sinc lowpass with unity DC gain. `cutoff` is a fraction of the
+// sample rate (0.5 is Nyquist).
+std::vector<double> lowpassKernel(size_t taps, double cutoff,
+                                  const WindowFunction &windowFn = blackman);
+
+// Stage factors for a multistage decimator, largest first, each at most 8.
+std::vector<size_t> decimationStages(size_t factor);
+
+template <std::floating_point T>
+T dot(const T *__restrict a, const T *__restrict b, size_t n) {
+  T acc = 0;
+#pragma omp simd reduction(+ : acc)
+  for (size_t i = 0; i < n; ++i) {
+    acc += a[i] * b[i];
+  }
+  return acc;
+}
+
+// FIR decimator that only evaluates the outputs it keeps. Filter state
+// carries across calls, so a stream can be fed in blocks of any size.
+template <std::floating_point T> class PolyphaseDecimator {
+  size_t factor;
+  std::vector<T> reversed;
+  std::vector<T> buffer;
+  size_t skip = 0;
+
+public:
+  PolyphaseDecimator(size_t factor, std::span<const double> kernel)
+      : factor(std::max<size_t>(factor, 1)),
+        reversed(kernel.rbegin(), kernel.rend()),
+        buffer(kernel.size() - 1, T(0)) {}
+
+  PolyphaseDecimator(size_t factor, size_t tapsPerPhase = 16)
+      : PolyphaseDecimator(factor,
+                           lowpassKernel(tapsPerPhase * factor + 1,
+                                         0.45 / std::max<size_t>(factor, 1))) {}
+
+  size_t getFactor() const { return factor; }
+  size_t taps() const { return reversed.size(); }
+  // Group delay in input samples
+  double delay() const { return (taps() - 1) / 2.; }
+
+  void reset() {
+    buffer.assign(taps() - 1, T(0));
+    skip = 0;
+  }
+
+  void process(std::span<const T> in, std::vector<T> &out) {
+    const size_t history = taps() - 1;
+    buffer.insert(buffer.end(), in.begin(), in.end());
+
+    size_t pos = history + skip;
+    for (; pos < buffer.size(); pos += factor) {
+      out.push_back(dot(reversed.data(), buffer.data() + pos - history,
+                        reversed.size()));
+    }
+    skip = pos - buffer.size();
+    buffer.erase(buffer.begin(), buffer.end() - history);
+  }
+};
+
+// Rational L/M resampler. The prototype filter runs at L times the input
+// rate and is split into L phases, so each output costs taps / L multiplies.
+template <std::floating_point T> class PolyphaseResampler {
+  size_t up;
+  size_t down;
+  size_t tapsPerPhase;
+  std::vector<std::vector<T>> phases;
+  std::vector<T> buffer;
+  size_t phase = 0;
+  size_t skip = 0;
+
+public:
+  PolyphaseResampler(size_t up, size_t down, size_t tapsPerPhase = 16)
+      : tapsPerPhase(tapsPerPhase) {
+    const auto g = std::gcd(up, down);
+    this->up = up / g;
+    this->down = down / g;
+    auto kernel =
+        lowpassKernel(tapsPerPhase * this->up,
+                      0.45 / std::max(this->up, this->down), blackman);
+    phases.assign(this->up, std::vector<T>(tapsPerPhase, T(0)));
+    for (size_t k = 0; k < kernel.size(); ++k) {
+      // Reversed per phase so each output is a forward dot product
+      phases[k % this->up][tapsPerPhase - 1 - k / this->up] =
+          kernel[k] * this->up;
+    }
+    buffer.assign(tapsPerPhase - 1, T(0));
+  }
+
+  double ratio() const { return (double)up / down; }
+
+  void reset() {
+    buffer.assign(tapsPerPhase - 1, T(0));
+    phase = 0;
+    skip = 0;
+  }
+
+  void process(std::span<const T> in, std::vector<T> &out) {
+    const size_t history = tapsPerPhase - 1;
+    buffer.insert(buffer.end(), in.begin(), in.end());
+
+    size_t pos = history + skip;
+    while (pos < buffer.size()) {
+      out.push_back(dot(phases[phase].data(), buffer.data() + pos - history,
+                        tapsPerPhase));
+      phase += down;
+      pos += phase / up;
+      phase %= up;
+    }
+    skip = pos - buffer.size();
+    buffer.erase(buffer.begin(), buffer.end() - history);
+  }
+};
+
+// Multistage decimator. Early stages use short filters since their
+// transition bands can fold into the part of the spectrum later stages
+// remove; only the last stage needs a sharp cutoff. Outputs are aligned so
+// that sample j corresponds to input sample j * factor.
+template <std::floating_point T> class DecimationChain {
+  size_t factor = 1;
+  std::vector<PolyphaseDecimator<T>> stages;
+  std::vector<T> scratch[2];
+  size_t alignment = 0;
+
+public:
+  explicit DecimationChain(size_t factor = 1) : factor(factor) {
+    auto factors = decimationStages(factor);
+    for (size_t i = 0; i < factors.size(); ++i) {
+      stages.emplace_back(factors[i], i + 1 == factors.size() ? 24 : 8);
+    }
+    reset();
+  }
+
+  size_t getFactor() const { return factor; }
+
+  // Group delay in input samples
+  double delay() const {
+    double res = 0, rate = 1;
+    for (const auto &stage : stages) {
+      res += stage.delay() * rate;
+      rate *= stage.getFactor();
+    }
+    return res;
+  }
+
+  void reset() {
+    for (auto &stage : stages) {
+      stage.reset();
+    }
+    alignment = std::round(delay() / factor);
+  }
+
+  void process(std::span<const T> in, std::vector<T> &out) {
+    if (stages.empty()) {
+      out.insert(out.end(), in.begin(), in.end());
+      return;
+    }
+    std::span<const T> current = in;
+    for (size_t i = 0; i < stages.size(); ++i) {
+      auto &next = scratch[i % 2];
+      next.clear();
+      stages[i].process(current, next);
+      current = next;
+    }
+    const size_t dropped = std::min(alignment, current.size());
+    alignment -= dropped;
+    out.insert(out.end(), current.begin() + dropped, current.end());
+  }
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef RINGS_HPP
+#define RINGS_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Events are timed in nanoseconds from the epoch of their recorder
+inline int64_t nanoseconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+// Ring of the last N events of one thread. `Event` is made of atomics the
+// writer stores with relaxed order before publishing head, so recording
+// never locks or waits for a reader; readers copy the events and drop the
+// ones overwritten while they read.
+template <typename Event, size_t N> struct EventRing {
+  std::array<Event, N> events;
+  // Events ever recorded; the next goes to head % N
+  std::atomic<uint64_t> head = 0;
+
+  // For the owning thread only: fills the next slot with `write`
+  template <typename Write> void push(Write &&write) {
+    // Only this thread writes the ring, so head cannot move under it
+    const uint64_t next = head.load(std::memory_order_relaxed);
+    write(events[next % N]);
+    head.store(next + 1, std::memory_order_release);
+  }
+
+  // Appends `read` of every event still held, oldest first, to `out`
+  template <typename T, typename Read>
+  void copyTo(std::vector<T> &out, Read &&read) const {
+    const uint64_t end = head.load(std::memory_order_acquire);
+    const uint64_t begin = end > N ? end - N : 0;
+    const size_t copied = out.size();
+    for (uint64_t i = begin; i < end; ++i) {
+      out.push_back(read(events[i % N]));
+    }
+    // The writer may have overwritten the oldest slots meanwhile, including
+    // the one it is writing now without having advanced head yet
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t now = head.load(std::memory_order_relaxed);
+    const uint64_t valid = now + 1 > N ? now + 1 - N : 0;
+    if (valid > begin) {
+      const auto from = out.begin() + copied;
+      out.erase(from, from + (std::min(valid, end) - begin));
+    }
+  }
+};
+
+// One ring per thread that records into an owner, created on the thread's
+// first event; that is the only time a lock is taken while recording.
+// Rings outlive their threads so their events can still be read.
+template <typename Ring> class ThreadRings {
+  static inline std::atomic<uint64_t> lastId = 0;
+  // Ids rather than addresses, as a new owner may reuse an old address
+  const uint64_t id = ++lastId;
+  mutable std::mutex lock;
+  std::vector<std::shared_ptr<Ring>> rings;
+
+public:
+  // Ring of the calling thread
+  Ring &local() {
+    thread_local uint64_t owner = 0;
+    thread_local Ring *ring = nullptr;
+    if (owner != id) {
+      auto created = std::make_shared<Ring>();
+      std::unique_lock temp{lock};
+      rings.push_back(created);
+      owner = id;
+      ring = created.get();
+    }
+    return *ring;
+  }
+
+  // Every ring so far, in the order their threads first recorded
+  std::vector<std::shared_ptr<Ring>> all() const {
+    std::unique_lock temp{lock};
+    return rings;
+  }
+};
+
+#endif
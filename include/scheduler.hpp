@@ -0,0 +1,132 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Lower values run first: a queued acquisition task always goes ahead of
+// analysis the UI is waiting on, which goes ahead of background work.
+enum class Priority { Acquisition, Interactive, Background };
+inline constexpr size_t PRIORITIES = 3;
+
+struct TaskStats {
+  std::string name;
+  uint64_t count = 0;
+  double totalMs = 0.;
+  double maxMs = 0.;
+
+  double meanMs() const { return count > 0 ? totalMs / count : 0.; }
+};
+
+// Repeating task created by Scheduler::every. Copies share the same task.
+class PeriodicTask {
+public:
+  struct State;
+
+  PeriodicTask() = default;
+  explicit PeriodicTask(std::shared_ptr<State> state);
+
+  // No run starts after this returns; a run in progress is waited for
+  void stop();
+  bool active() const;
+
+private:
+  std::shared_ptr<State> state;
+};
+
+// Work-stealing pool shared by acquisition, analysis and background jobs.
+// Every worker owns one deque per priority; it pops its own newest task and
+// otherwise steals the oldest task of another worker, always draining a
+// higher priority everywhere before looking at a lower one.
+class Scheduler {
+public:
+  using Task = std::move_only_function<void()>;
+
+  explicit Scheduler(size_t threads = std::thread::hardware_concurrency());
+  ~Scheduler();
+  static Scheduler &getInstance();
+
+  void submit(Priority priority, const char *name, Task task);
+  void submitAfter(Priority priority, std::chrono::nanoseconds delay,
+                   const char *name, Task task);
+  // Runs fn every period (measured from the end of one run to the start of
+  // the next) until the returned handle is stopped
+  PeriodicTask every(Priority priority, std::chrono::nanoseconds period,
+                     const char *name, std::function<void()> fn);
+
+  // Calls fn(begin, end) over [0, n) in chunks of `grain`, on up to
+  // getParallelism() threads including the caller, and returns once every
+  // chunk has run. The caller only ever runs chunks of this loop, so fn
+  // may use thread_local scratch and may be reached from inside a task.
+  void parallelFor(Priority priority, const char *name, size_t n,
+                   size_t grain,
+                   const std::function<void(size_t, size_t)> &fn);
+
+  size_t threads() const { return workers.size(); }
+  void setParallelism(size_t threads);
+  size_t getParallelism() const { return parallelism; }
+  // Tasks queued and not yet started, timed ones excluded
+  size_t pendingTasks() const { return pending; }
+
+  // Run count and wall time per task name since the last reset
+  std::vector<TaskStats> stats() const;
+  void resetStats();
+
+  Scheduler(const Scheduler &other) = delete;
+  Scheduler(Scheduler &&other) = delete;
+
+private:
+  struct Entry {
+    Task task;
+    const char *name;
+  };
+
+  struct Timed {
+    std::chrono::steady_clock::time_point due;
+    Priority priority;
+    const char *name;
+    std::shared_ptr<Task> task;
+
+    bool operator>(const Timed &other) const { return due > other.due; }
+  };
+
+  struct Worker {
+    std::mutex lock;
+    std::array<std::deque<Entry>, PRIORITIES> queues;
+    mutable std::mutex statsLock;
+    std::unordered_map<const char *, TaskStats> stats;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  // Chunks run by threads outside the pool are accounted here
+  Worker external;
+  std::vector<std::thread> pool;
+  std::atomic<size_t> parallelism;
+  std::atomic<size_t> pending = 0;
+  std::atomic<size_t> nextWorker = 0;
+
+  std::mutex sleepLock;
+  std::condition_variable wake;
+  std::priority_queue<Timed, std::vector<Timed>, std::greater<>> timed;
+  bool stopping = false;
+
+  void workerLoop(size_t index);
+  bool findTask(size_t index, Entry &entry);
+  bool promoteTimed();
+  void run(Worker &worker, Entry &entry);
+  static void record(Worker &worker, const char *name, double ms);
+};
+
+#endif
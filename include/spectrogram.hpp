@@ -0,0 +1,64 @@
+#ifndef SPECTROGRAM_HPP
+#define SPECTROGRAM_HPP
+
+#include "processing.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+inline constexpr size_t DEFAULT_SPECTROGRAM_HISTORY = 256;
+inline constexpr size_t DEFAULT_SPECTROGRAM_WINDOW = 1 << 10;
+
+// Sliding STFT over a live stream. Every `hop` samples one new column of
+// magnitudes (dB) is written into a fixed ring of `history` columns, so the
+// time-frequency history costs bins * history floats no matter how long the
+// stream runs. Columns are stored contiguously from the highest bin down to
+// DC, which is the column-major layout ImPlot's heatmap draws top-down.
+class Spectrogram {
+  size_t windowSize;
+  size_t hop;
+  size_t capacity;
+  double sampleRate;
+
+  std::vector<float> window;
+  float gain;
+  FftwBuffer<float> buffer;
+  std::vector<float> pending;
+  std::vector<float> history;
+  size_t head = 0;
+  size_t filled = 0;
+  uint64_t produced = 0;
+
+  void computeColumn(const float *samples);
+
+public:
+  struct Block {
+    const float *data;
+    size_t columns;
+    uint64_t firstColumn;
+  };
+
+  Spectrogram(size_t windowSize, size_t hop, double sampleRate,
+              size_t history = DEFAULT_SPECTROGRAM_HISTORY,
+              const WindowFunction &windowFn = hann);
+
+  // Returns the number of columns produced. When a block holds more columns
+  // than the history can keep, only the ones that survive are transformed.
+  size_t push(std::span<const float> samples);
+  void clear();
+
+  size_t bins() const { return windowSize / 2 + 1; }
+  size_t columns() const { return filled; }
+  size_t getWindowSize() const { return windowSize; }
+  double hopSeconds() const { return hop / sampleRate; }
+  double nyquist() const { return sampleRate / 2; }
+  // Centre of column k in seconds since the first pushed sample
+  double columnTime(uint64_t column) const;
+
+  // Stored columns in chronological order, at most two contiguous runs
+  std::array<Block, 2> blocks() const;
+};
+
+#endif
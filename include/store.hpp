@@ -0,0 +1,201 @@
+#ifndef STORE_HPP
+#define STORE_HPP
+
+#include "codec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Samples per chunk of a SampleStore
+inline constexpr size_t STORE_CHUNK = 1 << 16;
+// Unpacked chunks a SampleStore keeps for repeated reads
+inline constexpr size_t STORE_UNPACKED_CACHE = 4;
+
+// Read-only copy-free view of a range of a SampleStore. It shares the
+// chunks it covers, so it stays valid after the store drops or reuses them
+// and can be handed to another thread.
+class SampleSnapshot {
+  // Packed chunks are unpacked by whoever reads the snapshot
+  struct Piece {
+    std::shared_ptr<const float[]> samples;
+    std::shared_ptr<const uint32_t[]> packed;
+  };
+  std::vector<Piece> chunks;
+  // Position of the first sample within chunks.front()
+  size_t offset = 0;
+  size_t count = 0;
+  size_t first = 0;
+
+  friend class SampleStore;
+
+public:
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  // Index of the first sample in the store it was taken from
+  size_t firstIndex() const { return first; }
+
+  // Slow path for the odd sample: in a packed chunk every read decodes a
+  // whole frame, so ranges go through copyTo
+  float operator[](size_t i) const {
+    i += offset;
+    const auto &piece = chunks[i / STORE_CHUNK];
+    if (piece.samples) {
+      return piece.samples[i % STORE_CHUNK];
+    }
+    float x;
+    unpackSamples(piece.packed.get(), i % STORE_CHUNK, {&x, 1});
+    return x;
+  }
+
+  // Gathers the samples into one contiguous buffer, reusing its storage
+  void copyTo(std::vector<float> &out) const;
+};
+
+struct StoreStats {
+  size_t memoryBytes = 0;   // chunks held on the heap, spare included
+  size_t diskBytes = 0;     // spill file space in use
+  size_t spilledChunks = 0; // chunks moved to disk since the last clear
+  size_t coldReads = 0;     // reads of spilled chunks since the last clear
+  bool spillFailed = false; // the spill file could not be written
+  size_t packedChunks = 0;  // chunks held packed, in RAM or on disk
+  size_t packedBytes = 0;   // their packed size
+  size_t unpackedSamples = 0; // samples unpacked for reads since the last clear
+  double unpackSeconds = 0.;  // time spent unpacking them
+};
+
+class SpillFile;
+
+// Append-only channel history kept in fixed-size chunks whose addresses
+// never change. Samples are addressed by their index since the last clear,
+// which keeps counting as the oldest chunks are dropped to honour the
+// retention limit, so any index maps to its chunk in O(1).
+//
+// Once a quantum is set, every chunk that fills up is packed losslessly
+// (see codec.hpp) when all its samples are multiples of it, and unpacked
+// again on demand into a small cache of recently read chunks.
+//
+// Beyond the memory limit the oldest full chunks are written to an
+// unlinked file and replaced by read-only mappings of it, so they stay
+// addressable while the kernel pages them in on access and can drop them
+// again under pressure. Without mmap (Windows) everything stays in RAM.
+class SampleStore {
+  struct Chunk {
+    // Raw samples, null while the chunk is packed
+    std::shared_ptr<float[]> samples;
+    std::shared_ptr<const uint32_t[]> packed;
+    size_t packedWords = 0;
+    // Mapped from the spill file rather than allocated
+    bool spilled = false;
+  };
+  struct Unpacked {
+    // Index of the first sample of the chunk
+    size_t first = 0;
+    std::shared_ptr<const float[]> samples;
+  };
+  std::deque<Chunk> chunks;
+  // Dropped heap chunk kept for reuse when no snapshot still holds it
+  std::shared_ptr<float[]> spare;
+  // Index of the first sample of chunks.front()
+  size_t base = 0;
+  size_t first = 0;
+  size_t last = 0;
+  size_t retention;
+  float quantum = 0.f;
+  std::vector<uint32_t> packBuffer;
+  using UnpackedCache = std::array<Unpacked, STORE_UNPACKED_CACHE>;
+  // Most recently used first
+  mutable UnpackedCache unpackedCache;
+
+  // Spilled chunks always form a prefix of chunks
+  size_t spilledCount = 0;
+  // Heap bytes of the chunks, spare and cache excluded
+  size_t heapBytes = 0;
+  size_t memoryLimit;
+  std::filesystem::path spillDirectory;
+  std::shared_ptr<SpillFile> spill;
+  StoreStats counters;
+  mutable size_t coldReads = 0;
+  mutable size_t unpackedSamples = 0;
+  mutable double unpackSeconds = 0.;
+
+  void seal(Chunk &chunk);
+  void trim();
+  void spillCold();
+  UnpackedCache::iterator findUnpacked(size_t start) const;
+  // Raw samples of chunks[chunk], unpacking them if needed
+  std::shared_ptr<const float[]> chunkSamples(size_t chunk) const;
+
+public:
+  explicit SampleStore(
+      size_t retention = std::numeric_limits<size_t>::max(),
+      size_t memoryLimit = std::numeric_limits<size_t>::max());
+
+  void append(std::span<const float> samples);
+  // Drops everything; the next sample appended gets index `start`
+  void clear(size_t start = 0);
+
+  // At least `samples` of the newest samples are kept; whole chunks older
+  // than that are released, so up to STORE_CHUNK - 1 more may remain.
+  void setRetention(size_t samples);
+  size_t getRetention() const { return retention; }
+  // Step that stored samples are multiples of, or 0 to store chunks raw.
+  // Applies to chunks filled from now on; any that does not fit stays raw.
+  void setQuantum(float step) { quantum = step; }
+  // Heap bytes of chunks above which the oldest are spilled to disk
+  void setMemoryLimit(size_t bytes);
+  size_t getMemoryLimit() const { return memoryLimit; }
+  // Where the spill file is created; the system temporary directory
+  // unless set. Takes effect for the next file, after a clear.
+  void setSpillDirectory(std::filesystem::path directory);
+
+  size_t firstIndex() const { return first; }
+  size_t endIndex() const { return last; }
+  size_t size() const { return last - first; }
+  bool empty() const { return last == first; }
+  StoreStats stats() const;
+
+  // `index` must be in [firstIndex(), endIndex()). Slow path for the odd
+  // sample: a packed chunk costs a cache lookup and a shared_ptr copy per
+  // read, so ranges go through visit()
+  float operator[](size_t index) const {
+    index -= base;
+    const auto &chunk = chunks[index / STORE_CHUNK];
+    if (chunk.samples) {
+      return chunk.samples[index % STORE_CHUNK];
+    }
+    return chunkSamples(index / STORE_CHUNK)[index % STORE_CHUNK];
+  }
+
+  // Calls fn with the contiguous pieces of [from, to), clamped to the
+  // retained samples, in order
+  template <typename F> void visit(size_t from, size_t to, F &&fn) const {
+    from = std::max(from, first);
+    to = std::min(to, last);
+    while (from < to) {
+      const size_t chunk = (from - base) / STORE_CHUNK;
+      const size_t offset = (from - base) % STORE_CHUNK;
+      const size_t n = std::min(STORE_CHUNK - offset, to - from);
+      if (chunks[chunk].spilled) {
+        ++coldReads;
+      }
+      // Held for the call, so fn may read elsewhere in the store
+      const auto samples = chunkSamples(chunk);
+      fn(std::span<const float>(samples.get() + offset, n));
+      from += n;
+    }
+  }
+
+  // Shares [from, to), clamped to the retained samples, without copying.
+  // Packed chunks are shared packed unless already unpacked, and spilled
+  // chunks it covers are prefetched.
+  SampleSnapshot snapshot(size_t from, size_t to) const;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Streaming interval in the driver's time unit (TIME_UNITS in pico.hpp,
+// microseconds), and the rate it gives
+inline constexpr size_t SAMPLE_INTERVAL = 20;
+inline constexpr double DELTA_TIME = 1e-6 * SAMPLE_INTERVAL;
+inline constexpr double SAMPLE_RATE = 1. / DELTA_TIME;
+// Default length of the stored history
+inline constexpr size_t WAVEFORM_SECONDS = 30;
+
+// ADC codes have 8 bits of resolution, so single precision holds every
+// sample exactly at half the memory traffic of double.
+using Sample = float;
+
+// One block of both channels as handed over by the streaming callback
+struct StreamResult {
+  std::vector<Sample> dataA;
+  std::vector<Sample> dataB;
+  // Index of the block's first sample since the stream was started
+  uint64_t first = 0;
+  // When the driver callback handed the block over
+  std::chrono::steady_clock::time_point sent =
+      std::chrono::steady_clock::now();
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include <complex>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+enum class SweepDirection { Up, Down, UpDown, DownUp };
+
+// Stepped sine sweep as programmed into the signal generator: the frequency
+// moves by `increment` every `dwell` seconds between `start` and `end`.
+struct SweepSchedule {
+  double start = 0.;
+  double end = 0.;
+  double increment = 0.;
+  double dwell = 0.;
+  SweepDirection direction = SweepDirection::Up;
+  // Stream index (as in StreamResult::first) of the first sample taken
+  // with the generator running; the schedule starts there
+  uint64_t firstSample = 0;
+
+  size_t steps() const;
+  // Step held during the given dwell since the sweep started
+  size_t stepAt(uint64_t dwell) const;
+  double frequency(size_t step) const { return start + step * increment; }
+};
+
+// Windowed single-bin DFT at an arbitrary frequency (cycles per sample)
+// using the Goertzel recurrence. The result carries a phase reference common
+// to every call with the same length, so ratios between channels are exact.
+std::complex<double> goertzel(std::span<const float> samples,
+                              double frequency,
+                              std::span<const float> window);
+
+struct BodePoint {
+  double frequency;
+  double magnitude; // dB, NaN until the step has been measured
+  double phase;     // degrees
+};
+
+// Follows the generator schedule over the incoming stream and demodulates
+// both channels at the current step frequency once per dwell, so each
+// dwell costs O(samples) and the Bode plot fills in while the sweep runs.
+// The first `guard` fraction of every dwell is skipped to let the response
+// settle and to absorb timing slop between the generator and the stream.
+// Samples streamed before the schedule's first sample are ignored.
+class SweepTracker {
+  SweepSchedule schedule;
+  double sampleRate;
+  double guard;
+
+  std::vector<BodePoint> bode;
+  std::vector<float> bufferA;
+  std::vector<float> bufferB;
+  std::vector<float> window;
+  // Samples since the schedule's first one
+  uint64_t sample = 0;
+  uint64_t dwell = 0;
+
+  double dwellStart(uint64_t index) const;
+  void finishDwell();
+
+public:
+  SweepTracker(const SweepSchedule &schedule, double sampleRate,
+               double guard = 0.25);
+
+  // `first` is the stream index of the first sample of a and b
+  void push(std::span<const float> a, std::span<const float> b,
+            uint64_t first);
+  void clear();
+  const std::vector<BodePoint> &points() const { return bode; }
+  double currentFrequency() const;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "rings.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <string>
+
+// Events each thread keeps while recording; the oldest are overwritten
+inline constexpr size_t TRACE_RING = 1 << 16;
+// Stall dumps are at least this far apart
+inline constexpr std::chrono::seconds TRACE_DUMP_INTERVAL{10};
+
+// Chrome trace-event phases the recorder emits
+enum class TracePhase : char {
+  Complete = 'X',
+  Instant = 'i',
+  FlowStart = 's',
+  FlowEnd = 'f',
+};
+
+// Rolling recorder of pipeline events, written out as Chrome trace-event
+// JSON that chrome://tracing and Perfetto open. Events carry the recording
+// thread and a sample range (`first`, `count`), and flows tie a block's
+// send to its receipt by the block's first sample index.
+//
+// While not recording, every call returns after one relaxed load. While
+// recording, each thread writes a ring of its own the way Profiler does,
+// so the window kept is the last TRACE_RING events of every thread, and
+// the trace is written on demand or when a frame stalls.
+class TraceRecorder {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  TraceRecorder();
+  static TraceRecorder &getInstance();
+
+  void start() { active.store(true, std::memory_order_relaxed); }
+  void stop() { active.store(false, std::memory_order_relaxed); }
+  bool recording() const { return active.load(std::memory_order_relaxed); }
+
+  void instant(const char *name, uint64_t first = 0, uint64_t count = 0) {
+    if (recording()) {
+      add(TracePhase::Instant, name, Clock::now(), {}, first, count);
+    }
+  }
+  void complete(const char *name, Clock::time_point start,
+                Clock::time_point end, uint64_t first = 0,
+                uint64_t count = 0) {
+    if (recording()) {
+      add(TracePhase::Complete, name, start, end - start, first, count);
+    }
+  }
+  // One end of an arrow from the event that sends `id` to the one that
+  // receives it; both ends must share the name
+  void flow(const char *name, bool begin, uint64_t id) {
+    if (recording()) {
+      add(begin ? TracePhase::FlowStart : TracePhase::FlowEnd, name,
+          Clock::now(), {}, id, 0);
+    }
+  }
+  // Records a frame and dumps the trace if it stalled
+  void frame(Clock::time_point start, Clock::time_point end);
+  // Names the calling thread in traces written from now on
+  void nameThread(std::string name);
+
+  // Frames longer than `threshold` write the trace to `directory`;
+  // a zero threshold turns this off
+  void setStallDump(std::chrono::milliseconds threshold,
+                    std::filesystem::path directory);
+  std::chrono::milliseconds getStallThreshold() const;
+  // Path of the last trace written for a stall, if any
+  std::filesystem::path lastStallDump() const;
+
+  // Writes the events held, oldest first. Returns false if the file could
+  // not be written.
+  bool write(const std::filesystem::path &path) const;
+  // Copies the events held now and writes them on a background task, so a
+  // caller on the UI thread only pays for the copy. The future tells
+  // whether the file was written.
+  std::future<bool> writeLater(std::filesystem::path path) const;
+
+  TraceRecorder(const TraceRecorder &other) = delete;
+
+  struct Copy;
+
+private:
+  struct Event {
+    // Nanoseconds since the recorder was created
+    std::atomic<int64_t> time;
+    std::atomic<int64_t> duration;
+    std::atomic<const char *> name;
+    std::atomic<uint64_t> first;
+    std::atomic<uint64_t> count;
+    std::atomic<char> phase;
+  };
+  struct Ring : EventRing<Event, TRACE_RING> {
+    // Set by nameThread under the lock
+    std::string name;
+  };
+
+  Clock::time_point epoch;
+  std::atomic<bool> active = false;
+  ThreadRings<Ring> rings;
+  mutable std::mutex lock;
+  std::chrono::milliseconds stallThreshold{0};
+  std::filesystem::path stallDirectory;
+  std::filesystem::path stallDump;
+  Clock::time_point lastDump;
+
+  // Unsorted, which is left to the thread writing the copy
+  Copy copy() const;
+  void add(TracePhase phase, const char *name, Clock::time_point time,
+           Clock::duration duration, uint64_t first, uint64_t count);
+};
+
+#endif
@@ -1,19 +1,42 @@
 #ifndef UI_HPP
 #define UI_HPP
 
+#include "average.hpp"
+#include "correlation.hpp"
+#include "envelope.hpp"
+#include "filters.hpp"
+#include "ingest.hpp"
+#include "measure.hpp"
 #include "mpsc.hpp"
+#include "persistence.hpp"
 #include "pico.hpp"
 #include "processing.hpp"
+#include "resample.hpp"
+#include "spectrogram.hpp"
+#include "store.hpp"
+#include "sweep.hpp"
+#include "zoom.hpp"
 
 #include <implot.h>
 #include <libps2000/ps2000.h>
+#include <limits>
 #include <optional>
+#include <span>
 #include <vector>
 
 enum class TimeBase { US, MS, S };
 enum class SigGen { Noise, FreqSweep };
 
 inline constexpr TimeBase DEFAULT_TIMEBASE = TimeBase::S;
+inline constexpr double DEFAULT_HISTORY_MEGABYTES = 1024.;
+inline constexpr double DEFAULT_RAM_MEGABYTES = 256.;
+
+// Samples each channel keeps at `decimation` for the given history length
+// and memory budget, the budget being shared by both raw channels
+size_t historySamples(double seconds, double megabytes, size_t decimation = 1);
+// Heap bytes each channel's store at `decimation` may hold before spilling
+// to disk, shared the same way
+size_t historyMemoryLimit(double megabytes, size_t decimation = 1);
 
 struct FreqSweepSettings {
   double startFreq = 1.;
@@ -21,6 +44,12 @@ struct FreqSweepSettings {
   double sweepDuration = 5.;
 };
 
+// CPU time the last drawScopeTab spent drawing each view
+struct ViewTimes {
+  double scopeMs = 0.;
+  double spectrumMs = 0.;
+};
+
 struct ScopeSettings {
   enPS2000Range voltageRange = DEFAULT_VOLTAGE_RANGE;
   TimeBase timebase = TimeBase::S;
@@ -37,18 +66,67 @@ struct ScopeSettings {
   bool follow = false;
   bool generate = false;
   bool showSpectrum = false;
+  bool showCoherence = false;
+  bool zoomSpectrum = false;
+  // Shade each pixel of the spectrum down to its lowest bin as well
+  bool showSpectrumMin = false;
+  bool showSpectrogram = false;
+  bool showBode = false;
+  bool showDelay = false;
+  // Draw trigger-aligned sweeps as a density map instead of the traces
+  bool showPersistence = false;
   bool resetScopeWindow = false;
+  // New data is picked up once the spectrum job in flight returns; a
+  // changed view or spectrum setting cancels that job first
   bool updateSpectrum = false;
+  bool restartSpectrum = false;
 
-  std::optional<mpsc::Recv<StreamResult>> recv;
-  std::vector<double> dataA;
-  std::vector<double> dataB;
+  // Bounded history of the stored (filtered) channels, the oldest chunks
+  // being released once both retention limits are exceeded and spilled to
+  // disk beyond the RAM budget
+  double historySeconds = WAVEFORM_SECONDS;
+  // Spectra cover at most the newest this many seconds of the view
+  double spectrumSeconds = std::numeric_limits<double>::infinity();
+  double historyMegabytes = DEFAULT_HISTORY_MEGABYTES;
+  double ramMegabytes = DEFAULT_RAM_MEGABYTES;
+  // Applied to incoming blocks before they are stored
+  std::vector<FilterSpec> filterSpecsA;
+  std::vector<FilterSpec> filterSpecsB;
+  // Accumulates the displayed spectrum across worker results
+  SpectrumAverager spectrumAverage;
+  SpectralMetrics spectralA;
+  SpectralMetrics spectralB;
+  // Delay of A against B over the visible range, from the spectrum worker
+  CorrelationWeighting correlationWeighting = CorrelationWeighting::None;
+  DelayEstimate delay;
+  // Reduced-rate copies of the channels are displayed while decimation > 1
+  size_t decimation = 1;
+  size_t spectrogramSize = DEFAULT_SPECTROGRAM_WINDOW;
+  ImPlotRange spectrogramScale = {-100, 20};
+  // Its voltage span and hysteresis follow the voltage range
+  PersistenceSettings persistence;
+  ViewTimes viewTimes;
+  // Last view sent to the ingest thread
+  ViewRequest view;
+  // Stores and processes the streamed blocks on a thread of its own; the
+  // frame reads what it publishes
+  Ingest ingest{SAMPLE_RATE, historySamples(historySeconds, historyMegabytes),
+                historyMemoryLimit(ramMegabytes)};
 
+  ScopeSettings();
+  void setDecimation(size_t factor);
+  void setHistory(double seconds, double megabytes);
+  void setRamBudget(double megabytes);
+  void setHysteresis(double volts);
+  // Sends the persistence settings, or turns persistence off
+  void setPersistence();
   void clearData();
   void fillRandomData(size_t samples);
 };
 
 void drawScope(ScopeSettings &settings, Scope &scope);
 void drawScopeTab(ScopeSettings &settings, Scope &scope);
+// Frame rate overlay, expandable into per-stage timings and queue depths
+void drawProfiler();
 
 #endif
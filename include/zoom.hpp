@@ -0,0 +1,34 @@
+#ifndef ZOOM_HPP
+#define ZOOM_HPP
+
+#include "processing.hpp"
+
+#include <span>
+#include <stop_token>
+
+// Widest band, as a fraction of the sample rate, for which zooming pays
+// off; wider views use the ordinary baseband spectrum.
+inline constexpr double MAX_ZOOM_BANDWIDTH = 0.25;
+
+// Decimation used to zoom on `bandwidth` Hz: the largest factor with only
+// prime factors up to 7 that keeps the band within half of the decimated
+// complex rate, where the anti-alias filters are flat.
+size_t zoomDecimation(double sampleRate, double bandwidth);
+
+// Cross spectrum of A against B restricted to [low, high] Hz. Both channels
+// are mixed down by the band centre with one shared oscillator, low-pass
+// decimated as complex baseband and transformed with complex FFTs of
+// `windowSize`, so bin width is sampleRate / (decimation * windowSize) and
+// shrinks as the band narrows. Only bins inside the band are returned;
+// res.startFrequency is the frequency of the first. The effective sample
+// rate (sampleRate / decimation) is returned for transferFunction. As with
+// crossSpectrum, segments run on the scheduler's threads, `stop` is checked
+// between them and `progress` follows every refinement pass but the last.
+double zoomCrossSpectrum(std::span<const float> a, std::span<const float> b,
+                         double sampleRate, double low, double high,
+                         CrossSpectrum &res, size_t windowSize = 1024,
+                         const WindowFunction &windowFn = hann,
+                         std::stop_token stop = {},
+                         const SpectrumProgress &progress = {});
+
+#endif
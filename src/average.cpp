@@ -0,0 +1,95 @@
+#include "average.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+SpectrumAverager::SpectrumAverager(AveragingMode mode, size_t length,
+                                   double alpha)
+    : mode(mode), length(std::max<size_t>(length, 1)), alpha(alpha) {}
+
+void SpectrumAverager::reset() {
+  count = 0;
+  accumulator.clear();
+  trace.clear();
+}
+
+void SpectrumAverager::setMode(AveragingMode mode) {
+  if (mode != this->mode) {
+    this->mode = mode;
+    reset();
+  }
+}
+
+void SpectrumAverager::setLength(size_t length) {
+  this->length = std::max<size_t>(length, 1);
+}
+
+void SpectrumAverager::setAlpha(double alpha) {
+  this->alpha = std::clamp(alpha, 0., 1.);
+}
+
+void SpectrumAverager::update(std::span<const double> db) {
+  const size_t n = db.size();
+  if (n != trace.size()) {
+    reset();
+    trace.resize(n);
+    accumulator.resize(n);
+  }
+
+  const double *__restrict in = db.data();
+  double *__restrict acc = accumulator.data();
+  double *__restrict out = trace.data();
+  if (count == 0 || mode == AveragingMode::None) {
+    std::copy(in, in + n, out);
+    for (size_t i = 0; i < n; ++i) {
+      acc[i] = std::pow(10., in[i] / 10);
+    }
+    ++count;
+    return;
+  }
+  ++count;
+
+  switch (mode) {
+  case AveragingMode::PeakHold:
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = std::max(out[i], in[i]);
+    }
+    return;
+  case AveragingMode::MinHold:
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = std::min(out[i], in[i]);
+    }
+    return;
+  case AveragingMode::Linear:
+  case AveragingMode::Exponential: {
+    const double weight = mode == AveragingMode::Linear
+                              ? 1. / std::min(count, length)
+                              : alpha;
+    for (size_t i = 0; i < n; ++i) {
+      acc[i] += weight * (std::pow(10., in[i] / 10) - acc[i]);
+      out[i] = 10 * std::log10(acc[i]);
+    }
+    return;
+  }
+  case AveragingMode::None:
+    return;
+  }
+}
+
+std::string to_string(AveragingMode mode) {
+  switch (mode) {
+  case AveragingMode::None:
+    return "None";
+  case AveragingMode::Linear:
+    return "Linear";
+  case AveragingMode::Exponential:
+    return "Exponential";
+  case AveragingMode::PeakHold:
+    return "Peak Hold";
+  case AveragingMode::MinHold:
+    return "Min Hold";
+  }
+  return "";
+}
@@ -0,0 +1,311 @@
+#include "codec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace {
+constexpr size_t LANES = 4;
+constexpr size_t PER_LANE = CODEC_FRAME / LANES;
+static_assert(PER_LANE == 32, "a lane of a frame must fill `bits` words");
+
+// Buffer header: sample count and quantum, then one offset per frame
+constexpr size_t HEADER = 2;
+// Frame header: bit width and mode, the reference code and the common
+// factor of all code differences, which scaled 8-bit ADC codes always have
+constexpr size_t FRAME_HEADER = 3;
+constexpr uint32_t DELTA = 1 << 8;
+// Codes round by adding and subtracting ROUND, which is exact below
+// MAX_CODE; ADC codes stay far below it
+constexpr float MAX_CODE = 1 << 22;
+constexpr float ROUND = 3 << 22;
+
+uint32_t zigzag(int32_t v) {
+  return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+int32_t unzigzag(uint32_t v) {
+  return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+// Inverse of an odd number modulo 2^32; Newton's iteration doubles the
+// correct low bits from 3
+uint32_t oddInverse(uint32_t odd) {
+  uint32_t inverse = odd;
+  for (int i = 0; i < 4; ++i) {
+    inverse *= 2 - odd * inverse;
+  }
+  return inverse;
+}
+
+// Exact division of multiples of a factor, as a shift and a multiplication
+// by the inverse of its odd part, which vectorises where division does not
+struct ExactDivisor {
+  unsigned shift;
+  uint32_t inverse;
+
+  explicit ExactDivisor(uint32_t factor)
+      : shift(std::countr_zero(factor)), inverse(oddInverse(factor >> shift)) {
+  }
+
+  int32_t operator()(int32_t x) const {
+    return static_cast<int32_t>(static_cast<uint32_t>(x >> shift) * inverse);
+  }
+};
+
+// Largest factor of every offset, found from the shared trailing zeros and
+// the odd part of the first two non-zero offsets; a candidate that does not
+// divide all of them falls back to the power of two
+uint32_t commonFactor(const uint32_t *offsets) {
+  uint32_t any = 0;
+#pragma omp simd reduction(| : any)
+  for (size_t i = 0; i < CODEC_FRAME; ++i) {
+    any |= offsets[i];
+  }
+  if (any == 0) {
+    return 1;
+  }
+  const unsigned shift = std::countr_zero(any);
+  uint32_t odd = 0;
+  for (size_t i = 0, seen = 0; i < CODEC_FRAME && seen < 2; ++i) {
+    if (offsets[i] != 0) {
+      odd = std::gcd(odd, offsets[i] >> shift);
+      ++seen;
+    }
+  }
+  // Twos beyond the shared trailing zeros are not common to all
+  odd >>= std::countr_zero(odd);
+  if (odd > 1) {
+    // x is a multiple of odd exactly when x * odd^-1 mod 2^32 is small
+    const uint32_t inverse = oddInverse(odd);
+    const uint32_t limit = std::numeric_limits<uint32_t>::max() / odd;
+    uint32_t misses = 0;
+#pragma omp simd reduction(| : misses)
+    for (size_t i = 0; i < CODEC_FRAME; ++i) {
+      misses |= ((offsets[i] >> shift) * inverse) > limit;
+    }
+    odd = misses ? 1 : odd;
+  }
+  return std::max<uint32_t>(odd, 1) << shift;
+}
+
+// Value j * LANES + l goes to lane l at bit j * Bits, so every lane shifts
+// alike and the lane loops are element-wise vector operations. Bits is a
+// template argument and the steps are unrolled so all shifts are constant.
+template <unsigned Bits, size_t J>
+void packStep(const uint32_t *values, uint32_t *acc, uint32_t *out) {
+  constexpr unsigned shift = J * Bits % 32;
+  constexpr size_t word = J * Bits / 32;
+  const uint32_t *v = values + J * LANES;
+#pragma omp simd
+  for (size_t l = 0; l < LANES; ++l) {
+    acc[l] |= v[l] << shift;
+  }
+  if constexpr (shift + Bits >= 32) {
+#pragma omp simd
+    for (size_t l = 0; l < LANES; ++l) {
+      out[word * LANES + l] = acc[l];
+      if constexpr (shift + Bits > 32) {
+        acc[l] = v[l] >> (32 - shift);
+      } else {
+        acc[l] = 0;
+      }
+    }
+  }
+}
+
+template <unsigned Bits, size_t J>
+void unpackStep(const uint32_t *in, uint32_t *values) {
+  constexpr unsigned shift = J * Bits % 32;
+  constexpr size_t word = J * Bits / 32;
+  constexpr uint32_t mask = Bits == 32 ? ~0u : (1u << Bits) - 1;
+  const uint32_t *w = in + word * LANES;
+  uint32_t *v = values + J * LANES;
+#pragma omp simd
+  for (size_t l = 0; l < LANES; ++l) {
+    if constexpr (shift + Bits <= 32) {
+      v[l] = (w[l] >> shift) & mask;
+    } else {
+      // Straddles this word of the lane and the next
+      v[l] = ((w[l] >> shift) | (w[LANES + l] << (32 - shift))) & mask;
+    }
+  }
+}
+
+template <unsigned Bits> void packFixed(const uint32_t *values, uint32_t *out) {
+  if constexpr (Bits > 0) {
+    uint32_t acc[LANES] = {};
+    [&]<size_t... J>(std::index_sequence<J...>) {
+      (packStep<Bits, J>(values, acc, out), ...);
+    }(std::make_index_sequence<PER_LANE>{});
+  }
+}
+
+template <unsigned Bits>
+void unpackFixed(const uint32_t *in, uint32_t *values) {
+  if constexpr (Bits == 0) {
+    std::fill_n(values, CODEC_FRAME, 0);
+  } else {
+    [&]<size_t... J>(std::index_sequence<J...>) {
+      (unpackStep<Bits, J>(in, values), ...);
+    }(std::make_index_sequence<PER_LANE>{});
+  }
+}
+
+using PackFn = void (*)(const uint32_t *, uint32_t *);
+
+template <size_t... Bits>
+constexpr std::array<PackFn, sizeof...(Bits)>
+packTable(std::index_sequence<Bits...>) {
+  return {&packFixed<Bits>...};
+}
+
+template <size_t... Bits>
+constexpr std::array<PackFn, sizeof...(Bits)>
+unpackTable(std::index_sequence<Bits...>) {
+  return {&unpackFixed<Bits>...};
+}
+
+// Indexed by bit width, 0 to 32
+constexpr auto PACK = packTable(std::make_index_sequence<33>{});
+constexpr auto UNPACK = unpackTable(std::make_index_sequence<33>{});
+
+void unpackFrame(const uint32_t *frame, float quantum, float *out) {
+  const unsigned bits = frame[0] & 0xff;
+  const auto reference = std::bit_cast<int32_t>(frame[1]);
+  const auto factor = static_cast<int32_t>(frame[2]);
+  uint32_t values[CODEC_FRAME];
+  UNPACK[bits](frame + FRAME_HEADER, values);
+  if (frame[0] & DELTA) {
+    int32_t code = reference;
+    for (size_t i = 0; i < CODEC_FRAME; ++i) {
+      code += unzigzag(values[i]) * factor;
+      out[i] = static_cast<float>(code) * quantum;
+    }
+  } else {
+#pragma omp simd
+    for (size_t i = 0; i < CODEC_FRAME; ++i) {
+      out[i] = static_cast<float>(reference +
+                                  static_cast<int32_t>(values[i]) * factor) *
+               quantum;
+    }
+  }
+}
+} // namespace
+
+bool packSamples(std::span<const float> samples, float quantum,
+                 std::vector<uint32_t> &out) {
+  if (!(quantum > 0.f) || !std::isfinite(quantum) || samples.empty()) {
+    return false;
+  }
+  const size_t frames = (samples.size() + CODEC_FRAME - 1) / CODEC_FRAME;
+  out.assign(HEADER + frames, 0);
+  // Worst case, so frames are appended without reallocating
+  out.reserve(HEADER + frames * (1 + FRAME_HEADER + 32 * LANES));
+  out[0] = static_cast<uint32_t>(samples.size());
+  out[1] = std::bit_cast<uint32_t>(quantum);
+
+  const float inverse = 1.f / quantum;
+  int32_t codes[CODEC_FRAME];
+  uint32_t deltas[CODEC_FRAME];
+  uint32_t offsets[CODEC_FRAME];
+  float decoded[CODEC_FRAME];
+  for (size_t f = 0; f < frames; ++f) {
+    const float *x = samples.data() + f * CODEC_FRAME;
+    const size_t n = std::min(CODEC_FRAME, samples.size() - f * CODEC_FRAME);
+    // Separate passes keep every loop free of selects, which would stop
+    // them vectorising; NaN fails the range check
+    uint32_t outside = 0;
+#pragma omp simd reduction(| : outside)
+    for (size_t i = 0; i < n; ++i) {
+      outside |= !(std::abs(x[i] * inverse) < MAX_CODE);
+    }
+    if (outside != 0) {
+      return false;
+    }
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+      codes[i] = static_cast<int32_t>((x[i] * inverse + ROUND) - ROUND);
+    }
+    // Rounding through the reciprocal may pick a neighbouring code, but
+    // only codes that reproduce every sample bit for bit are kept
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+      decoded[i] = static_cast<float>(codes[i]) * quantum;
+    }
+    if (std::memcmp(decoded, x, n * sizeof(float)) != 0) {
+      return false;
+    }
+    // A short last frame repeats its last code, which costs no bits
+    std::fill(codes + n, codes + CODEC_FRAME, codes[n - 1]);
+
+    int32_t min = codes[0];
+    int32_t max = codes[0];
+#pragma omp simd reduction(min : min) reduction(max : max)
+    for (size_t i = 0; i < CODEC_FRAME; ++i) {
+      min = std::min(min, codes[i]);
+      max = std::max(max, codes[i]);
+    }
+#pragma omp simd
+    for (size_t i = 0; i < CODEC_FRAME; ++i) {
+      offsets[i] = static_cast<uint32_t>(codes[i] - min);
+    }
+    // Offsets from the minimum and differences share every common factor
+    const uint32_t factor = commonFactor(offsets);
+    const ExactDivisor divide{factor};
+    deltas[0] = 0;
+#pragma omp simd
+    for (size_t i = 1; i < CODEC_FRAME; ++i) {
+      deltas[i] = zigzag(divide(codes[i] - codes[i - 1]));
+    }
+#pragma omp simd
+    for (size_t i = 0; i < CODEC_FRAME; ++i) {
+      offsets[i] = static_cast<uint32_t>(divide(offsets[i]));
+    }
+    uint32_t deltaBits = 0;
+#pragma omp simd reduction(| : deltaBits)
+    for (size_t i = 0; i < CODEC_FRAME; ++i) {
+      deltaBits |= deltas[i];
+    }
+    const unsigned delta = std::bit_width(deltaBits);
+    const unsigned reference =
+        std::bit_width(static_cast<uint32_t>(divide(max - min)));
+
+    out[HEADER + f] = static_cast<uint32_t>(out.size());
+    const bool useDelta = delta < reference;
+    const unsigned bits = useDelta ? delta : reference;
+    const size_t at = out.size();
+    out.resize(at + FRAME_HEADER + bits * LANES);
+    out[at] = bits | (useDelta ? DELTA : 0);
+    out[at + 1] = std::bit_cast<uint32_t>(useDelta ? codes[0] : min);
+    out[at + 2] = factor;
+    PACK[bits](useDelta ? deltas : offsets, out.data() + at + FRAME_HEADER);
+  }
+  return out.size() < samples.size();
+}
+
+size_t packedCount(const uint32_t *packed) { return packed[0]; }
+
+void unpackSamples(const uint32_t *packed, size_t first,
+                   std::span<float> out) {
+  const auto quantum = std::bit_cast<float>(packed[1]);
+  float frame[CODEC_FRAME];
+  for (size_t at = 0; at < out.size();) {
+    const size_t f = (first + at) / CODEC_FRAME;
+    const size_t offset = (first + at) % CODEC_FRAME;
+    const size_t n = std::min(CODEC_FRAME - offset, out.size() - at);
+    const uint32_t *data = packed + packed[HEADER + f];
+    if (n == CODEC_FRAME) {
+      unpackFrame(data, quantum, out.data() + at);
+    } else {
+      unpackFrame(data, quantum, frame);
+      std::copy_n(frame + offset, n, out.data() + at);
+    }
+    at += n;
+  }
+}
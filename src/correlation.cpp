@@ -0,0 +1,141 @@
+#include "correlation.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace {
+// Smallest 2^a 3^b 5^c at or above n; FFTW is fast on these and they pad
+// far less than the next power of two.
+size_t fastFftSize(size_t n) {
+  size_t best = std::bit_ceil(n);
+  for (size_t p5 = 1; p5 < best; p5 *= 5) {
+    for (size_t p35 = p5; p35 < best; p35 *= 3) {
+      const size_t size = p35 * std::bit_ceil((n + p35 - 1) / p35);
+      best = std::min(best, size);
+    }
+  }
+  return best;
+}
+
+// Copies x without its mean into buffer, zero padding the rest, and returns
+// the energy of the copied samples.
+double loadCentred(std::span<const float> x, FftwBuffer<float> &buffer) {
+  double sum = 0.;
+#pragma omp simd reduction(+ : sum)
+  for (size_t i = 0; i < x.size(); ++i) {
+    sum += x[i];
+  }
+  const float mean = sum / x.size();
+  float *__restrict out = buffer.real.get();
+  double energy = 0.;
+#pragma omp simd reduction(+ : energy)
+  for (size_t i = 0; i < x.size(); ++i) {
+    out[i] = x[i] - mean;
+    energy += double(out[i]) * out[i];
+  }
+  std::fill(out + x.size(), out + buffer.size, 0.f);
+  return energy;
+}
+} // namespace
+
+CrossCorrelator::CrossCorrelator(CorrelationWeighting weighting)
+    : weighting(weighting) {}
+
+void CrossCorrelator::setWeighting(CorrelationWeighting weighting) {
+  this->weighting = weighting;
+}
+
+DelayEstimate CrossCorrelator::estimate(std::span<const float> a,
+                                        std::span<const float> b,
+                                        size_t maxLag) {
+  const size_t n = std::min(a.size(), b.size());
+  values.clear();
+  this->maxLag = 0;
+  if (n < 3) {
+    return {};
+  }
+  a = a.first(n);
+  b = b.first(n);
+  if (maxLag == 0 || maxLag >= n) {
+    maxLag = n - 1;
+  }
+
+  // Circular correlation equals linear correlation for |lag| <= maxLag once
+  // n + maxLag samples fit in the transform
+  const size_t size = fastFftSize(n + maxLag);
+  if (size != fftSize) {
+    fftSize = size;
+    plan = std::make_unique<RealFft<float>>(size);
+    bufferA = FftwBuffer<float>{size};
+    bufferB = FftwBuffer<float>{size};
+  }
+  const double energy = std::sqrt(loadCentred(a, bufferA) *
+                                  loadCentred(b, bufferB));
+  if (energy == 0.) {
+    return {};
+  }
+
+  plan->execute(bufferA);
+  plan->execute(bufferB);
+
+  // A * conj(B), whitened to unit magnitude for PHAT
+  const size_t bins = size / 2 + 1;
+  float *__restrict spectrumA = bufferA.complex.get()[0];
+  const float *__restrict spectrumB = bufferB.complex.get()[0];
+  for (size_t i = 0; i < bins; ++i) {
+    const float ar = spectrumA[2 * i], ai = spectrumA[2 * i + 1];
+    const float br = spectrumB[2 * i], bi = spectrumB[2 * i + 1];
+    float re = ar * br + ai * bi;
+    float im = ai * br - ar * bi;
+    if (weighting == CorrelationWeighting::Phat) {
+      const float magnitude = std::sqrt(re * re + im * im) + 1e-20f;
+      re /= magnitude;
+      im /= magnitude;
+    }
+    spectrumA[2 * i] = re;
+    spectrumA[2 * i + 1] = im;
+  }
+  plan->inverse(bufferA);
+
+  // Negative lags wrap to the end of the inverse transform
+  const float scale = weighting == CorrelationWeighting::Phat
+                          ? 1.f / size
+                          : static_cast<float>(1. / energy);
+  const float *r = bufferA.real.get();
+  this->maxLag = maxLag;
+  values.resize(2 * maxLag + 1);
+  for (size_t i = 0; i < maxLag; ++i) {
+    values[i] = r[size - maxLag + i] * scale;
+  }
+  for (size_t i = 0; i <= maxLag; ++i) {
+    values[maxLag + i] = r[i] * scale;
+  }
+
+  const auto peak = std::ranges::max_element(values) - values.begin();
+  DelayEstimate res;
+  res.lag = peak - static_cast<ptrdiff_t>(maxLag);
+  res.peak = values[peak];
+  res.delay = res.lag;
+  res.valid = true;
+  if (peak > 0 && peak + 1 < static_cast<ptrdiff_t>(values.size())) {
+    const double left = values[peak - 1];
+    const double centre = values[peak];
+    const double right = values[peak + 1];
+    const double denominator = left - 2 * centre + right;
+    if (denominator < 0) {
+      res.delay += 0.5 * (left - right) / denominator;
+    }
+  }
+  return res;
+}
+
+std::string to_string(CorrelationWeighting weighting) {
+  switch (weighting) {
+  case CorrelationWeighting::None:
+    return "Plain";
+  case CorrelationWeighting::Phat:
+    return "GCC-PHAT";
+  }
+  return "";
+}
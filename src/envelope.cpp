@@ -0,0 +1,191 @@
+#include "envelope.hpp"
+
+#include <algorithm>
+#include <limits>
+
+size_t EnvelopePyramid::blockSize(size_t level) {
+  size_t size = ENVELOPE_BLOCK;
+  for (size_t i = 0; i < level; ++i) {
+    size *= ENVELOPE_FACTOR;
+  }
+  return size;
+}
+
+void EnvelopePyramid::push(size_t level, float min, float max) {
+  if (level == levels.size()) {
+    levels.emplace_back();
+  }
+  auto &l = levels[level];
+  if (l.pending == 0) {
+    l.pendingMin = min;
+    l.pendingMax = max;
+  } else {
+    l.pendingMin = std::min(l.pendingMin, min);
+    l.pendingMax = std::max(l.pendingMax, max);
+  }
+  if (++l.pending == ENVELOPE_FACTOR) {
+    l.min.push_back(l.pendingMin);
+    l.max.push_back(l.pendingMax);
+    l.pending = 0;
+    push(level + 1, l.min.back(), l.max.back());
+  }
+}
+
+void EnvelopePyramid::append(std::span<const float> samples) {
+  if (samples.empty()) {
+    return;
+  }
+  if (levels.empty()) {
+    levels.emplace_back();
+  }
+  // The finest level is filled directly; only completed blocks cascade
+  for (const float x : samples) {
+    // Cascading may grow levels, so the reference is taken per sample
+    auto &base = levels[0];
+    if (base.pending == 0) {
+      base.pendingMin = x;
+      base.pendingMax = x;
+    } else {
+      base.pendingMin = std::min(base.pendingMin, x);
+      base.pendingMax = std::max(base.pendingMax, x);
+    }
+    if (++base.pending == ENVELOPE_BLOCK) {
+      base.min.push_back(base.pendingMin);
+      base.max.push_back(base.pendingMax);
+      base.pending = 0;
+      push(1, base.pendingMin, base.pendingMax);
+    }
+  }
+  count += samples.size();
+}
+
+void EnvelopePyramid::clear(size_t start) {
+  levels.clear();
+  origin = start;
+  count = 0;
+}
+
+void EnvelopePyramid::discard(size_t index) {
+  if (index <= origin) {
+    return;
+  }
+  for (size_t k = 0; k < levels.size(); ++k) {
+    auto &l = levels[k];
+    const size_t before = (index - origin) / blockSize(k);
+    while (l.dropped < before && !l.min.empty()) {
+      l.min.pop_front();
+      l.max.pop_front();
+      ++l.dropped;
+    }
+  }
+}
+
+bool EnvelopePyramid::envelope(size_t first, size_t last, size_t buckets,
+                               std::vector<EnvelopeBucket> &out) const {
+  out.clear();
+  // Internally samples count from the origin
+  first = std::max(first, origin) - origin;
+  last = std::min(last, endIndex());
+  last = last > origin ? last - origin : 0;
+  if (first >= last || buckets == 0) {
+    return true;
+  }
+  const size_t perBucket = (last - first) / buckets;
+  if (perBucket < ENVELOPE_BLOCK) {
+    return false;
+  }
+
+  size_t level = 0;
+  while (level + 1 < levels.size() && blockSize(level + 1) <= perBucket) {
+    ++level;
+  }
+  const size_t block = blockSize(level);
+  // Rounded up so the bucket count never exceeds the request
+  const size_t width = (last - first + buckets * block - 1) /
+                       (buckets * block) * block;
+  const auto &l = levels[level];
+  const size_t complete = (l.dropped + l.min.size()) * block;
+
+  for (size_t start = first / width * width; start < last; start += width) {
+    const size_t end = std::min(start + width, count);
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+    for (size_t i = std::max(start / block, l.dropped);
+         i < std::min(end, complete) / block; ++i) {
+      min = std::min(min, l.min[i - l.dropped]);
+      max = std::max(max, l.max[i - l.dropped]);
+    }
+    // Buckets are block aligned, so one reaching past the complete blocks
+    // holds the whole tail: the incomplete block of this and every finer
+    // level.
+    if (end > complete) {
+      for (size_t k = 0; k <= level; ++k) {
+        if (levels[k].pending > 0) {
+          min = std::min(min, levels[k].pendingMin);
+          max = std::max(max, levels[k].pendingMax);
+        }
+      }
+    }
+    // Nothing is left of buckets wholly before the discarded range
+    if (min <= max) {
+      out.push_back({origin + start, end - start, min, max});
+    }
+  }
+  return true;
+}
+
+void PeakPyramid::assign(std::span<const double> series) {
+  // Levels are reused so a new spectrum of the same size allocates nothing
+  levels.resize(1);
+  levels[0].min.assign(series.begin(), series.end());
+  levels[0].max = levels[0].min;
+  size_t count = 1;
+  for (size_t n = series.size(); n > ENVELOPE_FACTOR; ++count) {
+    n = (n + ENVELOPE_FACTOR - 1) / ENVELOPE_FACTOR;
+    if (levels.size() == count) {
+      levels.emplace_back();
+    }
+    const auto &below = levels[count - 1];
+    auto &level = levels[count];
+    level.min.resize(n);
+    level.max.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      const size_t begin = i * ENVELOPE_FACTOR;
+      const size_t end = std::min(begin + ENVELOPE_FACTOR, below.min.size());
+      level.min[i] = *std::min_element(below.min.begin() + begin,
+                                       below.min.begin() + end);
+      level.max[i] = *std::max_element(below.max.begin() + begin,
+                                       below.max.begin() + end);
+    }
+  }
+  levels.resize(count);
+}
+
+void PeakPyramid::reduce(size_t first, size_t last, size_t buckets,
+                         std::vector<EnvelopeBucket> &out) const {
+  out.clear();
+  last = std::min(last, size());
+  if (first >= last || buckets == 0) {
+    return;
+  }
+  const size_t perBucket = (last - first) / buckets;
+  size_t level = 0;
+  size_t block = 1;
+  while (level + 1 < levels.size() && block * ENVELOPE_FACTOR <= perBucket) {
+    ++level;
+    block *= ENVELOPE_FACTOR;
+  }
+  // Rounded up so the bucket count never exceeds the request
+  const size_t width = (last - first + buckets * block - 1) /
+                       (buckets * block) * block;
+  const auto &l = levels[level];
+  for (size_t start = first / width * width; start < last; start += width) {
+    const size_t end = std::min(start + width, size());
+    const size_t from = start / block;
+    const size_t to = (end + block - 1) / block;
+    out.push_back({start, end - start,
+                   *std::min_element(l.min.begin() + from, l.min.begin() + to),
+                   *std::max_element(l.max.begin() + from,
+                                     l.max.begin() + to)});
+  }
+}
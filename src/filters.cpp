@@ -0,0 +1,243 @@
+#include "filters.hpp"
+#include "resample.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numbers>
+
+using std::numbers::pi;
+
+Biquad designBiquad(FilterType type, double freq, double q, double sampleRate) {
+  const double w0 = 2 * pi * freq / sampleRate;
+  const double cosw = std::cos(w0);
+  const double alpha = std::sin(w0) / (2 * q);
+  const double a0 = 1 + alpha;
+
+  double b0 = 0, b1 = 0, b2 = 0;
+  switch (type) {
+  case FilterType::LowPass:
+    b0 = b2 = (1 - cosw) / 2;
+    b1 = 1 - cosw;
+    break;
+  case FilterType::HighPass:
+    b0 = b2 = (1 + cosw) / 2;
+    b1 = -(1 + cosw);
+    break;
+  case FilterType::BandPass:
+    // Constant 0 dB peak gain
+    b0 = alpha;
+    b2 = -alpha;
+    break;
+  case FilterType::Notch:
+    b0 = b2 = 1;
+    b1 = -2 * cosw;
+    break;
+  default:
+    b0 = a0;
+    break;
+  }
+  return {b0 / a0, b1 / a0, b2 / a0, -2 * cosw / a0, (1 - alpha) / a0};
+}
+
+std::vector<Biquad> butterworth(FilterType type, size_t order, double freq,
+                                double sampleRate) {
+  const size_t sections = std::max<size_t>(order / 2, 1);
+  std::vector<Biquad> res;
+  for (size_t k = 1; k <= sections; ++k) {
+    const double q = 1 / (2 * std::sin((2 * k - 1) * pi / (4 * sections)));
+    res.push_back(designBiquad(type, freq, q, sampleRate));
+  }
+  return res;
+}
+
+BiquadCascade::BiquadCascade(std::span<const Biquad> coefficients) {
+  for (const auto &c : coefficients) {
+    sections.push_back({c});
+  }
+}
+
+void BiquadCascade::process(std::span<float> samples) {
+  for (auto &section : sections) {
+    const auto [b0, b1, b2, a1, a2] = section.coefficients;
+    double z1 = section.z1, z2 = section.z2;
+    for (auto &e : samples) {
+      const double x = e;
+      const double y = b0 * x + z1;
+      z1 = b1 * x - a1 * y + z2;
+      z2 = b2 * x - a2 * y;
+      e = y;
+    }
+    section.z1 = z1;
+    section.z2 = z2;
+  }
+}
+
+void BiquadCascade::reset() {
+  for (auto &section : sections) {
+    section.z1 = section.z2 = 0.;
+  }
+}
+
+FirFilter::FirFilter(std::span<const double> kernel)
+    : taps(kernel.size()), reversed(kernel.rbegin(), kernel.rend()) {
+  if (taps > DIRECT_FIR_TAPS) {
+    const size_t fftSize = std::bit_ceil(4 * taps);
+    block = fftSize - taps + 1;
+    kernelSpectrum = FftwBuffer<float>{fftSize};
+    buffer = FftwBuffer<float>{fftSize};
+    // Fold the inverse transform's scaling into the kernel
+    std::fill_n(kernelSpectrum.real.get(), fftSize, 0.f);
+    for (size_t i = 0; i < taps; ++i) {
+      kernelSpectrum.real[i] = kernel[i] / fftSize;
+    }
+    realFft<float>(fftSize).execute(kernelSpectrum);
+  }
+  reset();
+}
+
+void FirFilter::reset() {
+  input.assign(taps - 1, 0.f);
+  output.assign(block, 0.f);
+  outputStart = 0;
+}
+
+void FirFilter::process(std::span<float> samples) {
+  if (block == 0) {
+    processDirect(samples);
+  } else {
+    processOverlapSave(samples);
+  }
+}
+
+void FirFilter::processDirect(std::span<float> samples) {
+  const size_t history = taps - 1;
+  input.insert(input.end(), samples.begin(), samples.end());
+  for (size_t i = 0; i < samples.size(); ++i) {
+    samples[i] = dot(reversed.data(), input.data() + i, taps);
+  }
+  input.erase(input.begin(), input.end() - history);
+}
+
+void FirFilter::processOverlapSave(std::span<float> samples) {
+  const size_t history = taps - 1;
+  const size_t fftSize = buffer.size;
+  const auto &plan = realFft<float>(fftSize);
+  input.insert(input.end(), samples.begin(), samples.end());
+
+  size_t start = 0;
+  for (; start + fftSize <= input.size(); start += block) {
+    std::copy_n(input.data() + start, fftSize, buffer.real.get());
+    plan.execute(buffer);
+
+    auto *x = buffer.out();
+    const auto *h = kernelSpectrum.out();
+    for (size_t k = 0; k < fftSize / 2 + 1; ++k) {
+      x[k] *= h[k];
+    }
+    plan.inverse(buffer);
+    // The first taps - 1 outputs wrap around and are discarded
+    output.insert(output.end(), buffer.real.get() + history,
+                  buffer.real.get() + fftSize);
+  }
+  input.erase(input.begin(), input.begin() + start);
+
+  // The output queue was primed with one block of zeros, so it always holds
+  // at least as many samples as came in.
+  std::copy_n(output.begin() + outputStart, samples.size(), samples.begin());
+  outputStart += samples.size();
+  if (outputStart > output.size() / 2) {
+    output.erase(output.begin(), output.begin() + outputStart);
+    outputStart = 0;
+  }
+}
+
+DcBlocker::DcBlocker(double cutoff, double sampleRate)
+    : pole(std::exp(-2 * pi * cutoff / sampleRate)) {}
+
+void DcBlocker::process(std::span<float> samples) {
+  for (auto &e : samples) {
+    const double x = e;
+    y1 = x - x1 + pole * y1;
+    x1 = x;
+    e = y1;
+  }
+}
+
+void DcBlocker::reset() { x1 = y1 = 0.; }
+
+std::string to_string(FilterType type) {
+  switch (type) {
+  case FilterType::LowPass:
+    return "Low Pass";
+  case FilterType::HighPass:
+    return "High Pass";
+  case FilterType::BandPass:
+    return "Band Pass";
+  case FilterType::Notch:
+    return "Notch";
+  case FilterType::FirLowPass:
+    return "FIR Low Pass";
+  case FilterType::DcBlock:
+    return "DC Block";
+  }
+  return "";
+}
+
+std::unique_ptr<FilterStage> makeFilter(const FilterSpec &spec,
+                                        double sampleRate) {
+  const double freq = std::clamp(spec.freq, 1e-3, sampleRate * 0.499);
+  switch (spec.type) {
+  case FilterType::LowPass:
+  case FilterType::HighPass: {
+    auto sections = butterworth(spec.type, spec.order, freq, sampleRate);
+    return std::make_unique<BiquadCascade>(sections);
+  }
+  case FilterType::BandPass:
+  case FilterType::Notch: {
+    std::vector<Biquad> sections(std::max<size_t>(spec.order / 2, 1),
+                                 designBiquad(spec.type, freq, spec.q,
+                                              sampleRate));
+    return std::make_unique<BiquadCascade>(sections);
+  }
+  case FilterType::FirLowPass: {
+    auto kernel = lowpassKernel(spec.taps | 1, freq / sampleRate);
+    return std::make_unique<FirFilter>(kernel);
+  }
+  case FilterType::DcBlock:
+    return std::make_unique<DcBlocker>(freq, sampleRate);
+  }
+  return nullptr;
+}
+
+FilterChain::FilterChain(std::span<const FilterSpec> specs,
+                         double sampleRate) {
+  for (const auto &spec : specs) {
+    stages.push_back({makeFilter(spec, sampleRate)});
+  }
+}
+
+void FilterChain::process(std::span<float> samples) {
+  for (auto &stage : stages) {
+    auto start = std::chrono::steady_clock::now();
+    stage.filter->process(samples);
+    stage.elapsed += std::chrono::steady_clock::now() - start;
+    stage.samples += samples.size();
+  }
+}
+
+void FilterChain::reset() {
+  for (auto &stage : stages) {
+    stage.filter->reset();
+  }
+}
+
+std::vector<FilterStats> FilterChain::stats(double sampleRate) const {
+  std::vector<FilterStats> res;
+  for (const auto &stage : stages) {
+    const double ns =
+        stage.samples ? (double)stage.elapsed.count() / stage.samples : 0.;
+    res.push_back({ns, ns * 1e-9 * sampleRate, stage.filter->latency()});
+  }
+  return res;
+}
@@ -0,0 +1,496 @@
+#include "ingest.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Volts a signal must swing below zero to arm the next rising crossing,
+// until the UI sets it for the voltage range in use
+constexpr double DEFAULT_HYSTERESIS = 0.2;
+
+void updateTrace(ChannelTrace &trace, const ChannelTrace::Key &key,
+                 const SampleStore &store, const EnvelopePyramid &envelope) {
+  if (key == trace.key) {
+    return;
+  }
+  trace.key = key;
+  trace.first = key.first;
+  trace.samples.clear();
+  trace.envelope =
+      envelope.envelope(key.first, key.last, key.pixels, trace.buckets);
+  if (!trace.envelope) {
+    store.visit(key.first, key.last, [&trace](auto piece) {
+      trace.samples.insert(trace.samples.end(), piece.begin(), piece.end());
+    });
+  }
+}
+
+std::shared_ptr<const SpectrogramImage>
+copyImage(const Spectrogram &spectrogram) {
+  auto image = std::make_shared<SpectrogramImage>();
+  image->bins = spectrogram.bins();
+  image->hopSeconds = spectrogram.hopSeconds();
+  image->nyquist = spectrogram.nyquist();
+  const auto blocks = spectrogram.blocks();
+  image->columns = blocks[0].columns + blocks[1].columns;
+  image->data.reserve(image->columns * image->bins);
+  for (const auto &block : blocks) {
+    image->data.insert(image->data.end(), block.data,
+                       block.data + block.columns * image->bins);
+  }
+  if (image->columns > 0) {
+    const uint64_t first = blocks[0].firstColumn;
+    image->firstTime = spectrogram.columnTime(first);
+    image->lastTime = spectrogram.columnTime(first + image->columns - 1);
+  }
+  return image;
+}
+
+// Refills an image of `pool` that nothing else holds any more, so its
+// buffer is reused, and only allocates while every one is still shared
+std::shared_ptr<const PersistenceImage>
+copyImage(const Persistence &persistence,
+          std::vector<std::shared_ptr<PersistenceImage>> &pool) {
+  auto free = std::ranges::find_if(
+      pool, [](const auto &e) { return e.use_count() == 1; });
+  if (free == pool.end()) {
+    free = pool.insert(pool.end(), std::make_shared<PersistenceImage>());
+  }
+  auto &image = *free;
+  const auto &settings = persistence.getSettings();
+  image->rows = persistence.rows();
+  image->columns = persistence.columns();
+  image->startTime = persistence.startTime();
+  image->sampleInterval = persistence.sampleInterval();
+  image->minVolts = settings.minVolts;
+  image->maxVolts = settings.maxVolts;
+  image->peak = persistence.copyTo(image->data);
+  image->sweeps = persistence.sweepCount();
+  return image;
+}
+} // namespace
+
+Ingest::Ingest(double sampleRate, size_t retention, size_t memoryLimit)
+    : sampleRate(sampleRate), retention(retention), memoryLimit(memoryLimit),
+      raw{SampleStore{retention, memoryLimit},
+          SampleStore{retention, memoryLimit}},
+      stats{ChannelStats{DEFAULT_HYSTERESIS, 1. / sampleRate},
+            ChannelStats{DEFAULT_HYSTERESIS, 1. / sampleRate}},
+      spectrogram{DEFAULT_SPECTROGRAM_WINDOW, DEFAULT_SPECTROGRAM_WINDOW / 2,
+                  sampleRate} {
+  for (auto &slot : slots) {
+    slot.sampleInterval = 1. / sampleRate;
+  }
+  thread = std::thread([this] { run(); });
+}
+
+Ingest::~Ingest() {
+  {
+    std::unique_lock temp{inboxLock};
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+void Ingest::post(Command command) {
+  {
+    std::unique_lock temp{inboxLock};
+    inbox.push_back(std::move(command));
+  }
+  wake.notify_one();
+}
+
+void Ingest::attach(mpsc::Recv<StreamResult> recv) {
+  post([this, recv = std::move(recv)]() mutable {
+    this->recv = std::move(recv);
+  });
+}
+
+void Ingest::detach() {
+  post([this] { recv.reset(); });
+}
+
+void Ingest::append(std::vector<Sample> a, std::vector<Sample> b) {
+  post([this, a = std::move(a), b = std::move(b)] {
+    ingest(a, b, streamEnd);
+  });
+}
+
+void Ingest::clear() {
+  post([this] {
+    for (size_t i = 0; i < 2; ++i) {
+      raw[i].clear();
+      decimated[i].clear();
+      decimators[i].reset();
+      envelopes[i].clear();
+      filters[i].reset();
+      stats[i].clear();
+    }
+    spectrogram.clear();
+    image.reset();
+    if (persistence) {
+      persistence->clear();
+      persistenceStale = true;
+    }
+    ++version;
+    changed = true;
+  });
+}
+
+void Ingest::setView(const ViewRequest &view) {
+  post([this, view] {
+    this->view = view;
+    changed = true;
+  });
+}
+
+uint64_t Ingest::requestVisible(size_t limit) {
+  const uint64_t request = ++visibleRequests;
+  post([this, request, limit] {
+    visibleRequest = request;
+    visibleLimit = limit;
+    visibleStale = true;
+    changed = true;
+  });
+  return request;
+}
+
+void Ingest::setDecimation(size_t factor) {
+  post([this, factor] {
+    decimation = factor;
+    for (size_t i = 0; i < 2; ++i) {
+      decimators[i] = DecimationChain<Sample>{factor};
+      // Decimated indices continue from where the retained raw samples
+      // start, so both copies share one time axis
+      decimated[i].clear(raw[i].firstIndex() / factor);
+      decimated[i].setRetention(retention / factor);
+      decimated[i].setMemoryLimit(memoryLimit / factor);
+      if (factor > 1) {
+        raw[i].visit(raw[i].firstIndex(), raw[i].endIndex(),
+                     [&](std::span<const Sample> piece) {
+                       incomingDecimated.clear();
+                       decimators[i].process(piece, incomingDecimated);
+                       decimated[i].append(incomingDecimated);
+                     });
+      } else {
+        decimated[i].clear();
+      }
+      // The envelopes follow whichever copy is displayed
+      const auto &store = displayed(i);
+      envelopes[i].clear(store.firstIndex());
+      store.visit(store.firstIndex(), store.endIndex(),
+                  [this, i](auto piece) { envelopes[i].append(piece); });
+    }
+    ++version;
+    changed = true;
+  });
+}
+
+void Ingest::setRetention(size_t samples) {
+  post([this, samples] {
+    retention = samples;
+    for (size_t i = 0; i < 2; ++i) {
+      raw[i].setRetention(samples);
+      decimated[i].setRetention(samples / decimation);
+      envelopes[i].discard(displayed(i).firstIndex());
+      stats[i].discard(raw[i].firstIndex());
+    }
+    ++version;
+    changed = true;
+  });
+}
+
+void Ingest::setMemoryLimit(size_t bytes) {
+  post([this, bytes] {
+    memoryLimit = bytes;
+    for (size_t i = 0; i < 2; ++i) {
+      raw[i].setMemoryLimit(bytes);
+      decimated[i].setMemoryLimit(bytes / decimation);
+    }
+    changed = true;
+  });
+}
+
+void Ingest::setQuantum(float step) {
+  post([this, step] { quantum = step; });
+}
+
+void Ingest::setHysteresis(double volts) {
+  post([this, volts] {
+    for (auto &s : stats) {
+      s.setHysteresis(volts);
+    }
+  });
+}
+
+void Ingest::setFilters(size_t channel, std::vector<FilterSpec> specs) {
+  post([this, channel, specs = std::move(specs)] {
+    filters[channel] = FilterChain{specs, sampleRate};
+    changed = true;
+  });
+}
+
+void Ingest::setSpectrogram(size_t windowSize) {
+  post([this, windowSize] {
+    spectrogram = Spectrogram{windowSize, windowSize / 2, sampleRate};
+    image.reset();
+    changed = true;
+  });
+}
+
+void Ingest::trackSweep(std::optional<SweepSchedule> schedule) {
+  post([this, schedule] {
+    if (schedule) {
+      sweepTracker.emplace(*schedule, sampleRate);
+    } else {
+      sweepTracker.reset();
+    }
+    changed = true;
+  });
+}
+
+void Ingest::setPersistence(std::optional<PersistenceSettings> settings) {
+  post([this, settings] {
+    if (!settings) {
+      persistence.reset();
+      persistenceImages.clear();
+    } else if (!persistence || persistence->getSettings() != *settings) {
+      persistence.emplace(*settings, sampleRate);
+    }
+    persistenceImage.reset();
+    persistenceStale = true;
+    changed = true;
+  });
+}
+
+void Ingest::sync() {
+  std::promise<void> done;
+  auto published = done.get_future();
+  post([this, done = std::move(done)]() mutable {
+    synced.push_back(std::move(done));
+    changed = true;
+  });
+  published.wait();
+}
+
+bool Ingest::acquire() {
+  if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+    return false;
+  }
+  // Hands the slot read so far back to the writer along with taking the
+  // newest, so both directions need ordering
+  front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+  return true;
+}
+
+void Ingest::run() {
+  using Clock = std::chrono::steady_clock;
+  auto &profiler = Profiler::getInstance();
+  auto &trace = TraceRecorder::getInstance();
+  trace.nameThread("ingest");
+
+  std::vector<Command> commands;
+  Clock::time_point published;
+  while (true) {
+    {
+      std::unique_lock lock{inboxLock};
+      const auto ready = [this] { return stopping || !inbox.empty(); };
+      // Blocks are polled for while streaming, and changes held back by
+      // the publish interval are published once it has passed
+      std::optional<Clock::time_point> deadline;
+      if (recv) {
+        deadline = Clock::now() + INGEST_POLL_INTERVAL;
+      }
+      if (changed) {
+        deadline = std::min(deadline.value_or(Clock::time_point::max()),
+                            published + INGEST_PUBLISH_INTERVAL);
+      }
+      if (deadline) {
+        wake.wait_until(lock, *deadline, ready);
+      } else {
+        wake.wait(lock, ready);
+      }
+      if (stopping) {
+        return;
+      }
+      commands.swap(inbox);
+    }
+
+    const bool requested = !commands.empty();
+    for (auto &command : commands) {
+      command();
+    }
+    commands.clear();
+
+    if (recv) {
+      for (const auto &e : recv->flush_no_block()) {
+        const auto received = Clock::now();
+        profiler.record(Stage::ChannelHop, e.sent, received, e.dataA.size());
+        profiler.addQueued(Queue::Stream, -1);
+        trace.flow("block", false, e.first);
+        ProfileScope profile{Stage::Ingest, e.dataA.size()};
+        const size_t first = raw[0].endIndex();
+        ingest(e.dataA, e.dataB, e.first);
+        trace.complete("ingest", received, Clock::now(), first,
+                       e.dataA.size());
+      }
+    }
+
+    const auto now = Clock::now();
+    if (changed &&
+        (requested || now - published >= INGEST_PUBLISH_INTERVAL)) {
+      publish();
+      published = now;
+      changed = false;
+      for (auto &done : synced) {
+        done.set_value();
+      }
+      synced.clear();
+    }
+  }
+}
+
+void Ingest::ingest(std::span<const Sample> a, std::span<const Sample> b,
+                    uint64_t first) {
+  streamEnd = first + a.size();
+  // Filter the incoming block before it is stored; everything downstream
+  // sees the filtered stream.
+  const std::array blocks = {a, b};
+  for (size_t i = 0; i < 2; ++i) {
+    incoming[i].assign(blocks[i].begin(), blocks[i].end());
+    filters[i].process(incoming[i]);
+    // Unfiltered samples are whole ADC codes, which pack losslessly
+    raw[i].setQuantum(filters[i].empty() ? quantum : 0.f);
+    raw[i].append(incoming[i]);
+    stats[i].append(incoming[i]);
+    stats[i].discard(raw[i].firstIndex());
+  }
+
+  if (decimation > 1) {
+    ProfileScope profile{Stage::Decimation, a.size()};
+    for (size_t i = 0; i < 2; ++i) {
+      incomingDecimated.clear();
+      decimators[i].process(incoming[i], incomingDecimated);
+      decimated[i].append(incomingDecimated);
+      envelopes[i].append(incomingDecimated);
+      envelopes[i].discard(decimated[i].firstIndex());
+    }
+  } else {
+    for (size_t i = 0; i < 2; ++i) {
+      envelopes[i].append(incoming[i]);
+      envelopes[i].discard(raw[i].firstIndex());
+    }
+  }
+  if (view.spectrogram) {
+    spectrogram.push(incoming[0]);
+  }
+  if (sweepTracker) {
+    sweepTracker->push(incoming[0], incoming[1], first);
+  }
+  if (persistence) {
+    const size_t channel = persistence->getSettings().channel;
+    persistence->push(incoming[std::min<size_t>(channel, 1)]);
+    persistenceStale = true;
+  }
+  ++version;
+  changed = true;
+}
+
+const SampleStore &Ingest::displayed(size_t channel) const {
+  return decimation > 1 ? decimated[channel] : raw[channel];
+}
+
+void Ingest::publish() {
+  auto &s = slots[back];
+  s.view = view;
+  s.version = version;
+  s.decimation = decimation;
+  s.sampleInterval = decimation / sampleRate;
+  s.firstIndex = raw[0].firstIndex();
+  s.endIndex = raw[0].endIndex();
+
+  const double dt = s.sampleInterval;
+  s.history = {};
+  for (size_t i = 0; i < 2; ++i) {
+    const auto &store = displayed(i);
+    const double begin = store.firstIndex();
+    const double end = store.endIndex();
+    const auto left = std::clamp(view.start / dt, begin, end);
+    const auto right = std::clamp(view.end / dt, begin, end);
+    const auto first = static_cast<size_t>(std::round(left));
+    const auto last = std::max(first, static_cast<size_t>(right));
+    updateTrace(s.traces[i], {version, first, last, view.pixels}, store,
+                envelopes[i]);
+
+    if (visibleStale) {
+      const auto to =
+          std::min(static_cast<size_t>(std::max(view.end / dt, 0.)),
+                   store.endIndex());
+      const auto from =
+          std::max(static_cast<size_t>(std::max(view.start / dt, 0.)),
+                   to - std::min(to, visibleLimit));
+      visible[i] = store.snapshot(from, to);
+    }
+    s.visible[i] = visible[i];
+    s.window[i] = stats[i].window(
+        raw[i], static_cast<size_t>(std::max(view.start * sampleRate, 0.)),
+        static_cast<size_t>(std::max(view.end * sampleRate, 0.)));
+    s.stream[i] = stats[i].stream();
+    s.filters[i] = filters[i].stats(sampleRate);
+
+    for (const auto *copy : {&raw[i], &decimated[i]}) {
+      const auto kept = copy->stats();
+      auto &h = s.history;
+      h.memoryBytes += kept.memoryBytes;
+      h.diskBytes += kept.diskBytes;
+      h.spilledChunks += kept.spilledChunks;
+      h.coldReads += kept.coldReads;
+      h.spillFailed = h.spillFailed || kept.spillFailed;
+      h.packedChunks += kept.packedChunks;
+      h.packedBytes += kept.packedBytes;
+      h.unpackedSamples += kept.unpackedSamples;
+      h.unpackSeconds += kept.unpackSeconds;
+    }
+  }
+
+  s.visibleRequest = visibleRequest;
+  visibleStale = false;
+
+  // The image is shared by every snapshot until new columns arrive
+  if (view.spectrogram) {
+    const auto blocks = spectrogram.blocks();
+    // Columns produced so far, which end the second run
+    const uint64_t produced = blocks[1].firstColumn + blocks[1].columns;
+    if (!image || imageEnd != produced) {
+      image = copyImage(spectrogram);
+      imageEnd = produced;
+    }
+    s.spectrogram = image;
+  } else {
+    s.spectrogram.reset();
+  }
+
+  // Faded to the newest sample, so copied whenever samples arrived
+  if (persistence) {
+    if (persistenceStale) {
+      persistenceImage = copyImage(*persistence, persistenceImages);
+      persistenceStale = false;
+    }
+    s.persistence = persistenceImage;
+  } else {
+    s.persistence.reset();
+  }
+
+  s.sweeping = sweepTracker.has_value();
+  if (sweepTracker) {
+    s.bode = sweepTracker->points();
+    s.sweepFrequency = sweepTracker->currentFrequency();
+  } else {
+    s.bode.clear();
+  }
+
+  back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
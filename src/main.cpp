@@ -12,8 +12,11 @@
 #include "globals.hpp"
 #include "pico.hpp"
 #include "processing.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
 #include "ui.hpp"
 
+#include <chrono>
 #include <cmath>
 #include <complex>
 #include <cstdio>
@@ -336,8 +339,11 @@ int main(int, char **) {
   ScopeSettings settings;
   settings.fillRandomData(SAMPLE_RATE * 10);
 
+  TraceRecorder::getInstance().nameThread("ui");
+
   // Main loop
   while (!glfwWindowShouldClose(window)) {
+    const auto frameStart = std::chrono::steady_clock::now();
     // Poll and handle events (inputs, window resize, etc.)
     // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to
     // tell if dear imgui wants to use your inputs.
@@ -430,36 +436,27 @@ int main(int, char **) {
     }
     ImGui::End();
 
-    auto text = std::format("{:.2f} FPS", ImGui::GetIO().Framerate);
-    auto size = ImGui::CalcTextSize(text.c_str());
-    auto windowPadding = ImGui::GetStyle().WindowPadding;
-    auto framePadding = ImGui::GetStyle().FramePadding;
-    ImGui::SetNextWindowSize({size.x + (framePadding.x + windowPadding.x) * 2,
-                              size.y + (framePadding.y + windowPadding.y) * 2});
-    ImGui::SetNextWindowPos({ImGui::GetIO().DisplaySize.x - size.x -
-                                 framePadding.x - windowPadding.x - 10.f,
-                             0.f + 5.f});
-    ImGui::SetNextWindowBgAlpha(0.75);
-    ImGui::Begin("FPS Overlay", nullptr,
-                 ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoDecoration |
-                     ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoNav |
-                     ImGuiWindowFlags_NoInputs);
-    ImGui::TextUnformatted(text.c_str());
-    ImGui::End();
+    drawProfiler();
 
     // ImPlot::ShowDemoWindow(nullptr);
 
-    // Rendering
-    ImGui::Render();
-    int display_w, display_h;
-    glfwGetFramebufferSize(window, &display_w, &display_h);
-    glViewport(0, 0, display_w, display_h);
-    glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w,
-                 clear_color.z * clear_color.w, clear_color.w);
-    glClear(GL_COLOR_BUFFER_BIT);
-    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    // Rendering, up to but not including the swap, which waits for vsync
+    {
+      ProfileScope profile{Stage::Render};
+      ImGui::Render();
+      int display_w, display_h;
+      glfwGetFramebufferSize(window, &display_w, &display_h);
+      glViewport(0, 0, display_w, display_h);
+      glClearColor(clear_color.x * clear_color.w,
+                   clear_color.y * clear_color.w,
+                   clear_color.z * clear_color.w, clear_color.w);
+      glClear(GL_COLOR_BUFFER_BIT);
+      ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    }
 
     glfwSwapBuffers(window);
+    TraceRecorder::getInstance().frame(frameStart,
+                                       std::chrono::steady_clock::now());
   }
 
   // Cleanup
@@ -0,0 +1,247 @@
+#include "measure.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void ChannelStats::Summary::merge(const Summary &other) {
+  sum += other.sum;
+  sumSq += other.sumSq;
+  min = std::min(min, other.min);
+  max = std::max(max, other.max);
+}
+
+ChannelStats::Summary summarize(std::span<const float> samples) {
+  ChannelStats::Summary res;
+  const float *data = samples.data();
+  const size_t n = samples.size();
+  double sum = 0., sumSq = 0.;
+  float lo = res.min, hi = res.max;
+#pragma omp simd reduction(+ : sum, sumSq) reduction(min : lo) reduction(max : hi)
+  for (size_t i = 0; i < n; ++i) {
+    const double x = data[i];
+    sum += x;
+    sumSq += x * x;
+    lo = std::min(lo, data[i]);
+    hi = std::max(hi, data[i]);
+  }
+  res.sum = sum;
+  res.sumSq = sumSq;
+  res.min = lo;
+  res.max = hi;
+  return res;
+}
+
+ChannelStats::ChannelStats(double hysteresis, double sampleInterval)
+    : hysteresis(hysteresis), sampleInterval(sampleInterval) {}
+
+void ChannelStats::clear() {
+  prefixSum = {0.};
+  prefixSq = {0.};
+  blockMin.clear();
+  blockMax.clear();
+  droppedBlocks = 0;
+  current = {};
+  total = {};
+  count = 0;
+  crossings.clear();
+  armed = false;
+  previous = 0.f;
+}
+
+void ChannelStats::append(std::span<const float> samples) {
+  const float h = hysteresis;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const float x = samples[i];
+    if (x < -h) {
+      armed = true;
+    } else if (armed && x >= 0.f) {
+      const double fraction = previous < 0.f ? -previous / (x - previous) : 0.;
+      crossings.push_back(count + i - 1 + fraction);
+      armed = false;
+    }
+    previous = x;
+  }
+
+  while (!samples.empty()) {
+    const size_t room = BLOCK - count % BLOCK;
+    const auto piece = samples.first(std::min(room, samples.size()));
+    const auto summary = summarize(piece);
+    current.merge(summary);
+    total.merge(summary);
+    count += piece.size();
+    samples = samples.subspan(piece.size());
+
+    if (count % BLOCK == 0) {
+      prefixSum.push_back(prefixSum.back() + current.sum);
+      prefixSq.push_back(prefixSq.back() + current.sumSq);
+      blockMin.push_back(current.min);
+      blockMax.push_back(current.max);
+      current = {};
+    }
+  }
+}
+
+void ChannelStats::discard(size_t index) {
+  const size_t before = index / BLOCK;
+  while (droppedBlocks < before && !blockMin.empty()) {
+    prefixSum.pop_front();
+    prefixSq.pop_front();
+    blockMin.pop_front();
+    blockMax.pop_front();
+    ++droppedBlocks;
+  }
+  while (!crossings.empty() && crossings.front() < index) {
+    crossings.pop_front();
+  }
+}
+
+Measurements ChannelStats::finish(const Summary &summary, size_t n,
+                                  double firstCrossing, double lastCrossing,
+                                  size_t crossingCount) const {
+  Measurements res;
+  if (n == 0) {
+    return res;
+  }
+  res.count = n;
+  res.mean = summary.sum / n;
+  res.rms = std::sqrt(summary.sumSq / n);
+  res.min = summary.min;
+  res.max = summary.max;
+  res.pkToPk = res.max - res.min;
+  if (crossingCount >= 2) {
+    res.period = (lastCrossing - firstCrossing) / (crossingCount - 1) *
+                 sampleInterval;
+    res.frequency = 1. / res.period;
+  }
+  return res;
+}
+
+Measurements ChannelStats::window(std::span<const float> data, size_t left,
+                                  size_t right) const {
+  return window(left, std::min(right, data.size()),
+                [data](size_t from, size_t to) {
+                  return summarize(data.subspan(from, to - from));
+                });
+}
+
+Measurements ChannelStats::window(const SampleStore &data, size_t left,
+                                  size_t right) const {
+  return window(std::max(left, data.firstIndex()),
+                std::min(right, data.endIndex()),
+                [&data](size_t from, size_t to) {
+                  Summary summary;
+                  data.visit(from, to, [&summary](auto piece) {
+                    summary.merge(summarize(piece));
+                  });
+                  return summary;
+                });
+}
+
+Measurements
+ChannelStats::window(size_t left, size_t right,
+                     const std::function<Summary(size_t, size_t)> &partial)
+    const {
+  right = std::min(right, count);
+  if (left >= right) {
+    return {};
+  }
+
+  Summary summary;
+  const size_t firstBlock =
+      std::max((left + BLOCK - 1) / BLOCK, droppedBlocks);
+  const size_t lastBlock =
+      std::min(right / BLOCK, droppedBlocks + blockMin.size());
+  if (firstBlock >= lastBlock) {
+    summary = partial(left, right);
+  } else {
+    summary.merge(partial(left, firstBlock * BLOCK));
+    summary.merge(partial(lastBlock * BLOCK, right));
+    const size_t from = firstBlock - droppedBlocks;
+    const size_t to = lastBlock - droppedBlocks;
+    summary.sum += prefixSum[to] - prefixSum[from];
+    summary.sumSq += prefixSq[to] - prefixSq[from];
+    for (size_t i = from; i < to; ++i) {
+      summary.min = std::min(summary.min, blockMin[i]);
+      summary.max = std::max(summary.max, blockMax[i]);
+    }
+  }
+
+  auto first = std::lower_bound(crossings.begin(), crossings.end(), left);
+  auto last = std::lower_bound(first, crossings.end(), right);
+  const size_t n = last - first;
+  return finish(summary, right - left, n ? *first : 0., n ? *(last - 1) : 0.,
+                n);
+}
+
+Measurements ChannelStats::stream() const {
+  // Frequency of the most recent cycles so it tracks a changing input
+  constexpr size_t RECENT_CROSSINGS = 64;
+  const size_t n = std::min(crossings.size(), RECENT_CROSSINGS);
+  return finish(total, count, n ? crossings[crossings.size() - n] : 0.,
+                n ? crossings.back() : 0., n);
+}
+
+SpectralMetrics spectralMetrics(std::span<const double> power, double binWidth,
+                                size_t harmonics, size_t leakage) {
+  SpectralMetrics res;
+  const size_t bins = power.size();
+  if (bins <= 2 * leakage + 2) {
+    return res;
+  }
+
+  // Bins within the leakage of centre, less those leaking from DC
+  auto bandBins = [&](size_t centre) {
+    const size_t lo = centre > leakage ? centre - leakage : 0;
+    return std::pair{std::max(lo, leakage + 1),
+                     std::min(centre + leakage + 1, bins)};
+  };
+  auto band = [&](size_t centre) {
+    double sum = 0.;
+    const auto [lo, hi] = bandBins(centre);
+    for (size_t i = lo; i < hi; ++i) {
+      sum += power[i];
+    }
+    return sum;
+  };
+  auto peakNear = [&](size_t centre) {
+    const auto [lo, hi] = bandBins(centre);
+    return static_cast<size_t>(
+        std::max_element(power.begin() + lo, power.begin() + hi) -
+        power.begin());
+  };
+
+  const auto peak = static_cast<size_t>(
+      std::max_element(power.begin() + leakage + 1, power.end()) -
+      power.begin());
+
+  // Centroid over the same bins as the fundamental's power
+  double weighted = 0.;
+  const double fundamental = band(peak);
+  const auto [lo, hi] = bandBins(peak);
+  for (size_t i = lo; i < hi; ++i) {
+    weighted += i * power[i];
+  }
+  const double peakBin = weighted / fundamental;
+  res.fundamental = peakBin * binWidth;
+
+  double harmonic = 0.;
+  for (size_t h = 2; h <= harmonics + 1; ++h) {
+    const auto centre = static_cast<size_t>(std::round(h * peakBin));
+    if (centre + leakage >= bins) {
+      break;
+    }
+    harmonic += band(peakNear(centre));
+  }
+
+  double total = 0.;
+  for (size_t i = leakage + 1; i < bins; ++i) {
+    total += power[i];
+  }
+  const double noise = std::max(total - fundamental - harmonic, 1e-300);
+  harmonic = std::max(harmonic, 1e-300);
+
+  res.thd = 10 * std::log10(harmonic / fundamental);
+  res.sinad = 10 * std::log10(fundamental / (noise + harmonic));
+  res.snr = 10 * std::log10(fundamental / noise);
+  return res;
+}
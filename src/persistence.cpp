@@ -0,0 +1,128 @@
+#include "persistence.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Hits are rescaled before their weight could lose float precision or
+// overflow the cells they add up in
+constexpr float RESCALE_WEIGHT = 0x1p40f;
+
+PersistenceSettings sanitize(PersistenceSettings settings) {
+  settings.length = std::max<size_t>(settings.length, 1);
+  settings.pretrigger = std::min(settings.pretrigger, settings.length - 1);
+  settings.rows = std::max<size_t>(settings.rows, 1);
+  return settings;
+}
+} // namespace
+
+Persistence::Persistence(const PersistenceSettings &settings,
+                         double sampleRate)
+    : settings(sanitize(settings)), sampleRate(sampleRate),
+      histogram((this->settings.rows + 1) * this->settings.length),
+      cells(this->settings.length) {}
+
+void Persistence::clear() {
+  std::fill(histogram.begin(), histogram.end(), 0.f);
+  pending.clear();
+  scan = 0;
+  armed = false;
+  position = 0;
+  base = 0;
+  sweeps = 0;
+}
+
+float Persistence::weight(uint64_t at) const {
+  if (settings.halfLife <= 0.) {
+    return 1.f;
+  }
+  return static_cast<float>(
+      std::exp2((at - base) / (settings.halfLife * sampleRate)));
+}
+
+void Persistence::accumulate(const float *sweep, uint64_t at) {
+  float w = weight(at);
+  if (w > RESCALE_WEIGHT) {
+    const float scale = 1.f / w;
+    float *h = histogram.data();
+    const size_t size = histogram.size();
+#pragma omp simd
+    for (size_t i = 0; i < size; ++i) {
+      h[i] *= scale;
+    }
+    base = at;
+    w = 1.f;
+  }
+
+  const auto n = static_cast<int32_t>(settings.length);
+  const auto rows = static_cast<int32_t>(settings.rows);
+  const auto rowsF = static_cast<float>(settings.rows);
+  const double span = settings.maxVolts - settings.minVolts;
+  const auto scale = static_cast<float>(settings.rows / span);
+  const auto offset = static_cast<float>(-settings.minVolts) * scale;
+  int32_t *c = cells.data();
+  // Every sample lands in its own column, out-of-range ones in the last
+  // row, so both loops are free of branches and of conflicting writes
+#pragma omp simd
+  for (int32_t j = 0; j < n; ++j) {
+    const float r = sweep[j] * scale + offset;
+    const bool inside = r >= 0.f && r < rowsF;
+    const int32_t row = inside ? rows - 1 - static_cast<int32_t>(r) : rows;
+    c[j] = row * n + j;
+  }
+  float *h = histogram.data();
+#pragma omp simd
+  for (int32_t j = 0; j < n; ++j) {
+    h[c[j]] += w;
+  }
+  ++sweeps;
+}
+
+size_t Persistence::push(std::span<const float> samples) {
+  pending.insert(pending.end(), samples.begin(), samples.end());
+  position += samples.size();
+  const uint64_t first = position - pending.size();
+
+  const size_t pre = settings.pretrigger;
+  const size_t post = settings.length - pre;
+  const auto level = static_cast<float>(settings.level);
+  const auto low = static_cast<float>(settings.level - settings.hysteresis);
+  size_t found = 0;
+  size_t i = scan;
+  // A crossing is only handled once the whole sweep around it is here
+  for (; i + post <= pending.size(); ++i) {
+    const float x = pending[i];
+    if (!armed) {
+      armed = x < low;
+    } else if (x >= level && i >= pre) {
+      accumulate(pending.data() + i - pre, first + i);
+      ++found;
+      armed = false;
+      // Held off until the sweep is over, so sweeps never overlap
+      i += post - 1;
+    }
+  }
+  scan = i;
+
+  // Only the samples before the next trigger that a sweep may reach back
+  // to are kept
+  const size_t keep = scan >= pre ? scan - pre : 0;
+  pending.erase(pending.begin(), pending.begin() + keep);
+  scan -= keep;
+  return found;
+}
+
+float Persistence::copyTo(std::vector<float> &out) const {
+  const size_t size = settings.rows * settings.length;
+  out.resize(size);
+  const float scale = 1.f / weight(position);
+  const float *h = histogram.data();
+  float *o = out.data();
+  float peak = 0.f;
+#pragma omp simd reduction(max : peak)
+  for (size_t i = 0; i < size; ++i) {
+    o[i] = h[i] * scale;
+    peak = std::max(peak, o[i]);
+  }
+  return peak;
+}
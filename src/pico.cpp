@@ -1,5 +1,7 @@
 #include "pico.hpp"
 #include "mpsc.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
 
 #include <algorithm>
 #include <cstdint>
@@ -14,20 +16,25 @@
 namespace {
 std::optional<mpsc::Send<StreamResult>> streamSender;
 enPS2000Range voltageRangeGlob = DEFAULT_VOLTAGE_RANGE;
+// Samples per channel sent since the stream was started
+uint64_t streamedSamples = 0;
 std::mutex globalLock;
 
 double toVolts(enPS2000Range range);
+SweepDirection toSweepDirection(PS2000_SWEEP_TYPE type);
 
 auto callback = [](int16_t **overviewBuffers, int16_t overflow,
                    uint32_t triggeredAt, int16_t triggered, int16_t auto_stop,
                    uint32_t nValues) {
+  const auto start = std::chrono::steady_clock::now();
+  ProfileScope profile{Stage::Callback, nValues};
   std::unique_lock temp{globalLock};
   if (!streamSender.has_value()) {
     return;
   }
-  auto f = ranges::views::transform([](const int16_t &e) -> double {
-    return (double)e / (double)PS2000_MAX_VALUE * toVolts(voltageRangeGlob);
-  });
+  const auto scale = adcStep(voltageRangeGlob);
+  auto f = ranges::views::transform(
+      [scale](const int16_t &e) -> Sample { return e * scale; });
   auto rangeA =
       ranges::make_subrange(overviewBuffers[0], overviewBuffers[0] + nValues) |
       f;
@@ -35,10 +42,24 @@ auto callback = [](int16_t **overviewBuffers, int16_t overflow,
       ranges::make_subrange(overviewBuffers[2], overviewBuffers[2] + nValues) |
       f;
 
-  streamSender.value().send(
-      StreamResult{rangeA | ranges::to_vector, rangeB | ranges::to_vector});
+  const uint64_t first = streamedSamples;
+  streamedSamples += nValues;
+  auto &trace = TraceRecorder::getInstance();
+  StreamResult block{.dataA = rangeA | ranges::to_vector,
+                     .dataB = rangeB | ranges::to_vector,
+                     .first = first};
+  if (streamSender.value().send(std::move(block))) {
+    Profiler::getInstance().addQueued(Queue::Stream, 1);
+    trace.flow("block", true, first);
+  }
+  trace.complete("callback", start, std::chrono::steady_clock::now(), first,
+                 nValues);
 };
 
+Sample adcStep(enPS2000Range range) {
+  return static_cast<Sample>(toVolts(range) / (double)PS2000_MAX_VALUE);
+}
+
 double toVolts(enPS2000Range range) {
   switch (range) {
   case PS2000_50MV:
@@ -63,6 +84,19 @@ double toVolts(enPS2000Range range) {
     return 0.;
   }
 }
+
+SweepDirection toSweepDirection(PS2000_SWEEP_TYPE type) {
+  switch (type) {
+  case PS2000_DOWN:
+    return SweepDirection::Down;
+  case PS2000_UPDOWN:
+    return SweepDirection::UpDown;
+  case PS2000_DOWNUP:
+    return SweepDirection::DownUp;
+  default:
+    return SweepDirection::Up;
+  }
+}
 } // namespace
 
 std::array<uint8_t, AWG_BUF_SIZE> getNoiseWaveform() {
@@ -79,7 +113,9 @@ Scope &Scope::getInstance() {
   return scope;
 }
 
-Scope::Scope() {}
+// The scheduler must outlive the scope, which stops its polling task on
+// destruction, so it is created first
+Scope::Scope() { Scheduler::getInstance(); }
 Scope::~Scope() {
   if (isStreaming()) {
     stopStream();
@@ -140,13 +176,18 @@ void Scope::setStreamingMode(bool dc) {
 }
 
 void Scope::restartStream(bool settingsChanged) {
-  std::unique_lock temp{globalLock};
-  if (!streamSender.has_value()) {
-    return;
+  {
+    std::unique_lock temp{globalLock};
+    if (!streamSender.has_value()) {
+      return;
+    }
   }
+  // Stopping waits for a poll in progress, whose callback takes globalLock
   if (streaming) {
     stopStream();
   }
+  std::unique_lock temp{globalLock};
+  TraceRecorder::getInstance().instant("restart stream", streamedSamples);
 
   if (settingsChanged) {
     ps2000_set_channel(handle, PS2000_CHANNEL_A, TRUE, dc, voltageRange);
@@ -158,13 +199,7 @@ void Scope::restartStream(bool settingsChanged) {
   ps2000_run_streaming_ns(handle, SAMPLE_INTERVAL, TIME_UNITS, SAMPLE_RATE * 10,
                           FALSE, 1, 1e6);
   streaming = true;
-  auto &streaming = this->streaming;
-  auto f = [handle = handle, &streaming]() mutable {
-    while (streaming) {
-      ps2000_get_streaming_last_values(handle, callback);
-    }
-  };
-  streamTask = std::thread{f};
+  startPolling();
 }
 
 std::optional<mpsc::Recv<StreamResult>> Scope::startStream() {
@@ -187,24 +222,27 @@ std::optional<mpsc::Recv<StreamResult>> Scope::startStream() {
     std::unique_lock temp{globalLock};
     voltageRangeGlob = voltageRange;
     streamSender.emplace(std::move(send));
+    streamedSamples = 0;
+    TraceRecorder::getInstance().instant("start stream");
   }
 
-  auto &streaming = this->streaming;
-  auto f = [handle = handle, &streaming]() mutable {
-    while (streaming) {
-      ps2000_get_streaming_last_values(handle, callback);
-    }
-  };
-
-  streamTask = std::thread{f};
+  startPolling();
 
   return {std::move(recv)};
 }
 
+void Scope::startPolling() {
+  streamTask = Scheduler::getInstance().every(
+      Priority::Acquisition, STREAM_POLL_INTERVAL, "stream",
+      [handle = handle] {
+        ps2000_get_streaming_last_values(handle, callback);
+      });
+}
+
 void Scope::stopStream() {
   if (streaming) {
     streaming = false;
-    streamTask.join();
+    streamTask.stop();
     ps2000_stop(handle);
   }
 }
@@ -247,16 +285,28 @@ bool Scope::startFreqSweep(double start, double end, double pkToPkV,
                                              PS2000_SINE, start, end, increment,
                                              DWELL_TIME, sweepType, sweeps);
 
+  // The stream is stopped, so the generator runs from the first sample it
+  // sends once restarted, or from that of the next stream started. Read
+  // before restarting, as the poll may stream blocks at once.
+  uint64_t firstSample = 0;
   if (restartStream) {
+    {
+      std::unique_lock temp{globalLock};
+      firstSample = streamedSamples;
+    }
     this->restartStream(false);
   }
   if (success) {
+    sweepSchedule = {start, end, increment, DWELL_TIME,
+                     toSweepDirection(sweepType), firstSample};
     generating = true;
     return true;
   }
   return false;
 }
 
+const SweepSchedule &Scope::getSweepSchedule() const { return sweepSchedule; }
+
 void Scope::stopSigGen() {
   bool restartStream = false;
   if (streaming) {
@@ -5,6 +5,15 @@
 #include <range/v3/all.hpp>
 
 using namespace std::numbers;
+
+// The FFTW planner is not thread safe, plan execution is. Never destroyed,
+// as plans owned by other statics are destroyed under it at exit in no
+// particular order.
+std::mutex &fftwPlannerLock() {
+  static auto &lock = *new std::mutex;
+  return lock;
+}
+
 double hann(size_t n, size_t N) {
   return 0.5 * (1 - std::cos(2 * pi * n / (N - 1)));
 }
@@ -17,3 +26,49 @@ double blackman(size_t n, size_t N) {
   return 0.42 - 0.5 * std::cos(2 * pi * n / (N - 1)) +
          0.08 * std::cos(4 * pi * n / (N - 1));
 }
+
+TransferFunction transferFunction(const CrossSpectrum &spectrum,
+                                  double sampleRate) {
+  const size_t bins = spectrum.sab.size();
+  TransferFunction res;
+  if (bins == 0 || spectrum.segments == 0) {
+    return res;
+  }
+  res.h1.resize(bins);
+  res.h2.resize(bins);
+  res.phase.resize(bins);
+  res.groupDelay.resize(bins);
+  res.coherence.resize(bins);
+  res.binWidth = sampleRate / spectrum.windowSize;
+  res.startFrequency = spectrum.startFrequency;
+
+  for (size_t i = 0; i < bins; ++i) {
+    const auto saa = spectrum.saa[i];
+    const auto sbb = spectrum.sbb[i];
+    const auto sab = spectrum.sab[i];
+    const auto crossPower = std::norm(sab);
+
+    // |H1|^2 = |Sab|^2 / Sbb^2, |H2|^2 = Saa^2 / |Sab|^2
+    res.h1[i] = 10 * std::log10(crossPower / (sbb * sbb));
+    res.h2[i] = 10 * std::log10(saa * saa / crossPower);
+    res.coherence[i] = saa * sbb > 0 ? crossPower / (saa * sbb) : 0.;
+    res.phase[i] = std::arg(sab);
+    if (i > 0) {
+      auto delta = res.phase[i] - res.phase[i - 1];
+      delta -= 2 * pi * std::round(delta / (2 * pi));
+      res.phase[i] = res.phase[i - 1] + delta;
+    }
+  }
+
+  if (bins > 1) {
+    const double dOmega = 2 * pi * sampleRate / spectrum.windowSize;
+    for (size_t i = 0; i < bins; ++i) {
+      const size_t lo = i == 0 ? 0 : i - 1;
+      const size_t hi = i == bins - 1 ? i : i + 1;
+      res.groupDelay[i] =
+          -(res.phase[hi] - res.phase[lo]) / ((hi - lo) * dOmega);
+    }
+  }
+
+  return res;
+}
@@ -0,0 +1,116 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr uint64_t ITEMS_MASK = (uint64_t{1} << 56) - 1;
+
+// Nearest-rank percentile in milliseconds of nanosecond durations, which
+// are reordered
+double percentile(std::vector<int64_t> &durations, double p) {
+  const size_t rank =
+      std::max<size_t>(std::ceil(p * durations.size()), 1) - 1;
+  std::nth_element(durations.begin(), durations.begin() + rank,
+                   durations.end());
+  return durations[rank] * 1e-6;
+}
+} // namespace
+
+const char *to_string(Stage stage) {
+  switch (stage) {
+  case Stage::Callback:
+    return "Callback";
+  case Stage::ChannelHop:
+    return "Channel hop";
+  case Stage::Ingest:
+    return "Ingest";
+  case Stage::Decimation:
+    return "Decimation";
+  case Stage::Welch:
+    return "Welch";
+  case Stage::Render:
+    return "Render";
+  }
+  return "";
+}
+
+const char *to_string(Queue queue) {
+  switch (queue) {
+  case Queue::Stream:
+    return "Stream";
+  case Queue::Spectrum:
+    return "Spectrum";
+  }
+  return "";
+}
+
+Profiler::Profiler() : epoch(Clock::now()) {}
+
+Profiler &Profiler::getInstance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+void Profiler::record(Stage stage, Clock::time_point start,
+                      Clock::time_point end, size_t items) {
+  rings.local().push([&](Event &event) {
+    event.end.store(nanoseconds(end - epoch), std::memory_order_relaxed);
+    event.duration.store(nanoseconds(end - start), std::memory_order_relaxed);
+    event.stageItems.store(static_cast<uint64_t>(stage) << 56 |
+                               std::min<uint64_t>(items, ITEMS_MASK),
+                           std::memory_order_relaxed);
+  });
+}
+
+size_t Profiler::queued(Queue queue) const {
+  return std::max<ptrdiff_t>(
+      depth[static_cast<size_t>(queue)].load(std::memory_order_relaxed), 0);
+}
+
+std::array<StageStats, STAGES>
+Profiler::stats(Clock::duration window) const {
+  const int64_t since = nanoseconds(Clock::now() - window - epoch);
+
+  struct Copy {
+    int64_t end;
+    int64_t duration;
+    uint64_t stageItems;
+  };
+  std::vector<Copy> copied;
+  std::array<std::vector<int64_t>, STAGES> durations;
+  std::array<uint64_t, STAGES> items{};
+  for (const auto &ring : rings.all()) {
+    copied.clear();
+    ring->copyTo(copied, [](const Event &event) {
+      return Copy{event.end.load(std::memory_order_relaxed),
+                  event.duration.load(std::memory_order_relaxed),
+                  event.stageItems.load(std::memory_order_relaxed)};
+    });
+    for (const auto &event : copied) {
+      const size_t stage = event.stageItems >> 56;
+      if (event.end < since || stage >= STAGES) {
+        continue;
+      }
+      durations[stage].push_back(event.duration);
+      items[stage] += event.stageItems & ITEMS_MASK;
+    }
+  }
+
+  const double seconds = std::chrono::duration<double>(window).count();
+  std::array<StageStats, STAGES> res;
+  for (size_t i = 0; i < STAGES; ++i) {
+    auto &d = durations[i];
+    if (d.empty()) {
+      continue;
+    }
+    auto &s = res[i];
+    s.count = d.size();
+    s.maxMs = *std::max_element(d.begin(), d.end()) * 1e-6;
+    s.p99Ms = percentile(d, 0.99);
+    s.p50Ms = percentile(d, 0.5);
+    s.perSecond = s.count / seconds;
+    s.itemsPerSecond = items[i] / seconds;
+  }
+  return res;
+}
@@ -0,0 +1,50 @@
+#include "resample.hpp"
+
+#include <cmath>
+#include <numbers>
+
+std::vector<double> lowpassKernel(size_t taps, double cutoff,
+                                  const WindowFunction &windowFn) {
+  using std::numbers::pi;
+  std::vector<double> res(taps);
+  const double centre = (taps - 1) / 2.;
+  for (size_t i = 0; i < taps; ++i) {
+    const double t = i - centre;
+    const double sinc =
+        t == 0. ? 2 * cutoff : std::sin(2 * pi * cutoff * t) / (pi * t);
+    res[i] = sinc * windowFn(i, taps);
+  }
+  const double sum = std::accumulate(res.begin(), res.end(), 0.);
+  for (auto &e : res) {
+    e /= sum;
+  }
+  return res;
+}
+
+std::vector<size_t> decimationStages(size_t factor) {
+  std::vector<size_t> primes;
+  for (size_t p = 2; factor > 1 && p * p <= factor; ++p) {
+    while (factor % p == 0) {
+      primes.push_back(p);
+      factor /= p;
+    }
+  }
+  if (factor > 1) {
+    primes.push_back(factor);
+  }
+
+  // Greedily merge the largest primes into stages of at most 8
+  std::sort(primes.rbegin(), primes.rend());
+  std::vector<size_t> res;
+  for (auto p : primes) {
+    auto stage = std::find_if(res.begin(), res.end(),
+                              [p](auto s) { return s * p <= 8; });
+    if (stage == res.end()) {
+      res.push_back(p);
+    } else {
+      *stage *= p;
+    }
+  }
+  std::sort(res.rbegin(), res.rend());
+  return res;
+}
@@ -0,0 +1,321 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <map>
+
+namespace {
+// Index of the pool worker running on this thread, if any
+thread_local Scheduler *currentScheduler = nullptr;
+thread_local size_t currentWorker = 0;
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+} // namespace
+
+struct PeriodicTask::State {
+  std::function<void()> fn;
+  std::atomic<bool> active = true;
+  std::mutex lock;
+  std::condition_variable idle;
+  bool scheduled = true;
+
+  void finish() {
+    std::unique_lock temp{lock};
+    scheduled = false;
+    idle.notify_all();
+  }
+};
+
+PeriodicTask::PeriodicTask(std::shared_ptr<State> state)
+    : state(std::move(state)) {}
+
+void PeriodicTask::stop() {
+  if (!state) {
+    return;
+  }
+  state->active = false;
+  std::unique_lock temp{state->lock};
+  state->idle.wait(temp, [this] { return !state->scheduled; });
+}
+
+bool PeriodicTask::active() const { return state && state->active; }
+
+Scheduler::Scheduler(size_t threads)
+    : parallelism(std::max<size_t>(threads, 1) + 1) {
+  threads = std::max<size_t>(threads, 1);
+  for (size_t i = 0; i < threads; ++i) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    pool.emplace_back([this, i] { workerLoop(i); });
+  }
+}
+
+Scheduler::~Scheduler() {
+  {
+    std::unique_lock temp{sleepLock};
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+}
+
+Scheduler &Scheduler::getInstance() {
+  // The thread calling parallelFor takes part, so one core is left for it
+  static Scheduler scheduler{
+      std::max(std::thread::hardware_concurrency(), 2u) - 1};
+  return scheduler;
+}
+
+void Scheduler::submit(Priority priority, const char *name, Task task) {
+  // Workers keep their own submissions local; other threads spread theirs
+  const size_t index = currentScheduler == this
+                           ? currentWorker
+                           : nextWorker++ % workers.size();
+  // Counted before it is visible so a worker never sees pending underflow
+  ++pending;
+  {
+    auto &worker = *workers[index];
+    std::unique_lock temp{worker.lock};
+    worker.queues[static_cast<size_t>(priority)].push_back(
+        {std::move(task), name});
+  }
+  std::unique_lock temp{sleepLock};
+  wake.notify_one();
+}
+
+void Scheduler::submitAfter(Priority priority, std::chrono::nanoseconds delay,
+                            const char *name, Task task) {
+  {
+    std::unique_lock temp{sleepLock};
+    timed.push({std::chrono::steady_clock::now() + delay, priority, name,
+                std::make_shared<Task>(std::move(task))});
+    // A sleeping worker may need to shorten its wait
+    wake.notify_one();
+  }
+}
+
+PeriodicTask Scheduler::every(Priority priority,
+                              std::chrono::nanoseconds period,
+                              const char *name, std::function<void()> fn) {
+  auto state = std::make_shared<PeriodicTask::State>();
+  state->fn = std::move(fn);
+
+  auto step = std::make_shared<std::function<void()>>();
+  *step = [this, state, priority, period, name,
+           weakStep = std::weak_ptr(step)]() {
+    if (state->active) {
+      state->fn();
+    }
+    auto next = weakStep.lock();
+    if (!state->active || !next) {
+      state->finish();
+      return;
+    }
+    submitAfter(priority, period, name, [next] { (*next)(); });
+  };
+  // The queued task owns the step; the step only refers to itself weakly
+  submit(priority, name, [step] { (*step)(); });
+  return PeriodicTask{state};
+}
+
+void Scheduler::parallelFor(Priority priority, const char *name, size_t n,
+                            size_t grain,
+                            const std::function<void(size_t, size_t)> &fn) {
+  if (n == 0) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  const size_t chunks = (n + grain - 1) / grain;
+
+  struct Group {
+    size_t n;
+    size_t grain;
+    size_t chunks;
+    const std::function<void(size_t, size_t)> *fn;
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> done = 0;
+    std::mutex lock;
+    std::condition_variable finished;
+
+    // Runs the next unclaimed chunk, if any is left. Claims that come after
+    // the last chunk return without touching fn, which lives only as long
+    // as the parallelFor call.
+    bool step() {
+      const size_t chunk = next++;
+      if (chunk >= chunks) {
+        return false;
+      }
+      (*fn)(chunk * grain, std::min(n, (chunk + 1) * grain));
+      if (++done == chunks) {
+        std::unique_lock temp{lock};
+        finished.notify_all();
+      }
+      return true;
+    }
+  };
+  auto group = std::make_shared<Group>(n, grain, chunks, &fn);
+
+  // A helper runs one chunk per task and queues itself again, so its worker
+  // goes back to promoting timed tasks and taking more urgent ones between
+  // chunks; a pass never holds every worker away from acquisition.
+  struct Helper {
+    Scheduler *scheduler;
+    Priority priority;
+    const char *name;
+    std::shared_ptr<Group> group;
+
+    void operator()() const {
+      if (group->step() && group->next < group->chunks) {
+        scheduler->submit(priority, name, *this);
+      }
+    }
+  };
+  const size_t helpers = std::min(chunks, getParallelism()) - 1;
+  for (size_t i = 0; i < helpers; ++i) {
+    submit(priority, name, Helper{this, priority, name, group});
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  while (group->step()) {
+  }
+  record(currentScheduler == this ? *workers[currentWorker] : external, name,
+         elapsedMs(start));
+
+  std::unique_lock temp{group->lock};
+  group->finished.wait(temp, [&] { return group->done == chunks; });
+}
+
+void Scheduler::setParallelism(size_t threads) {
+  parallelism = std::clamp<size_t>(threads, 1, workers.size() + 1);
+}
+
+std::vector<TaskStats> Scheduler::stats() const {
+  std::map<std::string, TaskStats> merged;
+  auto add = [&merged](const Worker &worker) {
+    std::unique_lock temp{worker.statsLock};
+    for (const auto &[key, stats] : worker.stats) {
+      auto &entry = merged[stats.name];
+      entry.name = stats.name;
+      entry.count += stats.count;
+      entry.totalMs += stats.totalMs;
+      entry.maxMs = std::max(entry.maxMs, stats.maxMs);
+    }
+  };
+  for (const auto &worker : workers) {
+    add(*worker);
+  }
+  add(external);
+
+  std::vector<TaskStats> res;
+  for (auto &[name, stats] : merged) {
+    res.push_back(std::move(stats));
+  }
+  return res;
+}
+
+void Scheduler::resetStats() {
+  for (auto &worker : workers) {
+    std::unique_lock temp{worker->statsLock};
+    worker->stats.clear();
+  }
+  std::unique_lock temp{external.statsLock};
+  external.stats.clear();
+}
+
+void Scheduler::record(Worker &worker, const char *name, double ms) {
+  std::unique_lock temp{worker.statsLock};
+  auto &stats = worker.stats[name];
+  if (stats.count == 0) {
+    stats.name = name;
+  }
+  ++stats.count;
+  stats.totalMs += ms;
+  stats.maxMs = std::max(stats.maxMs, ms);
+}
+
+bool Scheduler::findTask(size_t index, Entry &entry) {
+  for (size_t priority = 0; priority < PRIORITIES; ++priority) {
+    {
+      auto &own = *workers[index];
+      std::unique_lock temp{own.lock};
+      auto &queue = own.queues[priority];
+      if (!queue.empty()) {
+        entry = std::move(queue.back());
+        queue.pop_back();
+        --pending;
+        return true;
+      }
+    }
+    for (size_t offset = 1; offset < workers.size(); ++offset) {
+      auto &victim = *workers[(index + offset) % workers.size()];
+      std::unique_lock temp{victim.lock};
+      auto &queue = victim.queues[priority];
+      if (!queue.empty()) {
+        entry = std::move(queue.front());
+        queue.pop_front();
+        --pending;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Moves due timed tasks onto the queues. Returns whether any moved.
+bool Scheduler::promoteTimed() {
+  std::vector<Timed> due;
+  {
+    std::unique_lock temp{sleepLock};
+    const auto now = std::chrono::steady_clock::now();
+    while (!timed.empty() && timed.top().due <= now) {
+      due.push_back(timed.top());
+      timed.pop();
+    }
+  }
+  for (auto &e : due) {
+    submit(e.priority, e.name, [task = std::move(e.task)] { (*task)(); });
+  }
+  return !due.empty();
+}
+
+void Scheduler::run(Worker &worker, Entry &entry) {
+  const auto start = std::chrono::steady_clock::now();
+  entry.task();
+  record(worker, entry.name, elapsedMs(start));
+}
+
+void Scheduler::workerLoop(size_t index) {
+  currentScheduler = this;
+  currentWorker = index;
+  Entry entry;
+  while (true) {
+    promoteTimed();
+    if (findTask(index, entry)) {
+      run(*workers[index], entry);
+      entry = {};
+      continue;
+    }
+
+    std::unique_lock temp{sleepLock};
+    if (stopping) {
+      return;
+    }
+    if (pending > 0) {
+      continue;
+    }
+    // Submissions and new timed tasks notify under this lock, so checking
+    // and waiting cannot miss them
+    if (timed.empty()) {
+      wake.wait(temp);
+    } else {
+      const auto due = timed.top().due;
+      wake.wait_until(temp, due);
+    }
+  }
+}
@@ -0,0 +1,93 @@
+#include "spectrogram.hpp"
+
+#include <cmath>
+#include <numeric>
+
+Spectrogram::Spectrogram(size_t windowSize, size_t hop, double sampleRate,
+                         size_t history, const WindowFunction &windowFn)
+    : windowSize(windowSize), hop(std::max<size_t>(hop, 1)),
+      capacity(std::max<size_t>(history, 1)), sampleRate(sampleRate),
+      window(windowCoefficients<float>(windowFn, windowSize)),
+      buffer(windowSize), history(capacity * bins()) {
+  // Scale so a full-scale sine reads its amplitude regardless of window
+  gain = 2. / std::accumulate(window.begin(), window.end(), 0.);
+  realFft<float>(windowSize);
+}
+
+void Spectrogram::clear() {
+  pending.clear();
+  head = 0;
+  filled = 0;
+  produced = 0;
+}
+
+double Spectrogram::columnTime(uint64_t column) const {
+  return (column * hop + windowSize / 2.) / sampleRate;
+}
+
+void Spectrogram::computeColumn(const float *samples) {
+  float *in = buffer.real.get();
+  for (size_t i = 0; i < windowSize; ++i) {
+    in[i] = window[i] * samples[i];
+  }
+  realFft<float>(windowSize).execute(buffer);
+
+  const size_t n = bins();
+  const float *out = buffer.complex.get()[0];
+  float *column = history.data() + head * n;
+  for (size_t k = 0; k < n; ++k) {
+    const float re = out[2 * k], im = out[2 * k + 1];
+    const float power = (re * re + im * im) * gain * gain;
+    column[n - 1 - k] = 10.f * std::log10(power + 1e-30f);
+  }
+
+  head = (head + 1) % capacity;
+  filled = std::min(filled + 1, capacity);
+  ++produced;
+}
+
+size_t Spectrogram::push(std::span<const float> samples) {
+  const size_t available = pending.size() + samples.size();
+  if (available < windowSize) {
+    pending.insert(pending.end(), samples.begin(), samples.end());
+    return 0;
+  }
+
+  // Columns that would be overwritten before anyone sees them are skipped,
+  // keeping the cost of a large block bounded by the history size.
+  const size_t possible = (available - windowSize) / hop + 1;
+  size_t skip = 0;
+  if (possible > capacity) {
+    const size_t skippedColumns = possible - capacity;
+    skip = skippedColumns * hop;
+    produced += skippedColumns;
+  }
+
+  if (skip >= pending.size()) {
+    samples = samples.subspan(skip - pending.size());
+    pending.clear();
+  } else {
+    pending.erase(pending.begin(), pending.begin() + skip);
+  }
+  pending.insert(pending.end(), samples.begin(), samples.end());
+
+  size_t start = 0;
+  size_t count = 0;
+  for (; start + windowSize <= pending.size(); start += hop) {
+    computeColumn(pending.data() + start);
+    ++count;
+  }
+  pending.erase(pending.begin(), pending.begin() + start);
+  return count;
+}
+
+std::array<Spectrogram::Block, 2> Spectrogram::blocks() const {
+  const size_t n = bins();
+  const uint64_t first = produced - filled;
+  if (filled < capacity) {
+    return {Block{history.data(), filled, first},
+            Block{history.data(), 0, produced}};
+  }
+  return {Block{history.data() + head * n, capacity - head, first},
+          Block{history.data(), head, first + capacity - head}};
+}
@@ -0,0 +1,343 @@
+#include "store.hpp"
+
+#include <chrono>
+#include <mutex>
+
+#ifndef _WIN32
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr size_t CHUNK_BYTES = STORE_CHUNK * sizeof(float);
+
+size_t packedBytes(size_t words) { return words * sizeof(uint32_t); }
+} // namespace
+
+// Backing file for spilled chunks, one chunk-sized slot each, of which
+// packed chunks only write and read their packed size. The file is
+// unlinked as soon as it is created, so it never outlives the process.
+// Mappings hold the file alive, which lets snapshots outlive the store.
+class SpillFile : public std::enable_shared_from_this<SpillFile> {
+  int fd = -1;
+  std::mutex lock;
+  std::vector<size_t> freeSlots;
+  size_t slots = 0;
+  // Bytes written to slots in use
+  size_t used = 0;
+
+  void release(size_t slot, size_t size) {
+    std::unique_lock temp{lock};
+    freeSlots.push_back(slot);
+    used -= size;
+  }
+
+public:
+  explicit SpillFile(const std::filesystem::path &directory) {
+#ifndef _WIN32
+    auto name = (directory / "picoscope-spill-XXXXXX").string();
+    fd = mkstemp(name.data());
+    if (fd >= 0) {
+      unlink(name.c_str());
+    }
+#endif
+  }
+
+  ~SpillFile() {
+#ifndef _WIN32
+    if (fd >= 0) {
+      close(fd);
+    }
+#endif
+  }
+
+  SpillFile(const SpillFile &other) = delete;
+
+  size_t bytes() {
+    std::unique_lock temp{lock};
+    return used;
+  }
+
+  // Copies up to one chunk's bytes to disk and maps them back, or returns
+  // nullptr
+  std::shared_ptr<std::byte[]> write(const void *data, size_t size) {
+#ifdef _WIN32
+    return nullptr;
+#else
+    if (fd < 0) {
+      return nullptr;
+    }
+    size_t slot;
+    {
+      std::unique_lock temp{lock};
+      if (freeSlots.empty()) {
+        if (ftruncate(fd, (slots + 1) * CHUNK_BYTES) != 0) {
+          return nullptr;
+        }
+        freeSlots.push_back(slots++);
+      }
+      slot = freeSlots.back();
+      freeSlots.pop_back();
+      used += size;
+    }
+
+    const auto *bytes = static_cast<const char *>(data);
+    const off_t offset = slot * CHUNK_BYTES;
+    for (size_t done = 0; done < size;) {
+      const auto n = pwrite(fd, bytes + done, size - done, offset + done);
+      if (n <= 0) {
+        release(slot, size);
+        return nullptr;
+      }
+      done += n;
+    }
+    void *mapped =
+        mmap(nullptr, CHUNK_BYTES, PROT_READ, MAP_SHARED, fd, offset);
+    if (mapped == MAP_FAILED) {
+      release(slot, size);
+      return nullptr;
+    }
+    return std::shared_ptr<std::byte[]>(
+        static_cast<std::byte *>(mapped),
+        [self = shared_from_this(), slot, size](std::byte *p) {
+          munmap(p, CHUNK_BYTES);
+          self->release(slot, size);
+        });
+#endif
+  }
+};
+
+void SampleSnapshot::copyTo(std::vector<float> &out) const {
+  out.resize(count);
+  size_t at = 0;
+  size_t from = offset;
+  for (const auto &piece : chunks) {
+    const size_t n = std::min(STORE_CHUNK - from, count - at);
+    if (piece.samples) {
+      std::copy_n(piece.samples.get() + from, n, out.data() + at);
+    } else {
+      unpackSamples(piece.packed.get(), from, {out.data() + at, n});
+    }
+    at += n;
+    from = 0;
+  }
+}
+
+SampleStore::SampleStore(size_t retention, size_t memoryLimit)
+    : retention(std::max<size_t>(retention, 1)), memoryLimit(memoryLimit) {
+  std::error_code error;
+  spillDirectory = std::filesystem::temp_directory_path(error);
+}
+
+void SampleStore::append(std::span<const float> samples) {
+  while (!samples.empty()) {
+    const size_t used = last - base;
+    if (used == chunks.size() * STORE_CHUNK) {
+      if (!chunks.empty()) {
+        seal(chunks.back());
+      }
+      Chunk chunk;
+      chunk.samples = spare ? std::move(spare)
+                            : std::make_shared_for_overwrite<float[]>(
+                                  STORE_CHUNK);
+      chunks.push_back(std::move(chunk));
+      heapBytes += CHUNK_BYTES;
+    }
+    const size_t offset = used % STORE_CHUNK;
+    const size_t n = std::min(STORE_CHUNK - offset, samples.size());
+    std::copy_n(samples.data(), n, chunks.back().samples.get() + offset);
+    last += n;
+    samples = samples.subspan(n);
+  }
+  trim();
+  spillCold();
+}
+
+void SampleStore::clear(size_t start) {
+  chunks.clear();
+  unpackedCache = {};
+  spilledCount = 0;
+  heapBytes = 0;
+  base = first = last = start;
+  counters = {};
+  coldReads = 0;
+  unpackedSamples = 0;
+  unpackSeconds = 0.;
+  // Slots still mapped by snapshots keep the old file alive
+  spill.reset();
+}
+
+void SampleStore::setRetention(size_t samples) {
+  retention = std::max<size_t>(samples, 1);
+  trim();
+}
+
+void SampleStore::setMemoryLimit(size_t bytes) {
+  memoryLimit = bytes;
+  spillCold();
+}
+
+void SampleStore::setSpillDirectory(std::filesystem::path directory) {
+  spillDirectory = std::move(directory);
+}
+
+StoreStats SampleStore::stats() const {
+  auto res = counters;
+  res.memoryBytes = heapBytes + (spare ? CHUNK_BYTES : 0);
+  for (const auto &entry : unpackedCache) {
+    res.memoryBytes += entry.samples ? CHUNK_BYTES : 0;
+  }
+  res.diskBytes = spill ? spill->bytes() : 0;
+  res.coldReads = coldReads;
+  res.unpackedSamples = unpackedSamples;
+  res.unpackSeconds = unpackSeconds;
+  return res;
+}
+
+void SampleStore::seal(Chunk &chunk) {
+  if (quantum <= 0.f ||
+      !packSamples({chunk.samples.get(), STORE_CHUNK}, quantum, packBuffer)) {
+    return;
+  }
+  auto packed = std::make_shared_for_overwrite<uint32_t[]>(packBuffer.size());
+  std::copy(packBuffer.begin(), packBuffer.end(), packed.get());
+  chunk.packed = std::move(packed);
+  chunk.packedWords = packBuffer.size();
+  heapBytes += packedBytes(chunk.packedWords);
+  heapBytes -= CHUNK_BYTES;
+  ++counters.packedChunks;
+  counters.packedBytes += packedBytes(chunk.packedWords);
+  // The raw buffer is filled again right away unless a snapshot holds it
+  if (chunk.samples.use_count() == 1) {
+    spare = std::move(chunk.samples);
+  }
+  chunk.samples.reset();
+}
+
+auto SampleStore::findUnpacked(size_t start) const -> UnpackedCache::iterator {
+  return std::find_if(unpackedCache.begin(), unpackedCache.end(),
+                      [start](const auto &entry) {
+                        return entry.samples && entry.first == start;
+                      });
+}
+
+std::shared_ptr<const float[]> SampleStore::chunkSamples(size_t chunk) const {
+  const auto &c = chunks[chunk];
+  if (c.samples) {
+    return c.samples;
+  }
+  auto hit = findUnpacked(base + chunk * STORE_CHUNK);
+  if (hit == unpackedCache.end()) {
+    // Replaces the least recently used entry
+    hit = unpackedCache.end() - 1;
+    const auto begin = std::chrono::steady_clock::now();
+    auto samples = std::make_shared_for_overwrite<float[]>(STORE_CHUNK);
+    unpackSamples(c.packed.get(), 0, {samples.get(), STORE_CHUNK});
+    unpackSeconds += std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+    unpackedSamples += STORE_CHUNK;
+    *hit = {base + chunk * STORE_CHUNK, std::move(samples)};
+  }
+  std::rotate(unpackedCache.begin(), hit, hit + 1);
+  return unpackedCache.front().samples;
+}
+
+void SampleStore::trim() {
+  // Only whole chunks go, and only while enough samples remain without them
+  while (chunks.size() > 1 && last - (base + STORE_CHUNK) >= retention) {
+    auto &front = chunks.front();
+    if (front.packed) {
+      --counters.packedChunks;
+      counters.packedBytes -= packedBytes(front.packedWords);
+    }
+    if (front.spilled) {
+      --spilledCount;
+    } else {
+      heapBytes -= front.packed ? packedBytes(front.packedWords) : CHUNK_BYTES;
+      if (front.samples.use_count() == 1) {
+        // Only this thread takes snapshots, so a count of one cannot rise
+        spare = std::move(front.samples);
+      }
+    }
+    chunks.pop_front();
+    base += STORE_CHUNK;
+    first = std::max(first, base);
+  }
+}
+
+void SampleStore::spillCold() {
+  // The chunk being appended to always stays on the heap
+  while (!counters.spillFailed && spilledCount + 1 < chunks.size() &&
+         heapBytes > memoryLimit) {
+    if (!spill) {
+      spill = std::make_shared<SpillFile>(spillDirectory);
+    }
+    auto &chunk = chunks[spilledCount];
+    // Packed chunks are spilled packed
+    const size_t size =
+        chunk.packed ? packedBytes(chunk.packedWords) : CHUNK_BYTES;
+    auto mapped = chunk.packed
+                      ? spill->write(chunk.packed.get(), size)
+                      : spill->write(chunk.samples.get(), size);
+    if (!mapped) {
+      // Keep everything in RAM rather than lose history
+      counters.spillFailed = true;
+      break;
+    }
+    if (chunk.packed) {
+      chunk.packed = std::shared_ptr<const uint32_t[]>(
+          mapped, reinterpret_cast<const uint32_t *>(mapped.get()));
+    } else {
+      chunk.samples = std::shared_ptr<float[]>(
+          mapped, reinterpret_cast<float *>(mapped.get()));
+    }
+    chunk.spilled = true;
+    heapBytes -= size;
+    ++spilledCount;
+    ++counters.spilledChunks;
+  }
+  // A spare chunk would only count against the limit
+  if (spilledCount > 0) {
+    spare.reset();
+  }
+}
+
+SampleSnapshot SampleStore::snapshot(size_t from, size_t to) const {
+  SampleSnapshot res;
+  from = std::max(from, first);
+  to = std::min(to, last);
+  if (from >= to) {
+    return res;
+  }
+  res.first = from;
+  res.count = to - from;
+  res.offset = (from - base) % STORE_CHUNK;
+  const size_t firstChunk = (from - base) / STORE_CHUNK;
+  const size_t lastChunk = (to - 1 - base) / STORE_CHUNK;
+  for (size_t i = firstChunk; i <= lastChunk; ++i) {
+    const auto &chunk = chunks[i];
+    const auto cached = findUnpacked(base + i * STORE_CHUNK);
+    if (chunk.samples) {
+      res.chunks.push_back({chunk.samples, nullptr});
+    } else if (cached != unpackedCache.end()) {
+      res.chunks.push_back({cached->samples, nullptr});
+      continue;
+    } else {
+      res.chunks.push_back({nullptr, chunk.packed});
+    }
+    if (chunk.spilled) {
+      ++coldReads;
+#ifndef _WIN32
+      // The reader is about to touch all of it; start paging in now
+      const void *data = chunk.packed
+                             ? static_cast<const void *>(chunk.packed.get())
+                             : chunk.samples.get();
+      madvise(const_cast<void *>(data), CHUNK_BYTES, MADV_WILLNEED);
+#endif
+    }
+  }
+  return res;
+}
@@ -0,0 +1,123 @@
+#include "sweep.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+using std::numbers::pi;
+
+size_t SweepSchedule::steps() const {
+  if (increment <= 0.) {
+    return 1;
+  }
+  return static_cast<size_t>(std::floor((end - start) / increment + 1e-9)) + 1;
+}
+
+size_t SweepSchedule::stepAt(uint64_t dwell) const {
+  const size_t n = steps();
+  const uint64_t position = dwell % (2 * n);
+  switch (direction) {
+  case SweepDirection::Up:
+    return dwell % n;
+  case SweepDirection::Down:
+    return n - 1 - dwell % n;
+  case SweepDirection::UpDown:
+    return position < n ? position : 2 * n - 1 - position;
+  case SweepDirection::DownUp:
+    return position < n ? n - 1 - position : position - n;
+  }
+  return 0;
+}
+
+std::complex<double> goertzel(std::span<const float> samples,
+                              double frequency,
+                              std::span<const float> window) {
+  const double omega = 2 * pi * frequency;
+  const double coeff = 2 * std::cos(omega);
+  double s1 = 0., s2 = 0.;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const double s = window[i] * samples[i] + coeff * s1 - s2;
+    s2 = s1;
+    s1 = s;
+  }
+  return std::complex<double>{s1 - s2 * std::cos(omega), s2 * std::sin(omega)};
+}
+
+SweepTracker::SweepTracker(const SweepSchedule &schedule, double sampleRate,
+                           double guard)
+    : schedule(schedule), sampleRate(sampleRate), guard(guard) {
+  clear();
+}
+
+void SweepTracker::clear() {
+  bode.clear();
+  for (size_t i = 0; i < schedule.steps(); ++i) {
+    bode.push_back({schedule.frequency(i),
+                    std::numeric_limits<double>::quiet_NaN(),
+                    std::numeric_limits<double>::quiet_NaN()});
+  }
+  bufferA.clear();
+  bufferB.clear();
+  sample = 0;
+  dwell = 0;
+}
+
+double SweepTracker::dwellStart(uint64_t index) const {
+  return index * schedule.dwell * sampleRate;
+}
+
+double SweepTracker::currentFrequency() const {
+  return schedule.frequency(schedule.stepAt(dwell));
+}
+
+void SweepTracker::finishDwell() {
+  const size_t n = bufferA.size();
+  if (n > 0) {
+    if (window.size() != n) {
+      window.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        window[i] = 0.5 * (1 - std::cos(2 * pi * i / n));
+      }
+    }
+    auto &point = bode[schedule.stepAt(dwell)];
+    const double f = point.frequency / sampleRate;
+    const auto ratio = goertzel(bufferA, f, window) /
+                       goertzel(bufferB, f, window);
+    point.magnitude = 20 * std::log10(std::abs(ratio));
+    point.phase = std::arg(ratio) * 180 / pi;
+  }
+  bufferA.clear();
+  bufferB.clear();
+  ++dwell;
+}
+
+void SweepTracker::push(std::span<const float> a, std::span<const float> b,
+                        uint64_t first) {
+  const size_t n = std::min(a.size(), b.size());
+  // Samples from before the generator started belong to no dwell
+  size_t i = std::min<uint64_t>(
+      n, schedule.firstSample - std::min(first, schedule.firstSample));
+  while (i < n) {
+    const auto start = dwellStart(dwell);
+    const auto end = static_cast<uint64_t>(std::round(dwellStart(dwell + 1)));
+    const auto settled = static_cast<uint64_t>(
+        std::round(start + guard * (dwellStart(dwell + 1) - start)));
+
+    const size_t take = std::min<uint64_t>(n - i, end - sample);
+    // Only the settled part of the dwell is demodulated
+    const uint64_t from = std::max(sample, settled);
+    if (from < sample + take) {
+      const size_t offset = from - sample;
+      bufferA.insert(bufferA.end(), a.begin() + i + offset,
+                     a.begin() + i + take);
+      bufferB.insert(bufferB.end(), b.begin() + i + offset,
+                     b.begin() + i + take);
+    }
+    sample += take;
+    i += take;
+    if (sample >= end) {
+      finishDwell();
+    }
+  }
+}
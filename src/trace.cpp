@@ -0,0 +1,196 @@
+#include "trace.hpp"
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+namespace {
+// One event copied out of a ring
+struct Record {
+  int64_t time;
+  int64_t duration;
+  const char *name;
+  uint64_t first;
+  uint64_t count;
+  char phase;
+  size_t tid;
+};
+
+struct Thread {
+  size_t tid;
+  std::string name;
+};
+} // namespace
+
+// Events and the threads that recorded them
+struct TraceRecorder::Copy {
+  std::vector<Record> records;
+  std::vector<Thread> threads;
+};
+
+namespace {
+// Writes the events in time order
+bool writeJson(const std::filesystem::path &path,
+               TraceRecorder::Copy events) {
+  std::sort(events.records.begin(), events.records.end(),
+            [](const auto &a, const auto &b) { return a.time < b.time; });
+  auto *file = std::fopen(path.string().c_str(), "w");
+  if (!file) {
+    return false;
+  }
+  std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+  bool comma = false;
+  for (const auto &thread : events.threads) {
+    std::fprintf(file,
+                 "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                 "\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                 comma ? ",\n" : "", thread.tid, thread.name.c_str());
+    comma = true;
+  }
+  for (const auto &r : events.records) {
+    // Timestamps are in microseconds
+    std::fprintf(file,
+                 "%s{\"ph\":\"%c\",\"name\":\"%s\",\"cat\":\"pipeline\","
+                 "\"pid\":1,\"tid\":%zu,\"ts\":%.3f",
+                 comma ? ",\n" : "", r.phase, r.name, r.tid, r.time * 1e-3);
+    comma = true;
+    switch (static_cast<TracePhase>(r.phase)) {
+    case TracePhase::Complete:
+      std::fprintf(file, ",\"dur\":%.3f", r.duration * 1e-3);
+      break;
+    case TracePhase::Instant:
+      std::fputs(",\"s\":\"t\"", file);
+      break;
+    case TracePhase::FlowStart:
+      std::fprintf(file, ",\"id\":%" PRIu64 "}", r.first);
+      continue;
+    case TracePhase::FlowEnd:
+      std::fprintf(file, ",\"id\":%" PRIu64 ",\"bp\":\"e\"}", r.first);
+      continue;
+    }
+    std::fprintf(file,
+                 ",\"args\":{\"first\":%" PRIu64 ",\"count\":%" PRIu64 "}}",
+                 r.first, r.count);
+  }
+  std::fputs("\n]}\n", file);
+  return std::fclose(file) == 0;
+}
+} // namespace
+
+TraceRecorder::TraceRecorder() : epoch(Clock::now()) {}
+
+TraceRecorder &TraceRecorder::getInstance() {
+  static TraceRecorder recorder;
+  return recorder;
+}
+
+void TraceRecorder::add(TracePhase phase, const char *name,
+                        Clock::time_point time, Clock::duration duration,
+                        uint64_t first, uint64_t count) {
+  rings.local().push([&](Event &event) {
+    event.time.store(nanoseconds(time - epoch), std::memory_order_relaxed);
+    event.duration.store(nanoseconds(duration), std::memory_order_relaxed);
+    event.name.store(name, std::memory_order_relaxed);
+    event.first.store(first, std::memory_order_relaxed);
+    event.count.store(count, std::memory_order_relaxed);
+    event.phase.store(static_cast<char>(phase), std::memory_order_relaxed);
+  });
+}
+
+void TraceRecorder::nameThread(std::string name) {
+  auto &ring = rings.local();
+  std::unique_lock temp{lock};
+  ring.name = std::move(name);
+}
+
+void TraceRecorder::frame(Clock::time_point start, Clock::time_point end) {
+  if (!recording()) {
+    return;
+  }
+  add(TracePhase::Complete, "frame", start, end - start, 0, 0);
+
+  std::filesystem::path path;
+  {
+    std::unique_lock temp{lock};
+    if (stallThreshold.count() == 0 || end - start < stallThreshold ||
+        (stallDump != std::filesystem::path{} &&
+         end - lastDump < TRACE_DUMP_INTERVAL)) {
+      return;
+    }
+    lastDump = end;
+    const auto stamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    path = stallDirectory /
+           ("stall-" + std::to_string(stamp.count()) + ".json");
+    stallDump = path;
+  }
+
+  // Copying the rings is quick; sorting, formatting and writing them is
+  // left to a background task so the stall is not made longer
+  Scheduler::getInstance().submit(
+      Priority::Background, "trace dump",
+      [path, events = copy()]() mutable {
+        writeJson(path, std::move(events));
+      });
+}
+
+auto TraceRecorder::copy() const -> Copy {
+  Copy res;
+  const auto current = rings.all();
+  {
+    std::unique_lock temp{lock};
+    // Threads are numbered in the order they first recorded
+    for (size_t i = 0; i < current.size(); ++i) {
+      const auto &name = current[i]->name;
+      res.threads.push_back(
+          {i + 1, name.empty() ? "thread " + std::to_string(i + 1) : name});
+    }
+  }
+  for (size_t i = 0; i < current.size(); ++i) {
+    const size_t tid = i + 1;
+    current[i]->copyTo(res.records, [tid](const Event &e) {
+      return Record{e.time.load(std::memory_order_relaxed),
+                    e.duration.load(std::memory_order_relaxed),
+                    e.name.load(std::memory_order_relaxed),
+                    e.first.load(std::memory_order_relaxed),
+                    e.count.load(std::memory_order_relaxed),
+                    e.phase.load(std::memory_order_relaxed), tid};
+    });
+  }
+  return res;
+}
+
+bool TraceRecorder::write(const std::filesystem::path &path) const {
+  return writeJson(path, copy());
+}
+
+std::future<bool>
+TraceRecorder::writeLater(std::filesystem::path path) const {
+  std::promise<bool> written;
+  auto res = written.get_future();
+  Scheduler::getInstance().submit(
+      Priority::Background, "trace write",
+      [path = std::move(path), events = copy(),
+       written = std::move(written)]() mutable {
+        written.set_value(writeJson(path, std::move(events)));
+      });
+  return res;
+}
+
+void TraceRecorder::setStallDump(std::chrono::milliseconds threshold,
+                                 std::filesystem::path directory) {
+  std::unique_lock temp{lock};
+  stallThreshold = threshold;
+  stallDirectory = std::move(directory);
+}
+
+std::chrono::milliseconds TraceRecorder::getStallThreshold() const {
+  std::unique_lock temp{lock};
+  return stallThreshold;
+}
+
+std::filesystem::path TraceRecorder::lastStallDump() const {
+  std::unique_lock temp{lock};
+  return stallDump;
+}
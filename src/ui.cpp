@@ -1,11 +1,16 @@
 #include "ui.hpp"
 #include "pico.hpp"
 #include "processing.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
 
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
+#include <filesystem>
 #include <format>
+#include <future>
 #include <imgui.h>
 #include <implot.h>
 #include <iostream>
@@ -13,6 +18,7 @@
 #include <numbers>
 #include <range/v3/all.hpp>
 #include <ranges>
+#include <stop_token>
 #include <thread>
 
 namespace sr = std::ranges;
@@ -20,13 +26,49 @@ namespace sv = std::views;
 namespace rv = ranges::views;
 
 namespace {
-constexpr size_t PLOT_SAMPLES = 10000;
+constexpr std::chrono::milliseconds PROFILER_REFRESH{250};
 constexpr std::array SUPPORTED_RANGES = {
     PS2000_1V,   PS2000_2V,    PS2000_5V,    PS2000_10V,  PS2000_20V,
     PS2000_50MV, PS2000_100MV, PS2000_200MV, PS2000_500MV};
 constexpr std::array SUPPORTED_TIMEBASES = {TimeBase::S, TimeBase::MS,
                                             TimeBase::US};
 constexpr std::array SUPPORTED_SIGNALS = {SigGen::FreqSweep, SigGen::Noise};
+// Fraction of full scale a signal must swing below zero to arm the next
+// rising zero crossing
+constexpr double CROSSING_HYSTERESIS = 0.02;
+constexpr std::array SUPPORTED_FILTERS = {
+    FilterType::LowPass, FilterType::HighPass,   FilterType::BandPass,
+    FilterType::Notch,   FilterType::FirLowPass, FilterType::DcBlock};
+constexpr std::array<size_t, 8> SUPPORTED_DECIMATIONS = {1,  2,  4,  5,
+                                                         10, 20, 50, 100};
+constexpr std::array<size_t, 5> SUPPORTED_PERSISTENCE_LENGTHS = {
+    128, 256, 512, 1024, 2048};
+constexpr std::array SUPPORTED_WEIGHTINGS = {CorrelationWeighting::None,
+                                            CorrelationWeighting::Phat};
+constexpr std::array SUPPORTED_AVERAGING = {
+    AveragingMode::None, AveragingMode::Linear, AveragingMode::Exponential,
+    AveragingMode::PeakHold, AveragingMode::MinHold};
+// Delay search range either side of zero, in samples
+constexpr size_t CORRELATION_MAX_LAG = 1 << 14;
+
+// Output of one spectrum job. Previews are partial averages sent while the
+// job refines; the generation identifies the view and settings behind it.
+struct SpectrumResult {
+  uint64_t generation = 0;
+  bool preview = false;
+  TransferFunction transfer;
+  SpectralMetrics spectralA;
+  SpectralMetrics spectralB;
+  DelayEstimate delay;
+  // Built by the job, so the UI only reduces them to pixels: the H1 of a
+  // preview, or the average with a complete spectrum added
+  PeakPyramid spectrumPeaks;
+  PeakPyramid coherencePeaks;
+  // Complete results only: the average after adding the spectrum, and the
+  // bins it is over
+  SpectrumAverager average;
+  std::pair<double, double> averagedBins;
+};
 
 std::string to_string(TimeBase tb);
 std::string to_string(enPS2000Range range);
@@ -39,6 +81,13 @@ void drawSplitter(bool vertical, float thickness, float *size0, float *size1,
 void drawSweepSettings(FreqSweepSettings &settings);
 void drawSigGenControls(ScopeSettings &settings, Scope &scope);
 void drawSpectrumControls(ScopeSettings &settings);
+bool drawFilterChain(std::vector<FilterSpec> &specs,
+                     const std::vector<FilterStats> &stats);
+void drawFilterControls(ScopeSettings &settings);
+void drawMeasurements(ScopeSettings &settings);
+void drawTaskStats();
+void drawTraceControls();
+void drawPersistenceControls(ScopeSettings &settings);
 void drawScopeControls(ScopeSettings &settings, Scope &scope);
 void drawControls(ScopeSettings &settings, Scope &scope);
 
@@ -198,14 +247,16 @@ void drawScopeControls(ScopeSettings &settings, Scope &scope) {
   auto toggled = ImGui::Checkbox("Run", &settings.run);
 
   if (toggled && settings.run) {
-    settings.recv = scope.startStream();
-    if (!settings.recv.has_value())
+    auto recv = scope.startStream();
+    if (recv.has_value())
+      settings.ingest.attach(std::move(*recv));
+    else
       settings.run = false;
   }
 
   if (toggled && !settings.run) {
     scope.stopStream();
-    settings.recv = std::nullopt;
+    settings.ingest.detach();
   }
 
   if (scope.isStreaming()) {
@@ -216,6 +267,12 @@ void drawScopeControls(ScopeSettings &settings, Scope &scope) {
 
   ImGui::SameLine();
   ImGui::Checkbox("Follow", &settings.follow);
+  ImGui::SameLine();
+  if (ImGui::Checkbox("Persistence", &settings.showPersistence)) {
+    settings.setPersistence();
+  }
+  ImGui::SetItemTooltip("Draw sweeps of the live stream aligned on a trigger "
+                        "as a density map");
 
   ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.2);
   if (ImGui::BeginCombo("Voltage Range",
@@ -227,6 +284,10 @@ void drawScopeControls(ScopeSettings &settings, Scope &scope) {
           if (ImGui::Selectable(to_string(v).c_str(), selected)) {
             if (settings.voltageRange != v) {
               settings.voltageRange = v;
+              settings.ingest.setQuantum(adcStep(v));
+              settings.setHysteresis(to_limits(v).y / to_scale(v) *
+                                     CROSSING_HYSTERESIS);
+              settings.setPersistence();
               scope.setVoltageRange(v);
               auto new_limits = to_limits(v);
               ImPlot::SetNextAxisLimits(ImAxis_Y1, new_limits.x, new_limits.y,
@@ -268,6 +329,52 @@ void drawScopeControls(ScopeSettings &settings, Scope &scope) {
     auto range = settings.limits.X.Max - settings.limits.X.Min;
     ImPlot::SetNextAxisLimits(ImAxis_X1, 0, 0 + range, ImGuiCond_Always);
   }
+
+  // Applied on Enter so partly typed values never drop history
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.2f);
+  double seconds = settings.historySeconds;
+  if (ImGui::InputDouble("History (s)", &seconds, 0., 0., "%.0f",
+                         ImGuiInputTextFlags_EnterReturnsTrue) &&
+      seconds > 0.) {
+    settings.setHistory(seconds, settings.historyMegabytes);
+  }
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.3f);
+  double megabytes = settings.historyMegabytes;
+  if (ImGui::InputDouble("History (MB)", &megabytes, 0., 0., "%.0f",
+                         ImGuiInputTextFlags_EnterReturnsTrue) &&
+      megabytes > 0.) {
+    settings.setHistory(settings.historySeconds, megabytes);
+  }
+  const auto &stats = settings.ingest.current().history;
+  ImGui::SetItemTooltip(
+      "%.1f MB in RAM, %.1f MB on disk\n"
+      "%zu chunks packed %.1f:1, unpacked at %.0f MS/s",
+      stats.memoryBytes / double(1 << 20), stats.diskBytes / double(1 << 20),
+      stats.packedChunks,
+      stats.packedBytes > 0 ? stats.packedChunks * STORE_CHUNK *
+                                  sizeof(Sample) / double(stats.packedBytes)
+                            : 1.,
+      stats.unpackSeconds > 0. ? stats.unpackedSamples / stats.unpackSeconds / 1e6
+                               : 0.);
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.3f);
+  double ram = settings.ramMegabytes;
+  if (ImGui::InputDouble("RAM (MB)", &ram, 0., 0., "%.0f",
+                         ImGuiInputTextFlags_EnterReturnsTrue) &&
+      ram > 0.) {
+    settings.setRamBudget(ram);
+  }
+  ImGui::SetItemTooltip("History beyond this is kept in a temporary file\n"
+                        "%zu chunks spilled, %zu read back",
+                        stats.spilledChunks, stats.coldReads);
+  if (stats.spillFailed) {
+    ImGui::SameLine();
+    ImGui::TextColored({1.f, 0.4f, 0.4f, 1.f}, "Spill failed");
+    ImGui::SetItemTooltip("The spill file could not be written; history "
+                          "stays in RAM");
+  }
   ImGui::EndGroup();
 }
 
@@ -307,10 +414,12 @@ void drawSigGenControls(ScopeSettings &settings, Scope &scope) {
     case (SigGen::FreqSweep):
       drawSweepSettings(settings.freqSweepSettings);
       if (settings.generate && !scope.isGenerating()) {
-        scope.startFreqSweep(settings.freqSweepSettings.startFreq,
-                             settings.freqSweepSettings.endFreq, 2., 0,
-                             settings.freqSweepSettings.sweepDuration,
-                             PS2000_UPDOWN);
+        if (scope.startFreqSweep(settings.freqSweepSettings.startFreq,
+                                 settings.freqSweepSettings.endFreq, 2., 0,
+                                 settings.freqSweepSettings.sweepDuration,
+                                 PS2000_UPDOWN)) {
+          settings.ingest.trackSweep(scope.getSweepSchedule());
+        }
       }
       break;
     case (SigGen::Noise):
@@ -322,6 +431,7 @@ void drawSigGenControls(ScopeSettings &settings, Scope &scope) {
   }
   if (toggled && !settings.generate) {
     scope.stopSigGen();
+    settings.ingest.trackSweep(std::nullopt);
   }
   if (settings.selectedSigType == SigGen::FreqSweep) {
     drawSweepSettings(settings.freqSweepSettings);
@@ -371,7 +481,7 @@ void drawSpectrumControls(ScopeSettings &settings) {
         std::cout << "Selected " << windowSize << std::endl;
         selected_idx = i;
         if (windowSize != settings.windowSize) {
-          settings.updateSpectrum = true;
+          settings.restartSpectrum = true;
           settings.windowSize = windowSize;
         }
       }
@@ -397,7 +507,7 @@ void drawSpectrumControls(ScopeSettings &settings) {
       bool selected = s == settings.windowFn;
       if (ImGui::Selectable(s.c_str(), selected)) {
         if (settings.windowFn != s) {
-          settings.updateSpectrum = true;
+          settings.restartSpectrum = true;
           settings.windowFn = s;
         }
       }
@@ -409,9 +519,444 @@ void drawSpectrumControls(ScopeSettings &settings) {
     ImGui::EndCombo();
   }
 
+  ImGui::SameLine();
+  ImGui::Checkbox("Coherence", &settings.showCoherence);
+  ImGui::SameLine();
+  if (ImGui::Checkbox("Zoom", &settings.zoomSpectrum)) {
+    settings.restartSpectrum = true;
+  }
+  ImGui::SetItemTooltip("Resolve only the visible band, with resolution "
+                        "following the zoom level");
+  ImGui::SameLine();
+  ImGui::Checkbox("Min", &settings.showSpectrumMin);
+  ImGui::SetItemTooltip("Shade the range of the bins behind each pixel, not "
+                        "only their peak");
+
+  ImGui::SetNextItemWidth(prevSize.x);
+  auto spectrogramSize_str = std::format("{}", settings.spectrogramSize);
+  if (ImGui::BeginCombo("Spectrogram Size", spectrogramSize_str.c_str())) {
+    for (size_t power = 8; power <= 14; ++power) {
+      const size_t size = (size_t)1 << power;
+      const bool selected = size == settings.spectrogramSize;
+      if (ImGui::Selectable(std::format("{}", size).c_str(), selected) &&
+          !selected) {
+        settings.spectrogramSize = size;
+        settings.ingest.setSpectrogram(size);
+      }
+      if (selected) {
+        ImGui::SetItemDefaultFocus();
+      }
+    }
+    ImGui::EndCombo();
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Checkbox("Spectrogram (A)", &settings.showSpectrogram)) {
+    settings.ingest.setSpectrogram(settings.spectrogramSize);
+  }
+  ImGui::SameLine();
+  ImGui::Checkbox("Bode (A/B)", &settings.showBode);
+
+  ImGui::SetNextItemWidth(prevSize.x);
+  auto decimation_str = std::format("{}", settings.decimation);
+  if (ImGui::BeginCombo("Decimation", decimation_str.c_str())) {
+    for (auto factor : SUPPORTED_DECIMATIONS) {
+      const bool selected = factor == settings.decimation;
+      auto label = std::format("{} ({:.0f} Hz)", factor,
+                               SAMPLE_RATE / factor);
+      if (ImGui::Selectable(label.c_str(), selected) && !selected) {
+        settings.setDecimation(factor);
+      }
+      if (selected) {
+        ImGui::SetItemDefaultFocus();
+      }
+    }
+    ImGui::EndCombo();
+  }
+
+  ImGui::SetNextItemWidth(prevSize.x);
+  auto &average = settings.spectrumAverage;
+  if (ImGui::BeginCombo("Averaging", to_string(average.getMode()).c_str())) {
+    for (auto mode : SUPPORTED_AVERAGING) {
+      const bool selected = mode == average.getMode();
+      if (ImGui::Selectable(to_string(mode).c_str(), selected) && !selected) {
+        average.setMode(mode);
+        settings.restartSpectrum = true;
+      }
+      if (selected) {
+        ImGui::SetItemDefaultFocus();
+      }
+    }
+    ImGui::EndCombo();
+  }
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(prevSize.x);
+  if (average.getMode() == AveragingMode::Linear) {
+    int length = average.getLength();
+    if (ImGui::InputInt("Averages", &length, 1, 10)) {
+      average.setLength(std::max(length, 1));
+      settings.restartSpectrum = true;
+    }
+  } else if (average.getMode() == AveragingMode::Exponential) {
+    float alpha = average.getAlpha();
+    if (ImGui::SliderFloat("Alpha", &alpha, 0.01f, 1.f, "%.2f",
+                           ImGuiSliderFlags_Logarithmic)) {
+      average.setAlpha(alpha);
+      settings.restartSpectrum = true;
+    }
+  }
+  if (average.getMode() != AveragingMode::None) {
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+      average.reset();
+      settings.restartSpectrum = true;
+    }
+    ImGui::SameLine();
+    ImGui::Text("%zu updates", average.updates());
+  }
+
+  if (ImGui::Checkbox("Delay (A-B)", &settings.showDelay)) {
+    settings.restartSpectrum = true;
+  }
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(prevSize.x);
+  if (ImGui::BeginCombo("Weighting",
+                        to_string(settings.correlationWeighting).c_str())) {
+    for (auto weighting : SUPPORTED_WEIGHTINGS) {
+      const bool selected = weighting == settings.correlationWeighting;
+      if (ImGui::Selectable(to_string(weighting).c_str(), selected) &&
+          !selected) {
+        settings.correlationWeighting = weighting;
+        settings.restartSpectrum = true;
+      }
+      if (selected) {
+        ImGui::SetItemDefaultFocus();
+      }
+    }
+    ImGui::EndCombo();
+  }
+
   ImGui::EndGroup();
 }
 
+bool drawFilterChain(std::vector<FilterSpec> &specs,
+                     const std::vector<FilterStats> &stats) {
+  bool changed = false;
+  const auto width = ImGui::GetContentRegionAvail().x * 0.15f;
+  const size_t orderStep = 2, tapsStep = 64;
+
+  for (size_t i = 0; i < specs.size(); ++i) {
+    auto &spec = specs[i];
+    ImGui::PushID(static_cast<int>(i));
+    ImGui::PushItemWidth(width);
+    if (ImGui::BeginCombo("##Type", to_string(spec.type).c_str())) {
+      for (auto type : SUPPORTED_FILTERS) {
+        const bool selected = type == spec.type;
+        if (ImGui::Selectable(to_string(type).c_str(), selected) &&
+            !selected) {
+          spec.type = type;
+          changed = true;
+        }
+        if (selected) {
+          ImGui::SetItemDefaultFocus();
+        }
+      }
+      ImGui::EndCombo();
+    }
+    // Applied on Enter: the stored history is filtered, so a partly typed
+    // value would reach it
+    const auto flags = ImGuiInputTextFlags_EnterReturnsTrue;
+    ImGui::SameLine();
+    changed |= ImGui::InputDouble("Hz", &spec.freq, 0., 0., "%.1f", flags);
+    ImGui::SameLine();
+    switch (spec.type) {
+    case FilterType::BandPass:
+    case FilterType::Notch:
+      changed |= ImGui::InputDouble("Q", &spec.q, 0., 0., "%.2f", flags);
+      ImGui::SameLine();
+      [[fallthrough]];
+    case FilterType::LowPass:
+    case FilterType::HighPass:
+      changed |= ImGui::InputScalar("Order", ImGuiDataType_U64, &spec.order,
+                                    &orderStep, nullptr, nullptr, flags);
+      break;
+    case FilterType::FirLowPass:
+      changed |= ImGui::InputScalar("Taps", ImGuiDataType_U64, &spec.taps,
+                                    &tapsStep, nullptr, nullptr, flags);
+      break;
+    case FilterType::DcBlock:
+      break;
+    }
+    ImGui::PopItemWidth();
+    spec.order = std::clamp<size_t>(spec.order, 2, 16);
+    spec.taps = std::clamp<size_t>(spec.taps, 3, 1 << 14);
+    spec.q = std::max(spec.q, 0.1);
+
+    if (i < stats.size()) {
+      ImGui::SameLine();
+      ImGui::TextDisabled("%.1f ns/sample, %.2f%% load", stats[i].nsPerSample,
+                          stats[i].load * 100);
+    }
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Remove")) {
+      specs.erase(specs.begin() + i);
+      changed = true;
+      ImGui::PopID();
+      break;
+    }
+    ImGui::PopID();
+  }
+
+  if (ImGui::SmallButton("Add Filter")) {
+    specs.emplace_back();
+    changed = true;
+  }
+  return changed;
+}
+
+void drawFilterControls(ScopeSettings &settings) {
+  const auto &stats = settings.ingest.current().filters;
+  if (ImGui::BeginTable("Filter Controls", 2,
+                        ImGuiTableFlags_BordersInnerV |
+                            ImGuiTableFlags_Resizable,
+                        {ImGui::GetContentRegionAvail().x, 0.})) {
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(0);
+    ImGui::PushID("A");
+    ImGui::TextUnformatted("Channel A");
+    if (drawFilterChain(settings.filterSpecsA, stats[0])) {
+      settings.ingest.setFilters(0, settings.filterSpecsA);
+    }
+    ImGui::PopID();
+    ImGui::TableSetColumnIndex(1);
+    ImGui::PushID("B");
+    ImGui::TextUnformatted("Channel B");
+    if (drawFilterChain(settings.filterSpecsB, stats[1])) {
+      settings.ingest.setFilters(1, settings.filterSpecsB);
+    }
+    ImGui::PopID();
+    ImGui::EndTable();
+  }
+}
+
+void drawMeasurements(ScopeSettings &settings) {
+  // The view columns cover the view the snapshot was published for
+  const auto &snapshot = settings.ingest.current();
+  const std::array measurements = {snapshot.window[0], snapshot.window[1],
+                                   snapshot.stream[0], snapshot.stream[1]};
+  const std::array spectral = {settings.spectralA, settings.spectralB};
+
+  if (!ImGui::BeginTable("Measurements", 5,
+                         ImGuiTableFlags_BordersInnerV |
+                             ImGuiTableFlags_RowBg |
+                             ImGuiTableFlags_SizingStretchSame)) {
+    return;
+  }
+  for (auto header : {"", "A (view)", "B (view)", "A (stream)", "B (stream)"}) {
+    ImGui::TableSetupColumn(header);
+  }
+  ImGui::TableHeadersRow();
+
+  auto row = [&measurements](const char *label, const char *fmt,
+                             double Measurements::*field) {
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(0);
+    ImGui::TextUnformatted(label);
+    for (size_t i = 0; i < measurements.size(); ++i) {
+      ImGui::TableSetColumnIndex(i + 1);
+      if (measurements[i].count > 0) {
+        ImGui::Text(fmt, measurements[i].*field);
+      }
+    }
+  };
+  row("Mean", "%.4g V", &Measurements::mean);
+  row("RMS", "%.4g V", &Measurements::rms);
+  row("Min", "%.4g V", &Measurements::min);
+  row("Max", "%.4g V", &Measurements::max);
+  row("Pk-Pk", "%.4g V", &Measurements::pkToPk);
+  row("Frequency", "%.6g Hz", &Measurements::frequency);
+  row("Period", "%.4g s", &Measurements::period);
+
+  // Spectrum metrics come from the last spectrum of the visible range
+  auto spectralRow = [&spectral](const char *label, const char *fmt,
+                                 double SpectralMetrics::*field) {
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(0);
+    ImGui::TextUnformatted(label);
+    for (size_t i = 0; i < spectral.size(); ++i) {
+      ImGui::TableSetColumnIndex(i + 1);
+      if (spectral[i].fundamental > 0) {
+        ImGui::Text(fmt, spectral[i].*field);
+      }
+    }
+  };
+  spectralRow("Fundamental", "%.6g Hz", &SpectralMetrics::fundamental);
+  spectralRow("THD", "%.2f dB", &SpectralMetrics::thd);
+  spectralRow("SINAD", "%.2f dB", &SpectralMetrics::sinad);
+  spectralRow("SNR", "%.2f dB", &SpectralMetrics::snr);
+  ImGui::EndTable();
+
+  if (settings.showDelay && settings.delay.valid) {
+    ImGui::Text("Delay A-B: %.4g s (%.2f samples), peak %.3f",
+                settings.delay.delay * snapshot.sampleInterval,
+                settings.delay.delay, settings.delay.peak);
+  }
+}
+
+void drawTaskStats() {
+  auto &scheduler = Scheduler::getInstance();
+  ImGui::Text("%zu worker threads", scheduler.threads());
+  ImGui::SameLine();
+  if (ImGui::SmallButton("Reset")) {
+    scheduler.resetStats();
+  }
+  if (!ImGui::BeginTable("Tasks", 5,
+                         ImGuiTableFlags_BordersInnerV |
+                             ImGuiTableFlags_RowBg |
+                             ImGuiTableFlags_SizingStretchSame)) {
+    return;
+  }
+  for (auto header : {"Task", "Runs", "Mean", "Max", "Total"}) {
+    ImGui::TableSetupColumn(header);
+  }
+  ImGui::TableHeadersRow();
+  for (const auto &stats : scheduler.stats()) {
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(0);
+    ImGui::TextUnformatted(stats.name.c_str());
+    ImGui::TableSetColumnIndex(1);
+    ImGui::Text("%llu", static_cast<unsigned long long>(stats.count));
+    ImGui::TableSetColumnIndex(2);
+    ImGui::Text("%.3f ms", stats.meanMs());
+    ImGui::TableSetColumnIndex(3);
+    ImGui::Text("%.3f ms", stats.maxMs);
+    ImGui::TableSetColumnIndex(4);
+    ImGui::Text("%.1f ms", stats.totalMs);
+  }
+  ImGui::EndTable();
+}
+
+void drawPersistenceControls(ScopeSettings &settings) {
+  auto &p = settings.persistence;
+  bool changed = false;
+  ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x * 0.2f);
+  if (ImGui::BeginCombo("Source", p.channel == 0 ? "A" : "B")) {
+    for (size_t channel = 0; channel < 2; ++channel) {
+      const bool selected = channel == p.channel;
+      if (ImGui::Selectable(channel == 0 ? "A" : "B", selected) &&
+          !selected) {
+        p.channel = channel;
+        changed = true;
+      }
+      if (selected) {
+        ImGui::SetItemDefaultFocus();
+      }
+    }
+    ImGui::EndCombo();
+  }
+
+  ImGui::SameLine();
+  const auto volts = static_cast<float>(to_limits(settings.voltageRange).y /
+                                        to_scale(settings.voltageRange));
+  auto level = static_cast<float>(p.level);
+  if (ImGui::SliderFloat("Trigger (V)", &level, -volts, volts, "%.3f")) {
+    p.level = level;
+    changed = true;
+  }
+
+  ImGui::SameLine();
+  auto length_str = std::format("{}", p.length);
+  if (ImGui::BeginCombo("Sweep", length_str.c_str())) {
+    for (auto length : SUPPORTED_PERSISTENCE_LENGTHS) {
+      const bool selected = length == p.length;
+      auto label = std::format("{} ({:.1f} ms)", length,
+                               length * DELTA_TIME * 1e3);
+      if (ImGui::Selectable(label.c_str(), selected) && !selected) {
+        p.length = length;
+        p.pretrigger = length / 4;
+        changed = true;
+      }
+      if (selected) {
+        ImGui::SetItemDefaultFocus();
+      }
+    }
+    ImGui::EndCombo();
+  }
+
+  ImGui::SameLine();
+  auto halfLife = static_cast<float>(p.halfLife);
+  if (ImGui::SliderFloat("Half-life (s)", &halfLife, 0.f, 10.f,
+                         halfLife > 0.f ? "%.2f" : "infinite",
+                         ImGuiSliderFlags_Logarithmic)) {
+    p.halfLife = halfLife;
+    changed = true;
+  }
+  ImGui::SetItemTooltip("Time for a sweep to fade to half its brightness; "
+                        "0 keeps every sweep");
+  ImGui::PopItemWidth();
+
+  if (const auto &image = settings.ingest.current().persistence) {
+    ImGui::SameLine();
+    ImGui::Text("%zu sweeps", static_cast<size_t>(image->sweeps));
+  }
+  if (changed) {
+    settings.setPersistence();
+  }
+}
+
+void drawTraceControls() {
+  auto &trace = TraceRecorder::getInstance();
+  // Files go to the working directory, named by the wall clock
+  auto traceFile = [](const char *prefix) {
+    const auto stamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    std::error_code error;
+    return std::filesystem::current_path(error) /
+           (prefix + std::to_string(stamp.count()) + ".json");
+  };
+
+  bool recording = trace.recording();
+  if (ImGui::Checkbox("Record", &recording)) {
+    recording ? trace.start() : trace.stop();
+  }
+  ImGui::SetItemTooltip("Keeps the last %zu events of every thread",
+                        TRACE_RING);
+  ImGui::SameLine();
+  static std::string saved;
+  // Sorting, formatting and writing the events is left to a background
+  // task; the result shows once it finishes
+  static std::future<bool> saving;
+  static std::filesystem::path savingPath;
+  ImGui::BeginDisabled(saving.valid());
+  if (ImGui::Button("Save")) {
+    savingPath = traceFile("trace-");
+    saving = trace.writeLater(savingPath);
+    saved = "Saving " + savingPath.string();
+  }
+  ImGui::EndDisabled();
+  if (saving.valid() &&
+      saving.wait_for(std::chrono::seconds{0}) == std::future_status::ready) {
+    saved = saving.get() ? "Saved " + savingPath.string()
+                         : "Could not write " + savingPath.string();
+  }
+
+  int stallMs = static_cast<int>(trace.getStallThreshold().count());
+  ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.3f);
+  if (ImGui::InputInt("Save on stalls over (ms)", &stallMs, 10, 100)) {
+    std::error_code error;
+    trace.setStallDump(std::chrono::milliseconds{std::max(stallMs, 0)},
+                       std::filesystem::current_path(error));
+  }
+  ImGui::SetItemTooltip("Frames taking longer write the trace while "
+                        "recording; 0 turns this off");
+  if (!saved.empty()) {
+    ImGui::TextUnformatted(saved.c_str());
+  }
+  if (const auto dump = trace.lastStallDump(); !dump.empty()) {
+    ImGui::Text("Last stall: %s", dump.string().c_str());
+  }
+}
+
 void drawControls(ScopeSettings &settings, Scope &scope) {
   if (ImGui::BeginTable("Full Controls", 2,
                         ImGuiTableFlags_BordersInnerV |
@@ -427,6 +972,107 @@ void drawControls(ScopeSettings &settings, Scope &scope) {
 
   ImGui::SeparatorText("Spectrum Controls");
   drawSpectrumControls(settings);
+
+  ImGui::SeparatorText("Filter Controls");
+  drawFilterControls(settings);
+
+  ImGui::SeparatorText("Measurements");
+  drawMeasurements(settings);
+
+  if (ImGui::CollapsingHeader("Persistence")) {
+    drawPersistenceControls(settings);
+  }
+
+  if (ImGui::CollapsingHeader("Tasks")) {
+    drawTaskStats();
+  }
+
+  if (ImGui::CollapsingHeader("Trace")) {
+    drawTraceControls();
+  }
+}
+
+// A published trace with the scales it is drawn at. ImPlot reads it
+// through the getters below, so submitting a trace copies nothing.
+struct PlotTrace {
+  const ChannelTrace *trace;
+  double dt;
+  double scale;
+  double volts;
+};
+
+// Zoomed out, each bucket is drawn as a vertical stroke between its
+// extremes so glitches narrower than a pixel stay visible
+ImPlotPoint envelopePoint(int idx, void *data) {
+  const auto &plot = *static_cast<const PlotTrace *>(data);
+  const auto &bucket = plot.trace->buckets[idx / 2];
+  const double t = (bucket.first + bucket.count / 2.) * plot.dt * plot.scale;
+  return {t, (idx % 2 ? bucket.max : bucket.min) * plot.volts};
+}
+
+ImPlotPoint samplePoint(int idx, void *data) {
+  const auto &plot = *static_cast<const PlotTrace *>(data);
+  return {static_cast<double>(plot.trace->first + idx) * plot.dt * plot.scale,
+          plot.trace->samples[idx] * plot.volts};
+}
+
+// Peak buckets of a spectrum; each is drawn at the centre of its bins
+struct PlotPeaks {
+  const std::vector<EnvelopeBucket> *buckets;
+  double start;
+  double binWidth;
+};
+
+ImPlotPoint peakPoint(const PlotPeaks &plot, int idx, bool max) {
+  const auto &bucket = (*plot.buckets)[idx];
+  return {plot.start + (bucket.first + (bucket.count - 1) / 2.) * plot.binWidth,
+          max ? bucket.max : bucket.min};
+}
+
+ImPlotPoint peakMax(int idx, void *data) {
+  return peakPoint(*static_cast<const PlotPeaks *>(data), idx, true);
+}
+
+ImPlotPoint peakMin(int idx, void *data) {
+  return peakPoint(*static_cast<const PlotPeaks *>(data), idx, false);
+}
+
+// Sweeps aligned on the trigger at 0, in the units of the time base and
+// voltage range
+void drawPersistence(ScopeSettings &settings) {
+  const auto image = settings.ingest.current().persistence;
+  if (!ImPlot::BeginPlot("##Persistence", ImGui::GetContentRegionAvail(),
+                         ImPlotFlags_NoLegend)) {
+    return;
+  }
+  ImPlot::SetupAxes(to_string(settings.timebase).c_str(),
+                    to_string(settings.voltageRange).c_str(),
+                    ImPlotAxisFlags_AutoFit, 0);
+  const auto vLimits = to_limits(settings.voltageRange);
+  ImPlot::SetupAxisLimitsConstraints(ImAxis_Y1, vLimits.x, vLimits.y);
+  ImPlot::SetupAxisLimits(ImAxis_Y1, vLimits.x, vLimits.y);
+  if (image && image->peak > 0.f) {
+    const double scale = to_scale(settings.timebase);
+    const double volts = to_scale(settings.voltageRange);
+    const double end =
+        image->startTime + image->columns * image->sampleInterval;
+    ImPlot::PushColormap(ImPlotColormap_Hot);
+    ImPlot::PlotHeatmap("##Density", image->data.data(),
+                        static_cast<int>(image->rows),
+                        static_cast<int>(image->columns), 0., image->peak,
+                        nullptr,
+                        {image->startTime * scale, image->minVolts * volts},
+                        {end * scale, image->maxVolts * volts});
+    ImPlot::PopColormap();
+  }
+  ImPlot::TagX(0., ImVec4(1, 1, 0, 1));
+  ImPlot::EndPlot();
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
 }
 
 } // namespace
@@ -435,18 +1081,18 @@ void drawScope(ScopeSettings &settings, Scope &scope) {
   static uint32_t frame = 0;
   ++frame;
 
-  if (!ImPlot::BeginPlot("##Oscilloscope", ImGui::GetContentRegionAvail())) {
+  // New samples, or an answer to a changed view, warrant a new spectrum
+  if (settings.ingest.acquire()) {
+    settings.updateSpectrum = true;
+  }
+  const auto &snapshot = settings.ingest.current();
+  if (settings.showPersistence) {
+    drawPersistence(settings);
     return;
   }
 
-  if (settings.recv.has_value()) {
-    sr::for_each(settings.recv->flush_no_block(), [&settings](const auto &e) {
-      settings.dataA.insert(settings.dataA.end(), e.dataA.begin(),
-                            e.dataA.end());
-      settings.dataB.insert(settings.dataB.end(), e.dataB.begin(),
-                            e.dataB.end());
-      settings.updateSpectrum = true;
-    });
+  if (!ImPlot::BeginPlot("##Oscilloscope", ImGui::GetContentRegionAvail())) {
+    return;
   }
 
   ImPlot::SetupAxes(to_string(settings.timebase).c_str(),
@@ -457,164 +1103,405 @@ void drawScope(ScopeSettings &settings, Scope &scope) {
   ImPlot::SetupAxisLimits(ImAxis_X1, settings.limits.X.Min,
                           settings.limits.X.Max);
 
+  auto scale = to_scale(settings.timebase);
   if (settings.follow && scope.isStreaming() && frame % 5 == 0) {
-    double latest = DELTA_TIME *
-                    std::max(settings.dataA.size(), settings.dataB.size()) *
-                    to_scale(settings.timebase);
+    double latest = DELTA_TIME * snapshot.endIndex * scale;
     if (latest > settings.limits.X.Max || latest < settings.limits.X.Min) {
       auto range = settings.limits.X.Max - settings.limits.X.Min;
       ImPlot::SetupAxisLimits(ImAxis_X1, latest - range, latest,
                               ImPlotCond_Always);
     }
   } else {
-    auto temp = ImPlot::GetPlotLimits();
-    if (std::abs(temp.X.Min - settings.limits.X.Min) > 1e-6 ||
-        std::abs(temp.X.Max - settings.limits.X.Max) > 1e-6) {
-      settings.updateSpectrum = true;
+    settings.limits = ImPlot::GetPlotLimits();
+  }
+
+  // A changed view is answered by a later snapshot; until then the traces
+  // of the previous one are drawn where they belong on the new axes
+  const ViewRequest view{
+      .start = settings.limits.X.Min / scale,
+      .end = settings.limits.X.Max / scale,
+      .pixels = static_cast<size_t>(std::max(ImPlot::GetPlotSize().x, 1.f)),
+      .spectrogram = settings.showSpectrogram};
+  if (view != settings.view) {
+    // Only a different time range makes the spectrum in flight obsolete
+    if (view.start != settings.view.start || view.end != settings.view.end) {
+      settings.restartSpectrum = true;
     }
-    settings.limits = temp;
+    settings.view = view;
+    settings.ingest.setView(view);
   }
 
+  const double volts = to_scale(settings.voltageRange);
   for (int i = 0; i < 2; ++i) {
-    std::string name;
-    const std::vector<double> &data = ([i, &settings, &name]() {
-      if (i == 0) {
-        name = "Channel A";
-        return settings.dataA;
-      } else {
-        name = "Channel B";
-        return settings.dataB;
-      }
-    })();
-
-    auto scale = to_scale(settings.timebase);
-    auto left = settings.limits.X.Min / scale / DELTA_TIME;
-    auto right = settings.limits.X.Max / scale / DELTA_TIME;
-    left = left < 0 ? 0. : left;
-    left = left >= data.size() ? data.size() : left;
-    right = right < 0 ? 0. : right;
-    right = right >= data.size() ? data.size() : right;
-    size_t size = right - left;
-    auto stride = std::max(static_cast<size_t>(1), size / PLOT_SAMPLES);
-    auto idxs =
-        rv::iota((size_t)round(left)) | rv::take(size) | rv::stride(stride);
-    auto xs =
-        idxs |
-        rv::transform([scale](auto e) { return e * DELTA_TIME * scale; }) |
-        ranges::to_vector;
-    auto ys = idxs | rv::transform([&data, &settings](auto e) {
-                return data[e] * to_scale(settings.voltageRange);
-              }) |
-              ranges::to_vector;
-
-    ImPlot::PlotLine(name.c_str(), xs.data(), ys.data(), xs.size());
+    PlotTrace plot{&snapshot.traces[i], snapshot.sampleInterval, scale, volts};
+    ImPlot::PlotLineG(i == 0 ? "Channel A" : "Channel B",
+                      plot.trace->envelope ? envelopePoint : samplePoint,
+                      &plot, static_cast<int>(plot.trace->points()));
   }
   ImPlot::EndPlot();
 }
 
-void ScopeSettings::clearData() {
-  dataA.clear();
-  dataB.clear();
+size_t historySamples(double seconds, double megabytes, size_t decimation) {
+  const double bySeconds = seconds / DELTA_TIME;
+  const double byBytes = megabytes * (1 << 20) / (2 * sizeof(Sample));
+  return static_cast<size_t>(std::max(std::min(bySeconds, byBytes), 1.)) /
+         std::max<size_t>(decimation, 1);
+}
 
-  updateSpectrum = true;
+size_t historyMemoryLimit(double megabytes, size_t decimation) {
+  return static_cast<size_t>(megabytes * (1 << 20) / 2) /
+         std::max<size_t>(decimation, 1);
 }
 
-void drawSpectrum(ScopeSettings &settings) {
-  using namespace std::chrono_literals;
-  static bool first = true;
-  static auto [sendResult, recvResult] = mpsc::make<std::vector<double>>();
-  static auto [sendData, recvData] =
-      mpsc::make<std::tuple<std::vector<double>, std::vector<double>, size_t,
-                            WindowFunction>>();
-  static std::vector<double> ys;
-  static std::thread thread{
-      [recv = std::move(recvData), send = std::move(sendResult)]() mutable {
-        while (true) {
-          auto data = recv.flush();
-          if (data.empty()) {
-            continue;
-          }
+ScopeSettings::ScopeSettings() {
+  // Unfiltered samples are whole ADC codes, which pack losslessly
+  ingest.setQuantum(adcStep(voltageRange));
+}
+
+void ScopeSettings::clearData() {
+  ingest.clear();
+  restartSpectrum = true;
+}
 
-          auto &&[dataA, dataB, windowSize, windowFn] = std::move(data.back());
-          auto &&res =
-              welch(std::move(dataA), std::move(dataB), windowSize, windowFn);
+void ScopeSettings::setDecimation(size_t factor) {
+  decimation = factor;
+  ingest.setDecimation(factor);
+  restartSpectrum = true;
+}
 
-          send.send(std::move(res));
-        }
-      }};
-  if (first) {
-    thread.detach();
-    first = false;
-  }
+void ScopeSettings::setHistory(double seconds, double megabytes) {
+  historySeconds = seconds;
+  historyMegabytes = megabytes;
+  ingest.setRetention(historySamples(seconds, megabytes));
+}
 
-  if (settings.updateSpectrum) {
-    auto limits = settings.limits.X;
-    auto scale = to_scale(settings.timebase);
-    ImPlotRange range{limits.Min / scale, limits.Max / scale};
+void ScopeSettings::setRamBudget(double megabytes) {
+  ramMegabytes = megabytes;
+  ingest.setMemoryLimit(historyMemoryLimit(megabytes));
+}
 
-    int left = std::round(range.Min / DELTA_TIME);
-    int right = std::round(range.Max / DELTA_TIME);
+void ScopeSettings::setHysteresis(double volts) {
+  ingest.setHysteresis(volts);
+}
 
-    if (left < 0) {
-      left = 0;
-    }
-    if (left >= settings.dataA.size()) {
-      left = settings.dataA.size();
-    }
+void ScopeSettings::setPersistence() {
+  const double volts = to_limits(voltageRange).y / to_scale(voltageRange);
+  persistence.minVolts = -volts;
+  persistence.maxVolts = volts;
+  persistence.hysteresis = volts * CROSSING_HYSTERESIS;
+  persistence.level = std::clamp(persistence.level, -volts, volts);
+  if (showPersistence) {
+    ingest.setPersistence(persistence);
+  } else {
+    ingest.setPersistence(std::nullopt);
+  }
+}
 
-    if (right < 0) {
-      right = 0;
+void drawSpectrum(ScopeSettings &settings) {
+  using namespace std::chrono_literals;
+  static auto [sendResult, recvResult] = mpsc::make<SpectrumResult>();
+  static TransferFunction transfer;
+  static bool preview = false;
+  static std::pair<double, double> averagedBins;
+  // Taken from each result, so reducing to pixels costs O(pixels) a frame
+  static PeakPyramid spectrumPeaks;
+  static PeakPyramid coherencePeaks;
+  static std::vector<EnvelopeBucket> buckets;
+  // At most one job is in flight; newer data waits for it to return. A
+  // changed view or setting cancels it at its next segment instead, so
+  // superseded ranges stop costing time as soon as the view moves on. The
+  // generation counts those changes; results of older ones are dropped.
+  static std::atomic<bool> busy = false;
+  static std::stop_source cancel;
+  static uint64_t generation = 0;
+  // Sample range of the job in flight, for the trace
+  static std::pair<uint64_t, uint64_t> running;
+  // Visible samples are asked for once a job can be submitted, and the
+  // job waits for the snapshot answering the request
+  static uint64_t request = 0;
+
+  if (settings.restartSpectrum) {
+    ++generation;
+    if (busy && !cancel.stop_requested()) {
+      cancel.request_stop();
+      TraceRecorder::getInstance().instant("spectrum cancel", running.first,
+                                           running.second);
     }
-    if (right >= settings.dataA.size()) {
-      right = settings.dataA.size();
+    settings.restartSpectrum = false;
+    settings.updateSpectrum = true;
+    request = 0;
+  }
+  const auto &snapshot = settings.ingest.current();
+  if (settings.updateSpectrum && !busy && request == 0) {
+    const double limit = settings.spectrumSeconds / snapshot.sampleInterval;
+    request = settings.ingest.requestVisible(
+        limit < static_cast<double>(std::numeric_limits<size_t>::max())
+            ? static_cast<size_t>(limit)
+            : std::numeric_limits<size_t>::max());
+  }
+  if (settings.updateSpectrum && !busy &&
+      snapshot.visibleRequest == request) {
+    // The job shares the visible chunks the ingest thread published rather
+    // than copying them here
+    const double dt = snapshot.sampleInterval;
+    auto snapshotA = snapshot.visible[0];
+    auto snapshotB = snapshot.visible[1];
+    std::optional<CorrelationWeighting> correlation;
+    if (settings.showDelay) {
+      correlation = settings.correlationWeighting;
     }
-
-    auto dataA = settings.dataA | rv::slice(left, right) | ranges::to_vector;
-    auto dataB = settings.dataB | rv::slice(left, right) | ranges::to_vector;
-    sendData.send(std::tuple{std::move(dataA), std::move(dataB),
-                             settings.windowSize,
-                             WINDOW_MAP.at(settings.windowFn)});
+    // Zoom only once the visible band is narrow enough to gain resolution
+    std::optional<ImPlotRange> zoomBand;
+    const double nyquist = 0.5 / dt;
+    const ImPlotRange band{std::max(settings.spectrumLimits.X.Min, 0.),
+                           std::min(settings.spectrumLimits.X.Max, nyquist)};
+    if (settings.zoomSpectrum && band.Max > band.Min &&
+        band.Size() < MAX_ZOOM_BANDWIDTH / dt) {
+      zoomBand = band;
+    }
+    cancel = std::stop_source{};
+    busy = true;
+    running = {snapshotA.firstIndex(), snapshotA.size()};
+    Scheduler::getInstance().submit(
+        Priority::Interactive, "spectrum",
+        [snapshotA = std::move(snapshotA), snapshotB = std::move(snapshotB),
+         windowSize = settings.windowSize,
+         windowFn = WINDOW_MAP.at(settings.windowFn), sampleRate = 1. / dt,
+         correlation, zoomBand, stop = cancel.get_token(), tag = generation,
+         range = running, average = settings.spectrumAverage,
+         averagedBins = averagedBins]() mutable {
+          const auto start = std::chrono::steady_clock::now();
+          // Reused across jobs, which never overlap
+          static CrossSpectrum spectrum;
+          static CrossCorrelator correlator;
+          static std::vector<Sample> dataA, dataB;
+          snapshotA.copyTo(dataA);
+          snapshotB.copyTo(dataB);
+
+          // Previews bypass averaging, which only ever sees complete spectra
+          const auto sendPreview = [&](TransferFunction transfer) {
+            SpectrumResult preview{.generation = tag, .preview = true};
+            preview.spectrumPeaks.assign(transfer.h1);
+            preview.coherencePeaks.assign(transfer.coherence);
+            preview.transfer = std::move(transfer);
+            sendResult.send(std::move(preview));
+            Profiler::getInstance().addQueued(Queue::Spectrum, 1);
+          };
+
+          SpectrumResult result{.generation = tag};
+          if (zoomBand) {
+            // Harmonic metrics need the baseband spectrum; skip them
+            const double rate = zoomCrossSpectrum(
+                dataA, dataB, sampleRate, zoomBand->Min, zoomBand->Max,
+                spectrum, windowSize, windowFn, stop,
+                [&](const CrossSpectrum &partial) {
+                  // Zoomed bins are spaced by the decimated rate
+                  const double decimated =
+                      sampleRate / zoomDecimation(sampleRate,
+                                                  zoomBand->Size());
+                  sendPreview(transferFunction(partial, decimated));
+                });
+            result.transfer = transferFunction(spectrum, rate);
+          } else {
+            crossSpectrum<Sample>(
+                dataA, dataB, spectrum, windowSize, windowFn, stop,
+                [&](const CrossSpectrum &partial) {
+                  sendPreview(transferFunction(partial, sampleRate));
+                });
+            const double binWidth = sampleRate / spectrum.windowSize;
+            result.transfer = transferFunction(spectrum, sampleRate);
+            result.spectralA = spectralMetrics(spectrum.saa, binWidth);
+            result.spectralB = spectralMetrics(spectrum.sbb, binWidth);
+          }
+          if (correlation && !stop.stop_requested()) {
+            correlator.setWeighting(*correlation);
+            result.delay =
+                correlator.estimate(dataA, dataB, CORRELATION_MAX_LAG);
+          }
+          // A cancelled job's average is incomplete; only previews escape
+          if (!stop.stop_requested()) {
+            // Averaging across different zoom bands would mix unrelated bins
+            const std::pair bins{result.transfer.startFrequency,
+                                 result.transfer.binWidth};
+            if (bins != averagedBins) {
+              average.reset();
+            }
+            average.update(result.transfer.h1);
+            result.spectrumPeaks.assign(average.values());
+            result.coherencePeaks.assign(result.transfer.coherence);
+            result.average = std::move(average);
+            result.averagedBins = bins;
+            sendResult.send(std::move(result));
+            Profiler::getInstance().addQueued(Queue::Spectrum, 1);
+          }
+          auto &trace = TraceRecorder::getInstance();
+          trace.complete("spectrum job", start,
+                         std::chrono::steady_clock::now(), range.first,
+                         range.second);
+          if (stop.stop_requested()) {
+            trace.instant("spectrum cancelled", range.first, range.second);
+          }
+          busy = false;
+        });
 
     settings.updateSpectrum = false;
+    request = 0;
+  }
+
+  // Earlier generations may still be queued behind the current one
+  auto results = recvResult.flush_no_block();
+  Profiler::getInstance().addQueued(Queue::Spectrum,
+                                    -static_cast<ptrdiff_t>(results.size()));
+  auto current = results | sv::reverse;
+  auto latest = sr::find_if(current, [](const auto &result) {
+    return result.generation == generation;
+  });
+  if (latest != current.end()) {
+    transfer = std::move(latest->transfer);
+    preview = latest->preview;
+    if (!preview) {
+      settings.spectralA = latest->spectralA;
+      settings.spectralB = latest->spectralB;
+      settings.delay = latest->delay;
+      // The job averaged a copy; changing the averaging restarts the
+      // spectrum, so nothing was changed here meanwhile
+      settings.spectrumAverage = std::move(latest->average);
+      averagedBins = latest->averagedBins;
+    }
+    spectrumPeaks = std::move(latest->spectrumPeaks);
+    coherencePeaks = std::move(latest->coherencePeaks);
   }
 
-  auto result = recvResult.flush_no_block();
-  if (!result.empty()) {
-    ys = std::move(result.back());
-  }
-
-  double bin_size = SAMPLE_RATE / 2 / ys.size();
-  auto temp =
-      rv::iota(0) | rv::take(ys.size()) |
-      rv::transform([bin_size](auto i) { return std::pair{i, i * bin_size}; }) |
-      rv::drop_while([&settings](auto i) {
-        return i.second < settings.spectrumLimits.X.Min;
-      }) |
-      rv::take_while([&settings](auto &&i) {
-        return i.second <= settings.spectrumLimits.X.Max;
-      });
-
-  auto stride = std::max<size_t>(1, sr::distance(temp) / PLOT_SAMPLES);
-  auto xs = temp | rv::stride(stride) |
-            rv::transform([](auto p) { return p.second; }) | ranges::to_vector;
-  auto strided_ys = temp | rv::stride(stride) |
-                    rv::transform([](auto p) { return ys[p.first]; }) |
-                    ranges::to_vector;
+  // Bins inside the limits follow from the bin spacing; each pixel is drawn
+  // from the extremes of its bins, so narrow spurs are never skipped
+  const double bin_size = transfer.binWidth;
+  const double start = transfer.startFrequency;
+  const auto clampBin = [](double bin) {
+    return static_cast<size_t>(
+        std::clamp(bin, 0., static_cast<double>(spectrumPeaks.size())));
+  };
+  size_t firstBin = 0;
+  size_t lastBin = spectrumPeaks.size();
+  if (bin_size > 0.) {
+    firstBin = clampBin(
+        std::ceil((settings.spectrumLimits.X.Min - start) / bin_size));
+    lastBin = std::max(
+        firstBin,
+        clampBin(
+            std::floor((settings.spectrumLimits.X.Max - start) / bin_size) +
+            1));
+  }
+  // Dips rather than peaks are what matter in `dips` series such as the
+  // coherence, so their line goes through the minima and their band is
+  // always shaded
+  const auto plotBins = [&](const char *label, const PeakPyramid &peaks,
+                            bool dips) {
+    const auto pixels = static_cast<size_t>(ImPlot::GetPlotSize().x);
+    peaks.reduce(firstBin, lastBin, std::max<size_t>(pixels, 1), buckets);
+    PlotPeaks plot{&buckets, start, bin_size};
+    const auto count = static_cast<int>(buckets.size());
+    // Sharing the label gives the band the colour of the line
+    if (dips || settings.showSpectrumMin) {
+      ImPlot::PushStyleVar(ImPlotStyleVar_FillAlpha, 0.3f);
+      ImPlot::PlotShadedG(label, peakMin, &plot, peakMax, &plot, count);
+      ImPlot::PopStyleVar();
+    }
+    ImPlot::PlotLineG(label, dips ? peakMin : peakMax, &plot, count);
+  };
   if (ImPlot::BeginPlot("Spectrum", ImGui::GetContentRegionAvail(),
                         ImPlotFlags_NoLegend)) {
     ImPlot::SetupAxes("Frequency", "Db", 0, 0);
     ImPlot::SetupAxisLimitsConstraints(ImAxis_X1, 0, 20000);
     ImPlot::SetupAxisLimitsConstraints(ImAxis_Y1, -100, 100);
     ImPlot::SetupAxesLimits(0., 20e3, -100., 100., ImPlotCond_Once);
+    if (settings.showCoherence) {
+      ImPlot::SetupAxis(ImAxis_Y2, "Coherence", ImPlotAxisFlags_AuxDefault);
+      ImPlot::SetupAxisLimits(ImAxis_Y2, 0., 1.05, ImPlotCond_Once);
+    }
+
+    plotBins("SpectrumPlot", spectrumPeaks, false);
+
+    if (settings.showCoherence &&
+        coherencePeaks.size() == spectrumPeaks.size()) {
+      ImPlot::SetAxes(ImAxis_X1, ImAxis_Y2);
+      plotBins("Coherence", coherencePeaks, true);
+    }
 
-    ImPlot::PlotLine("SpectrumPlot", xs.data(), strided_ys.data(), xs.size());
+    const auto limits = ImPlot::GetPlotLimits();
+    if (settings.zoomSpectrum &&
+        (limits.X.Min != settings.spectrumLimits.X.Min ||
+         limits.X.Max != settings.spectrumLimits.X.Max)) {
+      settings.restartSpectrum = true;
+    }
+    settings.spectrumLimits = limits;
+    ImPlot::EndPlot();
+  }
+}
+
+void drawSpectrogram(ScopeSettings &settings) {
+  // Shared with the ingest thread, which copies it only when columns arrive
+  const auto image = settings.ingest.current().spectrogram;
+  if (!ImPlot::BeginPlot("Spectrogram", ImGui::GetContentRegionAvail(),
+                         ImPlotFlags_NoLegend)) {
+    return;
+  }
+  ImPlot::SetupAxes("s", "Frequency", ImPlotAxisFlags_AutoFit, 0);
+  ImPlot::SetupAxisLimits(ImAxis_Y1, 0., 20e3, ImPlotCond_Once);
+  if (!image || image->columns == 0) {
+    ImPlot::EndPlot();
+    return;
+  }
+  ImPlot::SetupAxisLimitsConstraints(ImAxis_Y1, 0, image->nyquist);
+
+  const double hop = image->hopSeconds;
+  const double binHeight = image->nyquist / (image->bins - 1);
+  ImPlot::PushColormap(ImPlotColormap_Viridis);
+  ImPlot::PlotHeatmap(
+      "##Spectrogram", image->data.data(), image->bins, image->columns,
+      settings.spectrogramScale.Min, settings.spectrogramScale.Max, nullptr,
+      {image->firstTime - hop / 2, -binHeight / 2},
+      {image->lastTime + hop / 2, image->nyquist + binHeight / 2},
+      ImPlotHeatmapFlags_ColMajor);
+  ImPlot::PopColormap();
+  ImPlot::EndPlot();
+}
 
-    settings.spectrumLimits = ImPlot::GetPlotLimits();
+void drawBode(ScopeSettings &settings) {
+  const auto &snapshot = settings.ingest.current();
+  if (!snapshot.sweeping) {
+    ImGui::TextDisabled("Start a frequency sweep to measure a Bode plot");
+    return;
+  }
+  const auto &points = snapshot.bode;
+  const auto count = static_cast<int>(points.size());
+  const double current = snapshot.sweepFrequency;
+  if (!ImPlot::BeginSubplots("Bode", 2, 1, ImGui::GetContentRegionAvail(),
+                             ImPlotSubplotFlags_LinkCols)) {
+    return;
+  }
+  // Steps that have not been measured yet are NaN and left as gaps
+  if (ImPlot::BeginPlot("##BodeMagnitude", {}, ImPlotFlags_NoLegend)) {
+    ImPlot::SetupAxes(nullptr, "dB", ImPlotAxisFlags_AutoFit,
+                      ImPlotAxisFlags_AutoFit);
+    ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Log10);
+    ImPlot::PlotLine("Magnitude", &points[0].frequency, &points[0].magnitude,
+                     count, ImPlotLineFlags_SkipNaN, 0, sizeof(BodePoint));
+    ImPlot::TagX(current, ImVec4(1, 1, 0, 1));
+    ImPlot::EndPlot();
+  }
+  if (ImPlot::BeginPlot("##BodePhase", {}, ImPlotFlags_NoLegend)) {
+    ImPlot::SetupAxes("Frequency", "deg", ImPlotAxisFlags_AutoFit, 0);
+    ImPlot::SetupAxisScale(ImAxis_X1, ImPlotScale_Log10);
+    ImPlot::SetupAxisLimits(ImAxis_Y1, -180, 180, ImPlotCond_Once);
+    ImPlot::PlotLine("Phase", &points[0].frequency, &points[0].phase, count,
+                     ImPlotLineFlags_SkipNaN, 0, sizeof(BodePoint));
     ImPlot::EndPlot();
   }
+  ImPlot::EndSubplots();
 }
 
 void drawScopeTab(ScopeSettings &settings, Scope &scope) {
+  settings.viewTimes = {};
   auto size = ImGui::GetContentRegionAvail();
   if (ImGui::BeginChild("Scope", {size.x, size.y * 0.75f},
                         ImGuiChildFlags_ResizeY | ImGuiChildFlags_Borders)) {
@@ -655,13 +1542,36 @@ void drawScopeTab(ScopeSettings &settings, Scope &scope) {
       drawSplitter(false, 20.f, &scopeWidth, &specWidth, 10., 10.);
     }
     if (ImGui::BeginChild("ScopeWindow", {scopeWidth, available.y})) {
+      const auto start = std::chrono::steady_clock::now();
       drawScope(settings, scope);
+      settings.viewTimes.scopeMs = elapsedMs(start);
       ImGui::EndChild();
     }
     if (settings.showSpectrum) {
       ImGui::SameLine();
       if (ImGui::BeginChild("Spectrum", ImGui::GetContentRegionAvail())) {
-        drawSpectrum(settings);
+        // The spectrum shares the pane evenly with the optional views
+        const int views = 1 + settings.showSpectrogram + settings.showBode;
+        auto viewSize = ImGui::GetContentRegionAvail();
+        viewSize.y /= views;
+        if (ImGui::BeginChild("SpectrumView", viewSize)) {
+          const auto start = std::chrono::steady_clock::now();
+          drawSpectrum(settings);
+          settings.viewTimes.spectrumMs = elapsedMs(start);
+        }
+        ImGui::EndChild();
+        if (settings.showSpectrogram) {
+          if (ImGui::BeginChild("SpectrogramView", viewSize)) {
+            drawSpectrogram(settings);
+          }
+          ImGui::EndChild();
+        }
+        if (settings.showBode) {
+          if (ImGui::BeginChild("BodeView", viewSize)) {
+            drawBode(settings);
+          }
+          ImGui::EndChild();
+        }
         ImGui::EndChild();
       }
     }
@@ -673,6 +1583,64 @@ void drawScopeTab(ScopeSettings &settings, Scope &scope) {
   }
 }
 
+void drawProfiler() {
+  auto &profiler = Profiler::getInstance();
+  // Refreshed a few times a second; sorting the timings every frame would
+  // show up in the render stage being measured
+  static std::array<StageStats, STAGES> stats;
+  static std::chrono::steady_clock::time_point updated;
+  const auto now = std::chrono::steady_clock::now();
+  if (now - updated > PROFILER_REFRESH) {
+    stats = profiler.stats();
+    updated = now;
+  }
+
+  const auto &io = ImGui::GetIO();
+  ImGui::SetNextWindowPos({io.DisplaySize.x - 10.f, 5.f}, ImGuiCond_Always,
+                          {1.f, 0.f});
+  ImGui::SetNextWindowBgAlpha(0.75);
+  ImGui::Begin("Profiler", nullptr,
+               ImGuiWindowFlags_NoDecoration |
+                   ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoNav |
+                   ImGuiWindowFlags_NoSavedSettings |
+                   ImGuiWindowFlags_NoFocusOnAppearing);
+  ImGui::Text("%.2f FPS", io.Framerate);
+  if (ImGui::CollapsingHeader("Stages")) {
+    if (ImGui::BeginTable("Stages", 5,
+                          ImGuiTableFlags_BordersInnerV |
+                              ImGuiTableFlags_RowBg)) {
+      for (auto header : {"Stage", "p50", "p99", "Per second", "Samples/s"}) {
+        ImGui::TableSetupColumn(header);
+      }
+      ImGui::TableHeadersRow();
+      for (size_t i = 0; i < STAGES; ++i) {
+        const auto &s = stats[i];
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        ImGui::TextUnformatted(to_string(static_cast<Stage>(i)));
+        if (s.count == 0) {
+          continue;
+        }
+        ImGui::TableSetColumnIndex(1);
+        ImGui::Text("%.3f ms", s.p50Ms);
+        ImGui::TableSetColumnIndex(2);
+        ImGui::Text("%.3f ms", s.p99Ms);
+        ImGui::TableSetColumnIndex(3);
+        ImGui::Text("%.1f", s.perSecond);
+        ImGui::TableSetColumnIndex(4);
+        ImGui::Text("%.3g", s.itemsPerSecond);
+      }
+      ImGui::EndTable();
+    }
+    for (auto queue : {Queue::Stream, Queue::Spectrum}) {
+      ImGui::Text("%s queue: %zu", to_string(queue), profiler.queued(queue));
+    }
+    ImGui::Text("Pending tasks: %zu",
+                Scheduler::getInstance().pendingTasks());
+  }
+  ImGui::End();
+}
+
 void ScopeSettings::fillRandomData(size_t samples) {
   auto iota = sv::iota(0) |
               sv::transform([](auto e) { return (double)e * DELTA_TIME; });
@@ -689,8 +1657,7 @@ void ScopeSettings::fillRandomData(size_t samples) {
   auto a = dataA | sv::take(samples) | ranges::to_vector;
   auto b = dataB | sv::take(samples) | ranges::to_vector;
 
-  this->dataA.insert(this->dataA.end(), a.begin(), a.end());
-  this->dataB.insert(this->dataB.end(), b.begin(), b.end());
-
-  updateSpectrum = true;
+  std::vector<Sample> sampledA(a.begin(), a.end());
+  std::vector<Sample> sampledB(b.begin(), b.end());
+  ingest.append(std::move(sampledA), std::move(sampledB));
 }
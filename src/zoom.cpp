@@ -0,0 +1,175 @@
+#include "zoom.hpp"
+
+#include "resample.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <mutex>
+#include <numbers>
+
+namespace {
+bool isSmooth(size_t n) {
+  for (size_t p : {2, 3, 5, 7}) {
+    while (n % p == 0) {
+      n /= p;
+    }
+  }
+  return n == 1;
+}
+
+// In-phase and quadrature parts of x * exp(-j 2 pi f n), decimated into i
+// and q. The mixed samples are per-thread scratch kept between calls.
+void basebandChannel(std::span<const float> x, double frequency,
+                     size_t decimation, std::vector<float> &i,
+                     std::vector<float> &q) {
+  thread_local std::vector<float> mixedI, mixedQ;
+  mixedI.resize(x.size());
+  mixedQ.resize(x.size());
+  // Rotating phasor, renormalised per block against accumulated drift
+  const std::complex<double> step = std::polar(1., -2 * std::numbers::pi *
+                                                       frequency);
+  std::complex<double> phasor = 1.;
+  constexpr size_t BLOCK = 1024;
+  for (size_t start = 0; start < x.size(); start += BLOCK) {
+    const size_t end = std::min(x.size(), start + BLOCK);
+    for (size_t n = start; n < end; ++n) {
+      mixedI[n] = x[n] * phasor.real();
+      mixedQ[n] = x[n] * phasor.imag();
+      phasor *= step;
+    }
+    phasor /= std::abs(phasor);
+  }
+
+  DecimationChain<float> chainI{decimation}, chainQ{decimation};
+  i.clear();
+  q.clear();
+  chainI.process(mixedI, i);
+  chainQ.process(mixedQ, q);
+}
+} // namespace
+
+size_t zoomDecimation(double sampleRate, double bandwidth) {
+  if (bandwidth <= 0.) {
+    return 1;
+  }
+  auto factor = static_cast<size_t>(sampleRate / (2 * bandwidth));
+  while (factor > 1 && !isSmooth(factor)) {
+    --factor;
+  }
+  return std::max<size_t>(factor, 1);
+}
+
+double zoomCrossSpectrum(std::span<const float> a, std::span<const float> b,
+                         double sampleRate, double low, double high,
+                         CrossSpectrum &res, size_t windowSize,
+                         const WindowFunction &windowFn,
+                         std::stop_token stop,
+                         const SpectrumProgress &progress) {
+  ProfileScope profile{Stage::Welch, a.size()};
+  res.segments = 0;
+  res.saa.clear();
+  res.sbb.clear();
+  res.sab.clear();
+  const double centre = (low + high) / 2;
+  const size_t decimation = zoomDecimation(sampleRate, high - low);
+  const double rate = sampleRate / decimation;
+
+  // Both channels are mixed down at once; the decimated I/Q of A and B
+  // persist between calls like the FFT scratch
+  thread_local std::array<std::vector<float>, 4> scratch;
+  // Named by reference, since the workers' own scratch is another object
+  auto &baseband = scratch;
+  auto &[ai, aq, bi, bq] = baseband;
+  Scheduler::getInstance().parallelFor(
+      Priority::Interactive, "zoomBaseband", 2, 1,
+      [&](size_t first, size_t last) {
+        for (size_t channel = first; channel < last; ++channel) {
+          basebandChannel(channel == 0 ? a : b, centre / sampleRate,
+                          decimation, baseband[2 * channel],
+                          baseband[2 * channel + 1]);
+        }
+      });
+  const size_t N = std::min(ai.size(), bi.size());
+  if (N < 10 || stop.stop_requested()) {
+    res.windowSize = 0;
+    return rate;
+  }
+
+  windowSize = std::min(windowSize, N);
+  const size_t stride = std::max<size_t>(windowSize * OVERLAP, 1);
+  const auto window = windowCoefficients<float>(windowFn, windowSize);
+  const auto &plan = complexFft<float>(windowSize);
+
+  // Signed bins k (frequency centre + k * binWidth) that fall in the band
+  const double binWidth = rate / windowSize;
+  const auto half = static_cast<ptrdiff_t>(windowSize / 2);
+  const auto firstBin = std::max<ptrdiff_t>(
+      -half, std::ceil((low - centre) / binWidth));
+  const auto lastBin = std::min<ptrdiff_t>(
+      half - 1 + static_cast<ptrdiff_t>(windowSize % 2),
+      std::floor((high - centre) / binWidth));
+  const size_t bins = std::max<ptrdiff_t>(lastBin - firstBin + 1, 0);
+  res.windowSize = windowSize;
+  res.startFrequency = centre + firstBin * binWidth;
+  res.saa.assign(bins, 0.);
+  res.sbb.assign(bins, 0.);
+  res.sab.assign(bins, {0., 0.});
+
+  const size_t segmentCount = (N - windowSize + stride + stride - 1) / stride;
+  std::mutex mergeLock;
+  spectrumPasses(
+      segmentCount, res, stop, progress,
+      [&](size_t offset, size_t spacing, size_t first, size_t last) {
+        auto *inA = complexScratch<float, 0>(windowSize);
+        auto *inB = complexScratch<float, 1>(windowSize);
+        auto *outA = complexScratch<float, 2>(windowSize);
+        auto *outB = complexScratch<float, 3>(windowSize);
+        thread_local std::vector<float> accumulators;
+        accumulators.assign(4 * bins, 0.f);
+        float *__restrict saa = accumulators.data();
+        float *__restrict sbb = saa + bins;
+        float *__restrict sabRe = sbb + bins;
+        float *__restrict sabIm = sabRe + bins;
+
+        size_t done = 0;
+        for (size_t index = first; index < last; ++index, ++done) {
+          if (stop.stop_requested()) {
+            break;
+          }
+          const size_t left = (offset + index * spacing) * stride;
+          const size_t valid = std::min(windowSize, N - left);
+          for (size_t n = 0; n < valid; ++n) {
+            inA[n][0] = window[n] * ai[left + n];
+            inA[n][1] = window[n] * aq[left + n];
+            inB[n][0] = window[n] * bi[left + n];
+            inB[n][1] = window[n] * bq[left + n];
+          }
+          for (size_t n = valid; n < windowSize; ++n) {
+            inA[n][0] = inA[n][1] = inB[n][0] = inB[n][1] = 0.f;
+          }
+          plan.execute(inA, outA);
+          plan.execute(inB, outB);
+
+          for (size_t i = 0; i < bins; ++i) {
+            const ptrdiff_t k = firstBin + static_cast<ptrdiff_t>(i);
+            const size_t at = k < 0 ? k + windowSize : k;
+            const float ar = outA[at][0], aim = outA[at][1];
+            const float br = outB[at][0], bim = outB[at][1];
+            saa[i] += ar * ar + aim * aim;
+            sbb[i] += br * br + bim * bim;
+            sabRe[i] += ar * br + aim * bim;
+            sabIm[i] += aim * br - ar * bim;
+          }
+        }
+
+        std::unique_lock temp{mergeLock};
+        for (size_t i = 0; i < bins; ++i) {
+          res.saa[i] += saa[i];
+          res.sbb[i] += sbb[i];
+          res.sab[i] += std::complex<double>(sabRe[i], sabIm[i]);
+        }
+        res.segments += done;
+      });
+  return rate;
+}
@@ -0,0 +1,49 @@
+#include "average.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(AverageTest, LinearAveragesPower) {
+  SpectrumAverager average{AveragingMode::Linear, 4};
+  // 10 dB and 20 dB average to 55 in power, not 15 dB
+  average.update(std::vector{10., 0.});
+  average.update(std::vector{20., 0.});
+  ASSERT_EQ(average.values().size(), 2);
+  EXPECT_NEAR(average.values()[0], 10 * std::log10(55.), 1e-9);
+  EXPECT_NEAR(average.values()[1], 0., 1e-9);
+  EXPECT_EQ(average.updates(), 2);
+}
+
+TEST(AverageTest, ExponentialConverges) {
+  SpectrumAverager average{AveragingMode::Exponential, 1, 0.5};
+  average.update(std::vector{0.});
+  for (int i = 0; i < 40; ++i) {
+    average.update(std::vector{10.});
+  }
+  EXPECT_NEAR(average.values()[0], 10., 1e-6);
+}
+
+TEST(AverageTest, HoldsKeepExtremes) {
+  SpectrumAverager peak{AveragingMode::PeakHold};
+  SpectrumAverager min{AveragingMode::MinHold};
+  for (auto frame : {std::vector{-50., -10.}, std::vector{-20., -60.},
+                     std::vector{-40., -30.}}) {
+    peak.update(frame);
+    min.update(frame);
+  }
+  EXPECT_EQ(peak.values(), (std::vector{-20., -10.}));
+  EXPECT_EQ(min.values(), (std::vector{-50., -60.}));
+}
+
+TEST(AverageTest, RestartsOnResetAndSizeChange) {
+  SpectrumAverager peak{AveragingMode::PeakHold};
+  peak.update(std::vector{0., 0.});
+  peak.reset();
+  peak.update(std::vector{-10., -10.});
+  EXPECT_EQ(peak.values(), (std::vector{-10., -10.}));
+
+  peak.update(std::vector{-30., -30., -30.});
+  EXPECT_EQ(peak.values(), (std::vector{-30., -30., -30.}));
+  EXPECT_EQ(peak.updates(), 1);
+}
@@ -0,0 +1,94 @@
+#include "codec.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <random>
+#include <vector>
+
+namespace {
+// 8-bit codes scaled to 16 bits as the driver streams them, times the
+// volts per code of the 10 V range
+constexpr float STEP = static_cast<float>(10. / 32767);
+
+std::vector<float> adcSignal(size_t n, int noise) {
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int> jitter(-noise, noise);
+  std::vector<float> res(n);
+  for (size_t i = 0; i < n; ++i) {
+    const int code = static_cast<int>(
+        std::round(100 * std::sin(2 * std::numbers::pi * i / 500.)));
+    res[i] = (std::clamp(code + jitter(gen), -127, 127) << 8) * STEP;
+  }
+  return res;
+}
+
+void expectBitExact(const std::vector<float> &a, const std::vector<float> &b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    ASSERT_EQ(std::bit_cast<uint32_t>(a[i]), std::bit_cast<uint32_t>(b[i]))
+        << "at " << i;
+  }
+}
+} // namespace
+
+TEST(CodecTest, RoundTripsAdcSamples) {
+  for (int noise : {0, 3, 127}) {
+    // A short last frame as well as whole ones
+    const auto samples = adcSignal(20 * CODEC_FRAME + 37, noise);
+    std::vector<uint32_t> packed;
+    ASSERT_TRUE(packSamples(samples, STEP, packed));
+    ASSERT_EQ(packedCount(packed.data()), samples.size());
+    std::vector<float> out(samples.size());
+    unpackSamples(packed.data(), 0, out);
+    expectBitExact(out, samples);
+    // 8-bit codes take at most 9 bits as differences
+    EXPECT_LT(packed.size() * 3, samples.size()) << "noise " << noise;
+  }
+}
+
+TEST(CodecTest, UnpacksAnyRange) {
+  const auto samples = adcSignal(10 * CODEC_FRAME, 5);
+  std::vector<uint32_t> packed;
+  ASSERT_TRUE(packSamples(samples, STEP, packed));
+  for (auto [first, n] : {std::pair<size_t, size_t>{0, 1},
+                          {CODEC_FRAME - 1, 2},
+                          {3 * CODEC_FRAME + 5, 4 * CODEC_FRAME},
+                          {10 * CODEC_FRAME - 1, 1}}) {
+    std::vector<float> out(n);
+    unpackSamples(packed.data(), first, out);
+    expectBitExact(out, {samples.begin() + first,
+                         samples.begin() + first + n});
+  }
+}
+
+TEST(CodecTest, HandlesEveryBitWidth) {
+  // Codes spanning up to 2^21 exercise widths up to 22 bits in both modes
+  std::mt19937 gen(5);
+  for (int width = 0; width <= 22; ++width) {
+    std::uniform_int_distribution<int32_t> code(-(1 << width) / 2,
+                                                (1 << width) / 2);
+    std::vector<float> samples(4 * CODEC_FRAME);
+    for (auto &x : samples) {
+      x = static_cast<float>(code(gen)) * 0.5f;
+    }
+    std::vector<uint32_t> packed;
+    ASSERT_TRUE(packSamples(samples, 0.5f, packed)) << "width " << width;
+    std::vector<float> out(samples.size());
+    unpackSamples(packed.data(), 0, out);
+    expectBitExact(out, samples);
+  }
+}
+
+TEST(CodecTest, RejectsSamplesOffTheQuantum) {
+  auto samples = adcSignal(4 * CODEC_FRAME, 3);
+  std::vector<uint32_t> packed;
+  EXPECT_FALSE(packSamples(samples, 0.f, packed));
+  samples[200] += STEP / 3;
+  EXPECT_FALSE(packSamples(samples, STEP, packed));
+  samples[200] = NAN;
+  EXPECT_FALSE(packSamples(samples, STEP, packed));
+  // Codes too large to round exactly
+  samples[200] = STEP * (1 << 23);
+  EXPECT_FALSE(packSamples(samples, STEP, packed));
+}
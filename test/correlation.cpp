@@ -0,0 +1,88 @@
+#include "correlation.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <random>
+#include <vector>
+
+namespace {
+// Sum of random low frequency tones, evaluated at t - delay so that a
+// fractional delay is exact.
+std::vector<float> tones(size_t n, double delay) {
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> freq(0.001, 0.1), phase(0., 6.);
+  std::vector<std::pair<double, double>> components(32);
+  for (auto &[f, p] : components) {
+    f = freq(gen);
+    p = phase(gen);
+  }
+  std::vector<float> res(n);
+  for (size_t i = 0; i < n; ++i) {
+    for (auto [f, p] : components) {
+      res[i] += std::sin(2 * std::numbers::pi * f * (i - delay) + p);
+    }
+  }
+  return res;
+}
+
+std::vector<float> noise(size_t n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<float> dist;
+  std::vector<float> res(n);
+  for (auto &e : res) {
+    e = dist(gen);
+  }
+  return res;
+}
+} // namespace
+
+TEST(CorrelationTest, FindsIntegerDelayBothWays) {
+  auto b = noise(1 << 14, 1);
+  std::vector<float> a(b.size());
+  for (size_t i = 7; i < a.size(); ++i) {
+    a[i] = 0.5f * b[i - 7];
+  }
+  CrossCorrelator correlator;
+  auto lagging = correlator.estimate(a, b, 100);
+  ASSERT_TRUE(lagging.valid);
+  EXPECT_EQ(lagging.lag, 7);
+  EXPECT_NEAR(lagging.delay, 7., 0.1);
+  EXPECT_GT(lagging.peak, 0.95);
+  EXPECT_EQ(correlator.correlation().size(), 201);
+
+  auto leading = correlator.estimate(b, a, 100);
+  EXPECT_EQ(leading.lag, -7);
+}
+
+TEST(CorrelationTest, InterpolatesFractionalDelay) {
+  auto a = tones(1 << 13, 2.3);
+  auto b = tones(1 << 13, 0.);
+  CrossCorrelator correlator;
+  EXPECT_NEAR(correlator.estimate(a, b, 50).delay, 2.3, 0.1);
+}
+
+TEST(CorrelationTest, PhatSharpensColouredPeak) {
+  // Low-pass noise gives a broad plain correlation peak; whitening the
+  // cross spectrum leaves a narrow one at the same lag.
+  auto white = noise(1 << 14, 1);
+  std::vector<float> b(white.size()), a(white.size());
+  float state = 0.f;
+  for (size_t i = 0; i < b.size(); ++i) {
+    b[i] = state = 0.95f * state + white[i];
+  }
+  for (size_t i = 12; i < a.size(); ++i) {
+    a[i] = b[i - 12];
+  }
+
+  CrossCorrelator correlator;
+  const auto plain = correlator.estimate(a, b, 200);
+  const float plainNeighbour = correlator.correlation()[200 + 15];
+  correlator.setWeighting(CorrelationWeighting::Phat);
+  const auto phat = correlator.estimate(a, b, 200);
+  const float phatNeighbour = correlator.correlation()[200 + 15];
+
+  EXPECT_EQ(plain.lag, 12);
+  EXPECT_EQ(phat.lag, 12);
+  EXPECT_LT(phatNeighbour / phat.peak, 0.2 * plainNeighbour / plain.peak);
+}
@@ -0,0 +1,183 @@
+#include "envelope.hpp"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace {
+std::vector<float> noise(size_t n) {
+  std::mt19937 gen(3);
+  std::normal_distribution<float> dist;
+  std::vector<float> res(n);
+  for (auto &e : res) {
+    e = dist(gen);
+  }
+  return res;
+}
+
+void expectExact(const std::vector<float> &data,
+                 const std::vector<EnvelopeBucket> &buckets) {
+  for (const auto &bucket : buckets) {
+    auto [min, max] = std::minmax_element(
+        data.begin() + bucket.first,
+        data.begin() + bucket.first + bucket.count);
+    EXPECT_EQ(bucket.min, *min);
+    EXPECT_EQ(bucket.max, *max);
+  }
+}
+} // namespace
+
+TEST(EnvelopeTest, BucketsMatchBruteForce) {
+  // Appended in uneven blocks, ending mid-block at every level
+  auto data = noise(123457);
+  EnvelopePyramid pyramid;
+  for (size_t at = 0; at < data.size(); at += 997) {
+    const size_t n = std::min<size_t>(997, data.size() - at);
+    pyramid.append(std::span(data).subspan(at, n));
+  }
+  ASSERT_EQ(pyramid.size(), data.size());
+  ASSERT_GT(pyramid.levelCount(), 4);
+
+  std::vector<EnvelopeBucket> buckets;
+  for (size_t pixels : {100, 500, 1000, 3000}) {
+    for (auto [first, last] : {std::pair<size_t, size_t>{0, data.size()},
+                               {1234, 98765},
+                               {100000, 200000}}) {
+      const size_t end = std::min(last, data.size());
+      if ((end - first) / pixels < ENVELOPE_BLOCK) {
+        EXPECT_FALSE(pyramid.envelope(first, last, pixels, buckets));
+        continue;
+      }
+      ASSERT_TRUE(pyramid.envelope(first, last, pixels, buckets));
+      ASSERT_FALSE(buckets.empty());
+      EXPECT_LE(buckets.front().first, first);
+      EXPECT_GE(buckets.back().first + buckets.back().count, end);
+      EXPECT_LE(buckets.size(), pixels + 2);
+      expectExact(data, buckets);
+    }
+  }
+}
+
+TEST(EnvelopeTest, GlitchSurvivesEveryZoomLevel) {
+  std::vector<float> data(1 << 20, 0.f);
+  data[654321] = 5.f;
+  data[654322] = -5.f;
+  EnvelopePyramid pyramid;
+  pyramid.append(data);
+
+  std::vector<EnvelopeBucket> buckets;
+  for (size_t span = 1 << 20; span >= 1 << 14; span /= 2) {
+    const size_t first = 654321 - span / 3;
+    ASSERT_TRUE(pyramid.envelope(first, first + span, 800, buckets));
+    auto max = std::ranges::max(buckets, {}, &EnvelopeBucket::max);
+    auto min = std::ranges::min(buckets, {}, &EnvelopeBucket::min);
+    EXPECT_EQ(max.max, 5.f);
+    EXPECT_EQ(min.min, -5.f);
+  }
+}
+
+TEST(EnvelopeTest, FineRangesFallBackToRaw) {
+  auto data = noise(10000);
+  EnvelopePyramid pyramid;
+  pyramid.append(data);
+  std::vector<EnvelopeBucket> buckets;
+  EXPECT_FALSE(pyramid.envelope(0, 1000, 1000, buckets));
+  EXPECT_TRUE(buckets.empty());
+  EXPECT_TRUE(pyramid.envelope(5000, 5000, 1000, buckets));
+  EXPECT_TRUE(buckets.empty());
+
+  pyramid.clear();
+  EXPECT_EQ(pyramid.size(), 0);
+  EXPECT_TRUE(pyramid.envelope(0, 10000, 100, buckets));
+  EXPECT_TRUE(buckets.empty());
+}
+
+TEST(EnvelopeTest, DiscardKeepsRetainedRangeExact) {
+  auto data = noise(200000);
+  EnvelopePyramid pyramid;
+  pyramid.clear(1000);
+  pyramid.append(data);
+  EXPECT_EQ(pyramid.endIndex(), 201000);
+  pyramid.discard(101000);
+
+  std::vector<EnvelopeBucket> buckets;
+  ASSERT_TRUE(pyramid.envelope(101000, 201000, 500, buckets));
+  ASSERT_FALSE(buckets.empty());
+  for (const auto &bucket : buckets) {
+    // Index i of the pyramid holds data[i - 1000]; the first bucket may
+    // start before the retained range but only what is kept counts
+    const size_t first = std::max<size_t>(bucket.first, 101000) - 1000;
+    const size_t last = bucket.first + bucket.count - 1000;
+    auto [min, max] =
+        std::minmax_element(data.begin() + first, data.begin() + last);
+    if (bucket.first >= 101000) {
+      EXPECT_EQ(bucket.min, *min);
+      EXPECT_EQ(bucket.max, *max);
+    } else {
+      EXPECT_LE(bucket.min, *min);
+      EXPECT_GE(bucket.max, *max);
+    }
+  }
+}
+
+TEST(PeakPyramidTest, BucketsMatchBruteForce) {
+  // Odd sizes leave a partial block at the end of every level
+  const auto data = noise(262145);
+  const std::vector<double> series(data.begin(), data.end());
+  PeakPyramid pyramid;
+  pyramid.assign(series);
+  ASSERT_EQ(pyramid.size(), data.size());
+  ASSERT_GT(pyramid.levelCount(), 4);
+
+  std::vector<EnvelopeBucket> buckets;
+  for (size_t pixels : {100, 1000, 1920}) {
+    for (auto [first, last] : {std::pair<size_t, size_t>{0, data.size()},
+                               {1234, 98765},
+                               {262000, 300000}}) {
+      const size_t end = std::min(last, data.size());
+      pyramid.reduce(first, last, pixels, buckets);
+      ASSERT_FALSE(buckets.empty());
+      EXPECT_LE(buckets.front().first, first);
+      EXPECT_GE(buckets.back().first + buckets.back().count, end);
+      EXPECT_LE(buckets.size(), pixels + 1);
+      expectExact(data, buckets);
+    }
+  }
+}
+
+TEST(PeakPyramidTest, SpurSurvivesEveryZoomLevel) {
+  std::vector<double> series(1 << 18, -90.);
+  series[123457] = -10.;
+  PeakPyramid pyramid;
+  pyramid.assign(series);
+
+  std::vector<EnvelopeBucket> buckets;
+  for (size_t span = 1 << 18; span >= 64; span /= 2) {
+    const size_t first = 123457 - span / 3;
+    pyramid.reduce(first, first + span, 800, buckets);
+    auto max = std::ranges::max(buckets, {}, &EnvelopeBucket::max);
+    EXPECT_EQ(max.max, -10.f);
+    EXPECT_EQ(std::ranges::min(buckets, {}, &EnvelopeBucket::min).min, -90.f);
+  }
+}
+
+TEST(PeakPyramidTest, FewBinsAreTheirOwnBuckets) {
+  const std::vector<double> series = {1., 5., 2., 4., 3.};
+  PeakPyramid pyramid;
+  pyramid.assign(series);
+  std::vector<EnvelopeBucket> buckets;
+  pyramid.reduce(1, 4, 100, buckets);
+  ASSERT_EQ(buckets.size(), 3);
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(buckets[i].first, i + 1);
+    EXPECT_EQ(buckets[i].count, 1);
+    EXPECT_EQ(buckets[i].min, series[i + 1]);
+    EXPECT_EQ(buckets[i].max, series[i + 1]);
+  }
+
+  pyramid.assign({});
+  EXPECT_EQ(pyramid.size(), 0);
+  pyramid.reduce(0, 10, 100, buckets);
+  EXPECT_TRUE(buckets.empty());
+}
@@ -0,0 +1,89 @@
+#include "filters.hpp"
+#include "signals.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+constexpr double FS = 50e3;
+
+// Feeds the stage in uneven blocks and returns the settled second half
+std::vector<float> run(FilterStage &stage, std::vector<float> data) {
+  for (size_t i = 0; i < data.size(); i += 333) {
+    const size_t n = std::min<size_t>(333, data.size() - i);
+    stage.process(std::span(data).subspan(i, n));
+  }
+  return {data.begin() + data.size() / 2, data.end()};
+}
+} // namespace
+
+TEST(FilterTest, ButterworthLowPass) {
+  auto sections = butterworth(FilterType::LowPass, 4, 1000, FS);
+  ASSERT_EQ(sections.size(), 2);
+  BiquadCascade pass{sections}, cutoff{sections}, stop{sections};
+  EXPECT_NEAR(rms(run(pass, tone(50000, 100 / FS))), std::sqrt(0.5), 1e-3);
+  // -3 dB at the corner
+  EXPECT_NEAR(rms(run(cutoff, tone(50000, 1000 / FS))), 0.5, 1e-2);
+  // 4th order: -80 dB two decades above
+  EXPECT_LT(rms(run(stop, tone(50000, 10000 / FS))), 1e-3);
+}
+
+TEST(FilterTest, MainsNotch) {
+  FilterSpec spec{FilterType::Notch, 50., 5., 2};
+  auto notch = makeFilter(spec, FS);
+  auto other = makeFilter(spec, FS);
+  EXPECT_LT(rms(run(*notch, tone(200000, 50 / FS))), 1e-2);
+  EXPECT_NEAR(rms(run(*other, tone(200000, 1000 / FS))), std::sqrt(0.5), 1e-2);
+}
+
+TEST(FilterTest, OverlapSaveMatchesDirect) {
+  auto kernel = std::vector<double>(201);
+  for (size_t i = 0; i < kernel.size(); ++i) {
+    kernel[i] = std::sin(0.1 * i) / (i + 1);
+  }
+  auto data = tone(20000, 1234 / FS);
+  auto reference = data;
+  // Direct convolution
+  for (size_t n = 0; n < data.size(); ++n) {
+    double acc = 0;
+    for (size_t k = 0; k < kernel.size() && k <= n; ++k) {
+      acc += kernel[k] * data[n - k];
+    }
+    reference[n] = acc;
+  }
+
+  FirFilter fir{kernel};
+  ASSERT_GT(fir.latency(), 0);
+  auto filtered = data;
+  for (size_t i = 0; i < filtered.size(); i += 500) {
+    fir.process(std::span(filtered).subspan(i, 500));
+  }
+  for (size_t n = fir.latency(); n < data.size(); n += 37) {
+    EXPECT_NEAR(filtered[n], reference[n - fir.latency()], 1e-4) << n;
+  }
+}
+
+TEST(FilterTest, DcBlockerRemovesOffset) {
+  DcBlocker blocker{5., FS};
+  auto out = run(blocker, tone(200000, 1000 / FS, 1., 2.5));
+  double mean = 0;
+  for (auto e : out) {
+    mean += e;
+  }
+  EXPECT_NEAR(mean / out.size(), 0., 1e-3);
+  EXPECT_NEAR(rms(out), std::sqrt(0.5), 1e-2);
+}
+
+TEST(FilterTest, ChainReportsPerStageCost) {
+  std::vector<FilterSpec> specs{{FilterType::DcBlock, 5.},
+                                {FilterType::FirLowPass, 5000., 0.7, 2, 255}};
+  FilterChain chain{specs, FS};
+  auto data = tone(100000, 100 / FS);
+  chain.process(data);
+  auto stats = chain.stats(FS);
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_GT(stats[1].nsPerSample, 0.);
+  EXPECT_GT(stats[1].latency, 0);
+  EXPECT_EQ(stats[0].latency, 0);
+}
@@ -0,0 +1,259 @@
+#include "ingest.hpp"
+#include "signals.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+constexpr double RATE = 1000.;
+
+// Waits for the snapshot published once everything posted has been applied
+const IngestSnapshot &synced(Ingest &ingest) {
+  ingest.sync();
+  EXPECT_TRUE(ingest.acquire());
+  return ingest.current();
+}
+} // namespace
+
+TEST(IngestTest, PublishesAppendedSamples) {
+  Ingest ingest{RATE};
+  EXPECT_FALSE(ingest.acquire());
+  ingest.append(ramp(0, 100), ramp(1000, 100));
+  ingest.setView({.start = 0.01, .end = 0.05, .pixels = 100});
+  const auto &s = synced(ingest);
+  EXPECT_EQ(s.firstIndex, 0);
+  EXPECT_EQ(s.endIndex, 100);
+  EXPECT_DOUBLE_EQ(s.sampleInterval, 1. / RATE);
+  // Few samples per pixel are shared as they are
+  for (size_t i = 0; i < 2; ++i) {
+    const auto &trace = s.traces[i];
+    EXPECT_FALSE(trace.envelope);
+    EXPECT_EQ(trace.first, 10);
+    ASSERT_EQ(trace.samples.size(), 40);
+    EXPECT_EQ(trace.samples.front(), 1000 * i + 10);
+  }
+  EXPECT_DOUBLE_EQ(s.window[0].max, 49.);
+  EXPECT_DOUBLE_EQ(s.stream[0].max, 99.);
+  // Nothing new was published since
+  EXPECT_FALSE(ingest.acquire());
+}
+
+TEST(IngestTest, SharesEnvelopesWhenZoomedOut) {
+  Ingest ingest{RATE};
+  const size_t n = 1 << 16;
+  ingest.append(ramp(0, n), ramp(0, n));
+  ingest.setView({.start = 0., .end = n / RATE, .pixels = 64});
+  const auto &s = synced(ingest);
+  const auto &trace = s.traces[0];
+  ASSERT_TRUE(trace.envelope);
+  EXPECT_TRUE(trace.samples.empty());
+  EXPECT_LE(trace.buckets.size(), 66);
+  EXPECT_EQ(trace.buckets.front().min, 0.f);
+  EXPECT_EQ(trace.buckets.back().max, static_cast<float>(n - 1));
+}
+
+TEST(IngestTest, SharesVisibleSamplesOnRequest) {
+  Ingest ingest{RATE};
+  ingest.append(ramp(0, 500), ramp(0, 500));
+  ingest.setView({.start = 0.1, .end = 0.3});
+  EXPECT_TRUE(synced(ingest).visible[0].empty());
+
+  const auto request = ingest.requestVisible();
+  const auto &s = synced(ingest);
+  EXPECT_EQ(s.visibleRequest, request);
+  ASSERT_EQ(s.visible[0].size(), 200);
+  EXPECT_EQ(s.visible[0].firstIndex(), 100);
+  EXPECT_EQ(s.visible[1][0], 100.f);
+
+  // Later snapshots keep the answer rather than taking new samples
+  ingest.append(ramp(500, 100), ramp(500, 100));
+  ingest.setView({.start = 0.1, .end = 0.5});
+  const auto &later = synced(ingest);
+  EXPECT_EQ(later.visibleRequest, request);
+  EXPECT_EQ(later.visible[0].size(), 200);
+
+  // A limited request keeps the newest samples of the view
+  const auto limited = ingest.requestVisible(150);
+  const auto &last = synced(ingest);
+  EXPECT_EQ(last.visibleRequest, limited);
+  ASSERT_EQ(last.visible[0].size(), 150);
+  EXPECT_EQ(last.visible[0].firstIndex(), 350);
+}
+
+TEST(IngestTest, DisplaysDecimatedSamples) {
+  Ingest ingest{RATE};
+  ingest.append(ramp(0, 4000), ramp(0, 4000));
+  ingest.setDecimation(4);
+  ingest.setView({.start = 0., .end = 4., .pixels = 2000});
+  const auto &s = synced(ingest);
+  EXPECT_EQ(s.decimation, 4);
+  EXPECT_DOUBLE_EQ(s.sampleInterval, 4. / RATE);
+  // Raw indices are unaffected
+  EXPECT_EQ(s.endIndex, 4000);
+  EXPECT_FALSE(s.traces[0].envelope);
+  EXPECT_NEAR(static_cast<double>(s.traces[0].samples.size()), 1000., 16.);
+
+  ingest.clear();
+  EXPECT_EQ(synced(ingest).endIndex, 0);
+}
+
+TEST(IngestTest, TakesBlocksFromStream) {
+  auto [send, recv] = mpsc::make<StreamResult>();
+  Ingest ingest{RATE};
+  ingest.attach(std::move(recv));
+  for (uint64_t first = 0; first < 1000; first += 250) {
+    send.send(StreamResult{ramp(first, 250), ramp(first, 250), first});
+  }
+  // Blocks arrive at the thread's own pace; sync only orders commands
+  size_t end = 0;
+  for (int i = 0; i < 200 && end < 1000; ++i) {
+    end = synced(ingest).endIndex;
+    if (end < 1000) {
+      std::this_thread::sleep_for(5ms);
+    }
+  }
+  EXPECT_EQ(end, 1000);
+  ingest.detach();
+}
+
+TEST(IngestTest, TracksSweepFromItsFirstSample) {
+  // Channel A is half of channel B once the generator runs, and twice it
+  // in the blocks streamed before
+  constexpr uint64_t STREAMED = 5000;
+  constexpr size_t LEAD = 300;
+  const SweepSchedule schedule{50., 150., 50., 0.2, SweepDirection::Up,
+                               STREAMED + LEAD};
+  const size_t dwell = schedule.dwell * RATE;
+  std::vector<Sample> a(LEAD + dwell * schedule.steps()), b(a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    const double f =
+        i < LEAD ? 80. : schedule.frequency((i - LEAD) / dwell);
+    b[i] = static_cast<Sample>(std::sin(2 * std::numbers::pi * f * i / RATE));
+    a[i] = (i < LEAD ? 2.f : 0.5f) * b[i];
+  }
+
+  auto [send, recv] = mpsc::make<StreamResult>();
+  Ingest ingest{RATE};
+  ingest.attach(std::move(recv));
+  ingest.trackSweep(schedule);
+  ingest.sync();
+  for (size_t first = 0; first < a.size(); first += 100) {
+    send.send(StreamResult{
+        std::vector(a.begin() + first, a.begin() + first + 100),
+        std::vector(b.begin() + first, b.begin() + first + 100),
+        STREAMED + first});
+  }
+  size_t end = 0;
+  for (int i = 0; i < 200 && end < a.size(); ++i) {
+    end = synced(ingest).endIndex;
+    if (end < a.size()) {
+      std::this_thread::sleep_for(5ms);
+    }
+  }
+  ASSERT_EQ(end, a.size());
+  const auto &s = ingest.current();
+  EXPECT_TRUE(s.sweeping);
+  ASSERT_EQ(s.bode.size(), schedule.steps());
+  for (const auto &point : s.bode) {
+    EXPECT_NEAR(point.magnitude, 20 * std::log10(0.5), 0.05)
+        << point.frequency;
+  }
+
+  // Stopping the sweep drops its points
+  ingest.trackSweep(std::nullopt);
+  EXPECT_FALSE(synced(ingest).sweeping);
+  EXPECT_TRUE(ingest.current().bode.empty());
+  ingest.detach();
+}
+
+TEST(IngestTest, ReaderNeverSeesOlderSnapshots) {
+  constexpr size_t TOTAL = 100000;
+  Ingest ingest{RATE};
+  ingest.setView({.start = 0., .end = 1., .pixels = 100});
+  size_t regressions = 0;
+  // Reads until the last block shows up, which sync() below guarantees
+  std::thread reader([&ingest, &regressions] {
+    size_t last = 0;
+    while (last < TOTAL) {
+      if (!ingest.acquire()) {
+        std::this_thread::yield();
+        continue;
+      }
+      const auto &s = ingest.current();
+      if (s.endIndex < last) {
+        ++regressions;
+      }
+      last = s.endIndex;
+      // A trace is never built past the samples it was published with
+      if (s.traces[0].points() > s.endIndex) {
+        ++regressions;
+      }
+    }
+  });
+  for (size_t first = 0; first < TOTAL; first += 100) {
+    ingest.append(ramp(first, 100), ramp(first, 100));
+    if (first % 10000 == 0) {
+      ingest.sync();
+    }
+  }
+  ingest.sync();
+  reader.join();
+  EXPECT_EQ(regressions, 0);
+}
+
+TEST(IngestTest, PublishesPersistenceWhileOn) {
+  Ingest ingest{RATE};
+  // Rising crossings of 0 every 100 samples
+  std::vector<Sample> square(1000);
+  for (size_t i = 0; i < square.size(); ++i) {
+    square[i] = i % 100 < 50 ? -1.f : 1.f;
+  }
+  ingest.append(square, square);
+  EXPECT_EQ(synced(ingest).persistence, nullptr);
+
+  ingest.setPersistence(PersistenceSettings{
+      .channel = 1, .length = 64, .pretrigger = 16, .halfLife = 0.});
+  ingest.append(square, square);
+  const auto image = synced(ingest).persistence;
+  ASSERT_NE(image, nullptr);
+  EXPECT_EQ(image->sweeps, 10);
+  EXPECT_EQ(image->peak, 10.f);
+  EXPECT_EQ(image->data.size(), image->rows * image->columns);
+  EXPECT_DOUBLE_EQ(image->startTime, -16 / RATE);
+
+  // Unchanged settings keep the sweeps; nothing new shares the image
+  ingest.setPersistence(PersistenceSettings{
+      .channel = 1, .length = 64, .pretrigger = 16, .halfLife = 0.});
+  EXPECT_EQ(synced(ingest).persistence->sweeps, 10);
+  ingest.setPersistence(std::nullopt);
+  EXPECT_EQ(synced(ingest).persistence, nullptr);
+}
+
+TEST(IngestTest, ReusesPersistenceImages) {
+  Ingest ingest{RATE};
+  ingest.setPersistence(PersistenceSettings{.length = 64, .pretrigger = 16});
+  std::vector<Sample> square(1000);
+  for (size_t i = 0; i < square.size(); ++i) {
+    square[i] = i % 100 < 50 ? -1.f : 1.f;
+  }
+  ingest.append(square, square);
+  const auto held = synced(ingest).persistence;
+  const auto heldData = held->data;
+  // Images are only held by the snapshots, so a handful serve every publish
+  std::set<const PersistenceImage *> images;
+  for (int i = 0; i < 20; ++i) {
+    ingest.append(square, square);
+    images.insert(synced(ingest).persistence.get());
+  }
+  EXPECT_LE(images.size(), 5);
+  // and one still held elsewhere is never refilled
+  EXPECT_FALSE(images.contains(held.get()));
+  EXPECT_EQ(held->sweeps, 10);
+  EXPECT_EQ(held->data, heldData);
+}
@@ -0,0 +1,142 @@
+#include "measure.hpp"
+#include "processing.hpp"
+#include "signals.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <random>
+#include <vector>
+
+namespace {
+constexpr double FS = 50e3;
+} // namespace
+
+TEST(MeasureTest, WindowMatchesDirectComputation) {
+  auto data = tone(100000, 1234.5 / FS, 2., 0.25);
+  ChannelStats stats{0.05, 1 / FS};
+  for (size_t i = 0; i < data.size(); i += 999) {
+    const size_t n = std::min<size_t>(999, data.size() - i);
+    stats.append(std::span(data).subspan(i, n));
+  }
+
+  for (auto [left, right] : {std::pair<size_t, size_t>{0, 100000},
+                             {123, 4000},
+                             {5000, 77777},
+                             {8192, 16384}}) {
+    double sum = 0, sumSq = 0;
+    float lo = data[left], hi = data[left];
+    for (size_t i = left; i < right; ++i) {
+      sum += data[i];
+      sumSq += (double)data[i] * data[i];
+      lo = std::min(lo, data[i]);
+      hi = std::max(hi, data[i]);
+    }
+    const size_t n = right - left;
+    auto m = stats.window(data, left, right);
+    EXPECT_EQ(m.count, n);
+    EXPECT_NEAR(m.mean, sum / n, 1e-9);
+    EXPECT_NEAR(m.rms, std::sqrt(sumSq / n), 1e-9);
+    EXPECT_EQ(m.min, lo);
+    EXPECT_EQ(m.max, hi);
+    EXPECT_NEAR(m.frequency, 1234.5, 1.) << left << ".." << right;
+  }
+}
+
+TEST(MeasureTest, StoreWindowMatchesSpanWindow) {
+  auto data = tone(300000, 1234.5 / FS, 2., 0.25);
+  ChannelStats stats{0.05, 1 / FS};
+  SampleStore store{100000};
+  stats.append(data);
+  store.append(data);
+
+  // Windows across chunk boundaries; the dropped head is not measured
+  for (auto [left, right] : {std::pair<size_t, size_t>{200000, 300000},
+                             {store.firstIndex() + 17, 250001},
+                             {0, 300000}}) {
+    auto fromStore = stats.window(store, left, right);
+    auto fromSpan =
+        stats.window(data, std::max(left, store.firstIndex()), right);
+    EXPECT_EQ(fromStore.count, fromSpan.count);
+    EXPECT_DOUBLE_EQ(fromStore.mean, fromSpan.mean);
+    EXPECT_DOUBLE_EQ(fromStore.rms, fromSpan.rms);
+    EXPECT_EQ(fromStore.min, fromSpan.min);
+    EXPECT_EQ(fromStore.max, fromSpan.max);
+    EXPECT_EQ(fromStore.frequency, fromSpan.frequency);
+  }
+}
+
+TEST(MeasureTest, DiscardKeepsRetainedWindows) {
+  auto data = tone(300000, 1234.5 / FS, 2., 0.25);
+  ChannelStats stats{0.05, 1 / FS};
+  SampleStore store{100000};
+  stats.append(data);
+  store.append(data);
+  const auto full = stats;
+  stats.discard(store.firstIndex());
+
+  for (auto [left, right] : {std::pair<size_t, size_t>{200000, 300000},
+                             {store.firstIndex() + 17, 250001},
+                             {0, 300000}}) {
+    auto kept = stats.window(store, left, right);
+    auto reference = full.window(store, left, right);
+    EXPECT_EQ(kept.count, reference.count);
+    EXPECT_DOUBLE_EQ(kept.mean, reference.mean);
+    EXPECT_EQ(kept.min, reference.min);
+    EXPECT_EQ(kept.frequency, reference.frequency);
+  }
+  EXPECT_NEAR(stats.stream().frequency, 1234.5, 1.);
+}
+
+TEST(MeasureTest, StreamTracksLatestFrequency) {
+  ChannelStats stats{0.05, 1 / FS};
+  stats.append(tone(50000, 500 / FS, 1.));
+  stats.append(tone(50000, 2000 / FS, 1.));
+  auto m = stats.stream();
+  EXPECT_EQ(m.count, 100000);
+  EXPECT_NEAR(m.frequency, 2000, 1.);
+  EXPECT_NEAR(m.pkToPk, 2., 1e-3);
+}
+
+TEST(MeasureTest, HysteresisRejectsNoise) {
+  std::mt19937 gen(1);
+  std::normal_distribution<float> noise(0., 0.01);
+  auto data = tone(50000, 100 / FS, 1.);
+  for (auto &e : data) {
+    e += noise(gen);
+  }
+  ChannelStats stats{0.05, 1 / FS};
+  stats.append(data);
+  EXPECT_NEAR(stats.window(data, 0, data.size()).frequency, 100, 0.5);
+}
+
+TEST(MeasureTest, SpectralMetricsOfDistortedTone) {
+  // Fundamental plus a -40 dB second harmonic and a little noise
+  std::mt19937 gen(1);
+  std::normal_distribution<double> noise(0., 1e-4);
+  const size_t n = 1 << 16;
+  std::vector<double> data(n);
+  for (size_t i = 0; i < n; ++i) {
+    const double t = i / FS;
+    data[i] = std::sin(2 * std::numbers::pi * 1000 * t) +
+              0.01 * std::sin(2 * std::numbers::pi * 2000 * t) + noise(gen);
+  }
+  auto spectrum = crossSpectrum(data, data, 4096, blackman);
+  auto metrics = spectralMetrics(spectrum.saa, FS / spectrum.windowSize);
+  EXPECT_NEAR(metrics.fundamental, 1000, 5);
+  EXPECT_NEAR(metrics.thd, -40, 0.5);
+  EXPECT_GT(metrics.snr, metrics.sinad);
+  EXPECT_NEAR(metrics.sinad, 40, 1);
+
+  // A tone within twice the leakage of DC, on a DC offset whose bins must
+  // not pull the fundamental up
+  const double low = 4.5 * FS / 4096;
+  for (size_t i = 0; i < n; ++i) {
+    const double t = i / FS;
+    data[i] = 0.5 + std::sin(2 * std::numbers::pi * low * t) +
+              0.01 * std::sin(2 * std::numbers::pi * 2 * low * t);
+  }
+  spectrum = crossSpectrum(data, data, 4096, blackman);
+  metrics = spectralMetrics(spectrum.saa, FS / spectrum.windowSize);
+  EXPECT_NEAR(metrics.fundamental, low, 0.15 * FS / 4096);
+}
@@ -0,0 +1,112 @@
+#include "persistence.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <vector>
+
+namespace {
+constexpr double FS = 50e3;
+
+// A square wave of `period` samples between -1 and 1 V
+std::vector<float> square(size_t n, size_t period) {
+  std::vector<float> res(n);
+  for (size_t i = 0; i < n; ++i) {
+    res[i] = i % period < period / 2 ? -1.f : 1.f;
+  }
+  return res;
+}
+
+PersistenceSettings squareSettings() {
+  return {.level = 0.,
+          .hysteresis = 0.5,
+          .length = 64,
+          .pretrigger = 16,
+          .rows = 20,
+          .minVolts = -2.,
+          .maxVolts = 2.,
+          .halfLife = 0.};
+}
+
+float total(const std::vector<float> &image) {
+  return std::accumulate(image.begin(), image.end(), 0.f);
+}
+} // namespace
+
+TEST(PersistenceTest, AlignsSweepsOnRisingCrossings) {
+  Persistence persistence{squareSettings(), FS};
+  // Rising edges every 100 samples, at 50, 150, ...
+  auto data = square(10000, 100);
+  size_t found = 0;
+  // Sweeps straddling blocks are completed by the next one
+  for (size_t at = 0; at < data.size(); at += 37) {
+    const size_t n = std::min<size_t>(37, data.size() - at);
+    found += persistence.push(std::span(data).subspan(at, n));
+  }
+  EXPECT_EQ(found, 100);
+  EXPECT_EQ(persistence.sweepCount(), 100);
+
+  std::vector<float> image;
+  EXPECT_EQ(persistence.copyTo(image), 100.f);
+  ASSERT_EQ(image.size(), 20 * 64);
+  // -1 V falls in row 14 from the top and 1 V in row 4 of 20 over 4 V;
+  // every sweep steps from one to the other at the trigger
+  for (size_t column = 0; column < 64; ++column) {
+    const size_t row = column < 16 ? 14 : 4;
+    EXPECT_EQ(image[row * 64 + column], 100.f) << column;
+  }
+  EXPECT_EQ(total(image), 100.f * 64);
+
+  // Without samples after it, a crossing waits for the next block
+  EXPECT_EQ(persistence.push(square(80, 100)), 0);
+  EXPECT_EQ(persistence.push(square(20, 100)), 1);
+  EXPECT_DOUBLE_EQ(persistence.startTime(), -16 / FS);
+}
+
+TEST(PersistenceTest, DropsSamplesOutsideTheRange) {
+  auto settings = squareSettings();
+  settings.maxVolts = 0.5;
+  Persistence persistence{settings, FS};
+  auto data = square(1000, 100);
+  persistence.push(data);
+  std::vector<float> image;
+  persistence.copyTo(image);
+  // Only the low half of every sweep is inside
+  EXPECT_EQ(total(image), persistence.sweepCount() * 16.f);
+}
+
+TEST(PersistenceTest, OldSweepsFade) {
+  auto settings = squareSettings();
+  // 1000 samples at FS
+  settings.halfLife = 1000 / FS;
+  Persistence persistence{settings, FS};
+  auto data = square(1000, 100);
+  persistence.push(data);
+  const auto sweeps = persistence.sweepCount();
+  std::vector<float> image;
+  persistence.copyTo(image);
+  const float fresh = total(image);
+  EXPECT_GT(fresh, 0.5f * sweeps * 64);
+  EXPECT_LT(fresh, sweeps * 64.f);
+
+  // A half-life of flat signal later, without a single trigger
+  const std::vector<float> flat(1000, -1.f);
+  EXPECT_EQ(persistence.push(flat), 0);
+  persistence.copyTo(image);
+  EXPECT_NEAR(total(image), fresh / 2, fresh * 1e-4);
+
+  // Rescaling along the way keeps the decay exact
+  const std::vector<float> quiet(1000 * 60, -1.f);
+  persistence.push(quiet);
+  persistence.copyTo(image);
+  EXPECT_NEAR(total(image), fresh / std::exp2(61.f), fresh * 1e-20);
+  persistence.push(data);
+  persistence.copyTo(image);
+  EXPECT_NEAR(total(image), fresh, fresh * 1e-3);
+
+  persistence.clear();
+  persistence.copyTo(image);
+  EXPECT_EQ(total(image), 0.f);
+  EXPECT_EQ(persistence.sweepCount(), 0);
+}
@@ -0,0 +1,168 @@
+#include "processing.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <random>
+#include <vector>
+
+namespace {
+constexpr double FS = 50e3;
+
+std::pair<std::vector<double>, std::vector<double>>
+delayedNoise(size_t n, double gain, size_t delay, double noise) {
+  std::mt19937 gen(1);
+  std::normal_distribution<double> dist;
+  std::vector<double> a(n), b(n);
+  for (auto &e : b) {
+    e = dist(gen);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    a[i] = (i >= delay ? gain * b[i - delay] : 0.) + noise * dist(gen);
+  }
+  return {a, b};
+}
+} // namespace
+
+TEST(CrossSpectrumTest, RecoversGainAndDelay) {
+  auto [a, b] = delayedNoise(1 << 16, 0.5, 3, 0.);
+  auto spectrum = crossSpectrum(a, b, 1024, hann);
+  ASSERT_EQ(spectrum.sab.size(), 513);
+  ASSERT_GT(spectrum.segments, 100);
+
+  auto tf = transferFunction(spectrum, FS);
+  const double gainDb = 20 * std::log10(0.5);
+  for (size_t i = 10; i < 500; i += 50) {
+    EXPECT_NEAR(tf.h1[i], gainDb, 0.1) << "bin " << i;
+    EXPECT_NEAR(tf.h2[i], gainDb, 0.1) << "bin " << i;
+    EXPECT_NEAR(tf.coherence[i], 1., 1e-2) << "bin " << i;
+    EXPECT_NEAR(tf.groupDelay[i], 3 / FS, 0.5 / FS) << "bin " << i;
+  }
+}
+
+TEST(CrossSpectrumTest, NoiseLowersCoherence) {
+  auto [a, b] = delayedNoise(1 << 16, 0.5, 0, 0.5);
+  auto tf = transferFunction(crossSpectrum(a, b, 1024, hann), FS);
+  for (size_t i = 10; i < 500; i += 50) {
+    // H1 is unbiased by output noise, H2 is biased upwards.
+    EXPECT_NEAR(tf.h1[i], 20 * std::log10(0.5), 1.5) << "bin " << i;
+    EXPECT_GT(tf.h2[i], tf.h1[i]) << "bin " << i;
+    EXPECT_NEAR(tf.coherence[i], 0.5, 0.15) << "bin " << i;
+  }
+}
+
+TEST(CrossSpectrumTest, WelchMatchesH1) {
+  auto [a, b] = delayedNoise(1 << 14, 2., 0, 0.);
+  auto db = welch(a, b, 512);
+  ASSERT_EQ(db.size(), 257);
+  EXPECT_NEAR(db[100], 20 * std::log10(2.), 1e-6);
+}
+
+TEST(CrossSpectrumTest, RejectsMismatchedInput) {
+  std::vector<double> a(100), b(99);
+  EXPECT_EQ(crossSpectrum(a, b).segments, 0);
+  EXPECT_TRUE(transferFunction(crossSpectrum(a, b), FS).h1.empty());
+}
+
+TEST(CrossSpectrumTest, FloatPathMatchesDouble) {
+  auto [a, b] = delayedNoise(1 << 14, 0.5, 2, 0.1);
+  std::vector<float> af(a.begin(), a.end()), bf(b.begin(), b.end());
+  std::vector<double> ad(af.begin(), af.end()), bd(bf.begin(), bf.end());
+
+  auto single = transferFunction(crossSpectrum(af, bf, 512), FS);
+  auto reference = transferFunction(crossSpectrum(ad, bd, 512), FS);
+  ASSERT_EQ(single.h1.size(), reference.h1.size());
+  for (size_t i = 1; i < single.h1.size(); ++i) {
+    EXPECT_NEAR(single.h1[i], reference.h1[i], 1e-3) << "bin " << i;
+    EXPECT_NEAR(single.coherence[i], reference.coherence[i], 1e-4)
+        << "bin " << i;
+  }
+}
+
+TEST(FftTest, RecoversToneAmplitude) {
+  std::vector<float> tone(1024);
+  for (size_t i = 0; i < tone.size(); ++i) {
+    tone[i] = 3.f * std::cos(2 * std::numbers::pi * 64 * i / tone.size());
+  }
+  auto spectrum = fft(tone);
+  static_assert(std::same_as<decltype(spectrum)::value_type,
+                             std::complex<float>>);
+  ASSERT_EQ(spectrum.size(), 513);
+  EXPECT_NEAR(std::abs(spectrum[64]), 3.f, 1e-4);
+  EXPECT_NEAR(std::abs(spectrum[63]), 0.f, 1e-4);
+}
+
+TEST(SpanApiTest, MatchesRangeOverloads) {
+  auto [ad, bd] = delayedNoise(1 << 14, 0.5, 3, 0.1);
+  std::vector<float> a(ad.begin(), ad.end()), b(bd.begin(), bd.end());
+
+  std::vector<std::complex<float>> bins(a.size() / 2 + 1);
+  fft<float>(a, bins);
+  auto reference = fft(a);
+  ASSERT_EQ(bins.size(), reference.size());
+  for (size_t i = 0; i < bins.size(); ++i) {
+    EXPECT_EQ(bins[i], reference[i]);
+  }
+
+  // Output buffers are reused across calls of different sizes
+  std::vector<double> h1;
+  welch<float>(a, b, h1, 256);
+  welch<float>(a, b, h1, 512);
+  EXPECT_EQ(h1, welch(a, b, 512));
+
+  auto window = windowCoefficients<float>(hann, 64);
+  std::vector<float> windowed(64);
+  applyWindow<float>(std::span(a).first(64), window, windowed);
+  auto lazy = applyWindow(std::span(a).first(64), hann) | ranges::to_vector;
+  for (size_t i = 0; i < windowed.size(); ++i) {
+    EXPECT_NEAR(windowed[i], lazy[i], 1e-6);
+  }
+}
+
+TEST(CancellationTest, ProgressRefinesToFullResult) {
+  auto [ad, bd] = delayedNoise(1 << 16, 0.5, 3, 0.1);
+  std::vector<float> a(ad.begin(), ad.end()), b(bd.begin(), bd.end());
+
+  CrossSpectrum full;
+  crossSpectrum<float>(a, b, full, 512);
+
+  // Every preview covers more segments than the last
+  std::vector<size_t> previews;
+  CrossSpectrum progressive;
+  crossSpectrum<float>(a, b, progressive, 512, hann, {},
+                       [&previews](const CrossSpectrum &partial) {
+                         previews.push_back(partial.segments);
+                       });
+  ASSERT_EQ(previews.size(), SPECTRUM_PASSES - 1);
+  EXPECT_TRUE(std::ranges::is_sorted(previews));
+  EXPECT_LT(previews.back(), full.segments);
+  EXPECT_EQ(progressive.segments, full.segments);
+  for (size_t i = 0; i < full.sab.size(); ++i) {
+    EXPECT_NEAR(progressive.saa[i], full.saa[i], 1e-6 * full.saa[i]);
+    EXPECT_NEAR(std::abs(progressive.sab[i] - full.sab[i]), 0.,
+                1e-6 * std::abs(full.sab[i]) + 1e-9);
+  }
+}
+
+TEST(CancellationTest, StopAbortsBetweenSegments) {
+  auto [ad, bd] = delayedNoise(1 << 16, 0.5, 3, 0.1);
+  std::vector<float> a(ad.begin(), ad.end()), b(bd.begin(), bd.end());
+
+  std::stop_source source;
+  source.request_stop();
+  CrossSpectrum spectrum;
+  crossSpectrum<float>(a, b, spectrum, 512, hann, source.get_token());
+  EXPECT_EQ(spectrum.segments, 0);
+
+  // Stopping from the first preview leaves only the coarsest pass
+  std::stop_source late;
+  size_t previews = 0;
+  crossSpectrum<float>(a, b, spectrum, 512, hann, late.get_token(),
+                       [&](const CrossSpectrum &) {
+                         ++previews;
+                         late.request_stop();
+                       });
+  EXPECT_EQ(previews, 1);
+  EXPECT_GT(spectrum.segments, 0);
+  EXPECT_LT(spectrum.segments, crossSpectrum(a, b, 512).segments / 4);
+}
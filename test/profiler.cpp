@@ -0,0 +1,83 @@
+#include "profiler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST(ProfilerTest, ReportsPercentilesAndRates) {
+  Profiler profiler;
+  const auto end = Profiler::Clock::now();
+  for (int i = 1; i <= 100; ++i) {
+    profiler.record(Stage::Welch, end - i * 1ms, end, 10);
+  }
+  const auto stats = profiler.stats(10s);
+  const auto &welch = stats[static_cast<size_t>(Stage::Welch)];
+  EXPECT_EQ(welch.count, 100);
+  EXPECT_NEAR(welch.p50Ms, 50., 1e-6);
+  EXPECT_NEAR(welch.p99Ms, 99., 1e-6);
+  EXPECT_NEAR(welch.maxMs, 100., 1e-6);
+  EXPECT_NEAR(welch.perSecond, 10., 1e-9);
+  EXPECT_NEAR(welch.itemsPerSecond, 100., 1e-9);
+  EXPECT_EQ(stats[static_cast<size_t>(Stage::Render)].count, 0);
+}
+
+TEST(ProfilerTest, IgnoresEventsOutsideTheWindow) {
+  Profiler profiler;
+  const auto now = Profiler::Clock::now();
+  profiler.record(Stage::Ingest, now - 5s, now - 4s);
+  profiler.record(Stage::Ingest, now - 2ms, now - 1ms);
+  EXPECT_EQ(profiler.stats(1s)[static_cast<size_t>(Stage::Ingest)].count, 1);
+}
+
+TEST(ProfilerTest, KeepsTheNewestEventsPerThread) {
+  Profiler profiler;
+  const auto now = Profiler::Clock::now();
+  for (size_t i = 0; i < PROFILE_RING + 100; ++i) {
+    profiler.record(Stage::Callback, now, now);
+  }
+  // The oldest slot is the one the writer fills next, so readers skip it
+  EXPECT_EQ(profiler.stats()[static_cast<size_t>(Stage::Callback)].count,
+            PROFILE_RING - 1);
+}
+
+TEST(ProfilerTest, CombinesThreadsWhileTheyRecord) {
+  Profiler profiler;
+  constexpr size_t EVENTS = 1000;
+  std::atomic<bool> reading = true;
+  std::thread reader([&] {
+    while (reading) {
+      for (const auto &s : profiler.stats()) {
+        EXPECT_LE(s.count, 4 * EVENTS);
+      }
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; ++t) {
+    writers.emplace_back([&profiler] {
+      for (size_t i = 0; i < EVENTS; ++i) {
+        const auto now = Profiler::Clock::now();
+        profiler.record(Stage::Decimation, now, now, 1);
+      }
+    });
+  }
+  for (auto &w : writers) {
+    w.join();
+  }
+  reading = false;
+  reader.join();
+  const auto s = profiler.stats()[static_cast<size_t>(Stage::Decimation)];
+  EXPECT_EQ(s.count, 4 * EVENTS);
+  EXPECT_NEAR(s.itemsPerSecond, 4. * EVENTS, 1e-9);
+}
+
+TEST(ProfilerTest, CountsQueueDepth) {
+  Profiler profiler;
+  profiler.addQueued(Queue::Stream, 3);
+  profiler.addQueued(Queue::Stream, -1);
+  EXPECT_EQ(profiler.queued(Queue::Stream), 2);
+  EXPECT_EQ(profiler.queued(Queue::Spectrum), 0);
+}
@@ -0,0 +1,65 @@
+#include "resample.hpp"
+#include "signals.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(ResampleTest, StageFactors) {
+  EXPECT_EQ(decimationStages(1), std::vector<size_t>{});
+  EXPECT_EQ(decimationStages(4), std::vector<size_t>{4});
+  EXPECT_EQ(decimationStages(100), (std::vector<size_t>{5, 5, 4}));
+  EXPECT_EQ(decimationStages(64), (std::vector<size_t>{8, 8}));
+  EXPECT_EQ(decimationStages(13), std::vector<size_t>{13});
+}
+
+TEST(ResampleTest, BlockSizeDoesNotMatter) {
+  auto data = tone(10000, 0.001);
+  DecimationChain<float> whole{20}, pieces{20};
+  std::vector<float> a, b;
+  whole.process(data, a);
+  for (size_t i = 0; i < data.size(); i += 77) {
+    const size_t n = std::min<size_t>(77, data.size() - i);
+    pieces.process(std::span(data).subspan(i, n), b);
+  }
+  ASSERT_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    EXPECT_FLOAT_EQ(a[i], b[i]);
+  }
+}
+
+TEST(ResampleTest, PassesBandAndRejectsAlias) {
+  const size_t factor = 10;
+  DecimationChain<float> passChain{factor}, stopChain{factor};
+  std::vector<float> pass, stop;
+  // Output Nyquist is 0.05 cycles per input sample
+  passChain.process(tone(100000, 0.01), pass);
+  stopChain.process(tone(100000, 0.09), stop);
+  // Less the outputs dropped to compensate the group delay
+  EXPECT_EQ(pass.size(),
+            100000 / factor - std::round(passChain.delay() / factor));
+  auto settled = [](const auto &v) { return std::span(v).subspan(200); };
+  EXPECT_NEAR(rms(settled(pass)), std::sqrt(0.5), 0.01);
+  EXPECT_LT(rms(settled(stop)), 1e-3);
+}
+
+TEST(ResampleTest, OutputIsTimeAligned) {
+  const size_t factor = 8;
+  auto data = tone(20000, 0.002);
+  DecimationChain<float> chain{factor};
+  std::vector<float> out;
+  chain.process(data, out);
+  for (size_t j = 100; j < out.size() - 100; j += 97) {
+    EXPECT_NEAR(out[j], data[j * factor], 0.02) << "sample " << j;
+  }
+}
+
+TEST(ResampleTest, RationalRatio) {
+  PolyphaseResampler<float> resampler{3, 2};
+  auto data = tone(30000, 0.01);
+  std::vector<float> out;
+  resampler.process(std::span(data).first(10001), out);
+  resampler.process(std::span(data).subspan(10001), out);
+  EXPECT_NEAR(out.size(), 45000, 2);
+  EXPECT_NEAR(rms(std::span(out).subspan(100)), std::sqrt(0.5), 0.01);
+}
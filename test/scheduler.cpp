@@ -0,0 +1,107 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST(SchedulerTest, ParallelForCoversRangeOnce) {
+  Scheduler scheduler{4};
+  std::vector<std::atomic<int>> hits(1000);
+  scheduler.parallelFor(Priority::Interactive, "cover", hits.size(), 7,
+                        [&hits](size_t begin, size_t end) {
+                          for (size_t i = begin; i < end; ++i) {
+                            ++hits[i];
+                          }
+                        });
+  for (const auto &e : hits) {
+    EXPECT_EQ(e, 1);
+  }
+}
+
+TEST(SchedulerTest, NestedParallelForFromTask) {
+  Scheduler scheduler{2};
+  std::promise<size_t> result;
+  scheduler.submit(Priority::Background, "outer", [&] {
+    std::atomic<size_t> sum = 0;
+    scheduler.parallelFor(Priority::Interactive, "inner", 100, 1,
+                          [&sum](size_t begin, size_t) { sum += begin; });
+    result.set_value(sum);
+  });
+  auto future = result.get_future();
+  ASSERT_EQ(future.wait_for(5s), std::future_status::ready);
+  EXPECT_EQ(future.get(), 4950);
+}
+
+TEST(SchedulerTest, HigherPriorityRunsFirst) {
+  Scheduler scheduler{1};
+  std::promise<void> release;
+  auto gate = release.get_future().share();
+  std::mutex lock;
+  std::vector<int> order;
+  std::promise<void> finished;
+
+  // Hold the only worker while the queue fills up
+  scheduler.submit(Priority::Acquisition, "gate", [gate] { gate.wait(); });
+  std::this_thread::sleep_for(10ms);
+  scheduler.submit(Priority::Background, "background", [&] {
+    std::unique_lock temp{lock};
+    order.push_back(2);
+    finished.set_value();
+  });
+  scheduler.submit(Priority::Interactive, "interactive", [&] {
+    std::unique_lock temp{lock};
+    order.push_back(1);
+  });
+  scheduler.submit(Priority::Acquisition, "acquisition", [&] {
+    std::unique_lock temp{lock};
+    order.push_back(0);
+  });
+  release.set_value();
+  finished.get_future().wait();
+  EXPECT_EQ(order, (std::vector{0, 1, 2}));
+}
+
+TEST(SchedulerTest, TimedAcquisitionRunsDuringParallelFor) {
+  Scheduler scheduler{2};
+  std::atomic<int> runs = 0;
+  auto task = scheduler.every(Priority::Acquisition, 1ms, "poll",
+                              [&runs] { ++runs; });
+  while (runs == 0) {
+    std::this_thread::sleep_for(1ms);
+  }
+  // Long enough for many polls to fall due while every thread has chunks
+  // left to run
+  const int before = runs;
+  scheduler.parallelFor(Priority::Interactive, "pass", 150, 1,
+                        [](size_t, size_t) {
+                          std::this_thread::sleep_for(2ms);
+                        });
+  EXPECT_GE(runs - before, 10);
+  task.stop();
+}
+
+TEST(SchedulerTest, PeriodicTaskStopsAndCountsRuns) {
+  Scheduler scheduler{2};
+  std::atomic<int> runs = 0;
+  auto task = scheduler.every(Priority::Acquisition, 1ms, "tick",
+                              [&runs] { ++runs; });
+  while (runs < 5) {
+    std::this_thread::sleep_for(1ms);
+  }
+  task.stop();
+  const int stopped = runs;
+  std::this_thread::sleep_for(10ms);
+  EXPECT_EQ(runs, stopped);
+  EXPECT_FALSE(task.active());
+
+  auto stats = scheduler.stats();
+  auto tick = std::ranges::find(stats, std::string{"tick"}, &TaskStats::name);
+  ASSERT_NE(tick, stats.end());
+  EXPECT_GE(tick->count, 5);
+}
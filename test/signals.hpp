@@ -0,0 +1,39 @@
+#ifndef SIGNALS_HPP
+#define SIGNALS_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <numeric>
+#include <span>
+#include <vector>
+
+// Test signals shared by the test files
+
+// Sine of `cyclesPerSample` (frequency over sample rate), scaled and offset
+inline std::vector<float> tone(size_t n, double cyclesPerSample,
+                               double amplitude = 1., double offset = 0.) {
+  std::vector<float> res(n);
+  for (size_t i = 0; i < n; ++i) {
+    res[i] = offset + amplitude * std::sin(2 * std::numbers::pi *
+                                           cyclesPerSample * i);
+  }
+  return res;
+}
+
+// first, first + 1, ..., so every sample tells where it came from
+inline std::vector<float> ramp(size_t first, size_t n) {
+  std::vector<float> res(n);
+  std::iota(res.begin(), res.end(), static_cast<float>(first));
+  return res;
+}
+
+inline double rms(std::span<const float> data) {
+  double sum = 0;
+  for (auto e : data) {
+    sum += e * e;
+  }
+  return std::sqrt(sum / data.size());
+}
+
+#endif
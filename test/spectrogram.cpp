@@ -0,0 +1,56 @@
+#include "signals.hpp"
+#include "spectrogram.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+constexpr double FS = 50e3;
+} // namespace
+
+TEST(SpectrogramTest, ColumnsFollowHop) {
+  Spectrogram spectrogram{256, 128, FS, 16};
+  auto data = tone(1000, 1000 / FS, 1.);
+  EXPECT_EQ(spectrogram.push(std::span(data).first(200)), 0);
+  // 1000 samples hold (1000 - 256) / 128 + 1 = 6 windows
+  EXPECT_EQ(spectrogram.push(std::span(data).subspan(200)), 6);
+  EXPECT_EQ(spectrogram.columns(), 6);
+  auto blocks = spectrogram.blocks();
+  EXPECT_EQ(blocks[0].columns, 6);
+  EXPECT_EQ(blocks[1].columns, 0);
+}
+
+TEST(SpectrogramTest, HistoryIsBounded) {
+  Spectrogram spectrogram{256, 128, FS, 8};
+  auto data = tone(1 << 16, 1000 / FS, 1.);
+  // Only the columns that fit in the history are computed
+  EXPECT_EQ(spectrogram.push(data), 8);
+  spectrogram.push(std::span(data).first(300));
+  EXPECT_EQ(spectrogram.columns(), 8);
+
+  auto blocks = spectrogram.blocks();
+  EXPECT_EQ(blocks[0].columns + blocks[1].columns, 8);
+  EXPECT_EQ(blocks[0].firstColumn + blocks[0].columns, blocks[1].firstColumn);
+  const size_t total = ((1 << 16) - 256) / 128 + 1;
+  EXPECT_GE(blocks[1].firstColumn + blocks[1].columns, total);
+}
+
+TEST(SpectrogramTest, PeakAtToneFrequency) {
+  Spectrogram spectrogram{1024, 512, FS, 4};
+  // Bin-centred tone: bin 100
+  const double freq = 100 * FS / 1024;
+  spectrogram.push(tone(4096, freq / FS, 2.));
+
+  const auto block = spectrogram.blocks()[0];
+  const size_t bins = spectrogram.bins();
+  const float *column = block.data;
+  size_t peak = 0;
+  for (size_t i = 0; i < bins; ++i) {
+    if (column[i] > column[peak]) {
+      peak = i;
+    }
+  }
+  EXPECT_EQ(bins - 1 - peak, 100);
+  EXPECT_NEAR(column[peak], 20 * std::log10(2.), 0.1);
+}
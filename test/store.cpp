@@ -0,0 +1,194 @@
+#include "signals.hpp"
+#include "store.hpp"
+
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+// Whole multiples of STEP, as unfiltered ADC samples are
+constexpr float STEP = 0.25f;
+
+std::vector<float> codes(size_t first, size_t n) {
+  std::vector<float> res(n);
+  for (size_t i = 0; i < n; ++i) {
+    res[i] = static_cast<float>(static_cast<int>((first + i) % 200) - 100) *
+             STEP;
+  }
+  return res;
+}
+} // namespace
+
+TEST(SampleStoreTest, IndexesAcrossChunks) {
+  SampleStore store;
+  const size_t n = 3 * STORE_CHUNK + 123;
+  for (size_t at = 0; at < n; at += 1000) {
+    store.append(ramp(at, std::min<size_t>(1000, n - at)));
+  }
+  ASSERT_EQ(store.size(), n);
+  EXPECT_EQ(store.firstIndex(), 0);
+  EXPECT_EQ(store.endIndex(), n);
+  for (size_t i : {size_t{0}, STORE_CHUNK - 1, STORE_CHUNK, n - 1}) {
+    EXPECT_EQ(store[i], static_cast<float>(i));
+  }
+
+  // Pieces are contiguous, in order and split only at chunk boundaries
+  size_t next = STORE_CHUNK - 10;
+  size_t pieces = 0;
+  store.visit(next, 2 * STORE_CHUNK + 10, [&](std::span<const float> piece) {
+    for (float x : piece) {
+      EXPECT_EQ(x, static_cast<float>(next++));
+    }
+    ++pieces;
+  });
+  EXPECT_EQ(next, 2 * STORE_CHUNK + 10);
+  EXPECT_EQ(pieces, 3);
+}
+
+TEST(SampleStoreTest, RetentionDropsWholeChunks) {
+  const size_t retention = 2 * STORE_CHUNK + 5;
+  SampleStore store{retention};
+  const size_t n = 10 * STORE_CHUNK + 7;
+  for (size_t at = 0; at < n; at += 4096) {
+    store.append(ramp(at, std::min<size_t>(4096, n - at)));
+    EXPECT_GE(store.size(), std::min(at + 1, retention));
+    EXPECT_LT(store.size(), retention + STORE_CHUNK);
+  }
+  EXPECT_EQ(store.endIndex(), n);
+  EXPECT_EQ(store.firstIndex() % STORE_CHUNK, 0);
+  EXPECT_EQ(store[store.firstIndex()], static_cast<float>(store.firstIndex()));
+  // At most one chunk is spare beyond those holding samples
+  EXPECT_LE(store.stats().memoryBytes, (retention + 2 * STORE_CHUNK) * sizeof(float));
+
+  store.setRetention(STORE_CHUNK);
+  EXPECT_LT(store.size(), 2 * STORE_CHUNK);
+  EXPECT_GE(store.size(), STORE_CHUNK);
+
+  store.clear(500);
+  EXPECT_TRUE(store.empty());
+  store.append(ramp(500, 10));
+  EXPECT_EQ(store.firstIndex(), 500);
+  EXPECT_EQ(store[509], 509.f);
+}
+
+TEST(SampleStoreTest, SnapshotOutlivesDroppedChunks) {
+  SampleStore store{2 * STORE_CHUNK};
+  store.append(ramp(0, 2 * STORE_CHUNK));
+  auto snapshot = store.snapshot(STORE_CHUNK - 100, STORE_CHUNK + 100);
+  ASSERT_EQ(snapshot.size(), 200);
+  EXPECT_EQ(snapshot.firstIndex(), STORE_CHUNK - 100);
+
+  // Dropping and refilling must not touch the chunk the snapshot holds
+  store.append(ramp(2 * STORE_CHUNK, 3 * STORE_CHUNK));
+  EXPECT_GT(store.firstIndex(), STORE_CHUNK);
+  std::vector<float> copy;
+  snapshot.copyTo(copy);
+  ASSERT_EQ(copy.size(), 200);
+  for (size_t i = 0; i < copy.size(); ++i) {
+    EXPECT_EQ(copy[i], static_cast<float>(STORE_CHUNK - 100 + i));
+    EXPECT_EQ(snapshot[i], copy[i]);
+  }
+
+  EXPECT_TRUE(store.snapshot(0, 10).empty());
+}
+
+TEST(SampleStoreTest, PacksSealedChunks) {
+  SampleStore store;
+  store.setQuantum(STEP);
+  const size_t n = 5 * STORE_CHUNK + 11;
+  for (size_t at = 0; at < n; at += 3000) {
+    store.append(codes(at, std::min<size_t>(3000, n - at)));
+  }
+  auto stats = store.stats();
+  // Every full chunk but the one being filled
+  EXPECT_EQ(stats.packedChunks, 5);
+  EXPECT_LT(stats.packedBytes * 3, 5 * STORE_CHUNK * sizeof(float));
+  EXPECT_LT(stats.memoryBytes, 3 * STORE_CHUNK * sizeof(float));
+
+  const auto expected = codes(0, n);
+  for (size_t i : {size_t{0}, STORE_CHUNK + 7, 5 * STORE_CHUNK, n - 1}) {
+    EXPECT_EQ(store[i], expected[i]);
+  }
+  size_t next = 10;
+  store.visit(10, n, [&](std::span<const float> piece) {
+    for (float x : piece) {
+      ASSERT_EQ(x, expected[next++]);
+    }
+  });
+  EXPECT_EQ(next, n);
+  EXPECT_GE(store.stats().unpackedSamples, 5 * STORE_CHUNK);
+
+  // Chunks outside the cache reach snapshots packed
+  auto snapshot = store.snapshot(100, 3 * STORE_CHUNK);
+  std::vector<float> copy;
+  snapshot.copyTo(copy);
+  ASSERT_EQ(copy.size(), 3 * STORE_CHUNK - 100);
+  for (size_t i = 0; i < copy.size(); i += 997) {
+    EXPECT_EQ(copy[i], expected[100 + i]);
+    EXPECT_EQ(snapshot[i], expected[100 + i]);
+  }
+
+  // Samples off the quantum leave their chunk raw
+  store.setQuantum(1.f);
+  store.append(codes(n, 2 * STORE_CHUNK));
+  EXPECT_EQ(store.stats().packedChunks, 5);
+}
+
+#ifndef _WIN32
+TEST(SampleStoreTest, SpillsColdChunksToDisk) {
+  const size_t retention = 6 * STORE_CHUNK;
+  SampleStore store{retention, 2 * STORE_CHUNK * sizeof(float)};
+  const size_t n = 10 * STORE_CHUNK + 3;
+  for (size_t at = 0; at < n; at += 5000) {
+    store.append(ramp(at, std::min<size_t>(5000, n - at)));
+    EXPECT_LE(store.stats().memoryBytes, 2 * STORE_CHUNK * sizeof(float));
+  }
+  auto stats = store.stats();
+  ASSERT_FALSE(stats.spillFailed);
+  EXPECT_GT(stats.spilledChunks, 0);
+  // Slots of dropped chunks are reused, so the file stays within retention
+  EXPECT_GT(stats.diskBytes, 0);
+  EXPECT_LE(stats.diskBytes, retention * sizeof(float));
+
+  // Spilled samples read back through every access path
+  const size_t from = store.firstIndex();
+  EXPECT_EQ(store[from], static_cast<float>(from));
+  size_t next = from;
+  store.visit(from, store.endIndex(), [&](std::span<const float> piece) {
+    for (float x : piece) {
+      EXPECT_EQ(x, static_cast<float>(next++));
+    }
+  });
+  EXPECT_EQ(next, n);
+  auto snapshot = store.snapshot(from, from + 2 * STORE_CHUNK);
+  EXPECT_GT(store.stats().coldReads, stats.coldReads);
+
+  // Snapshots keep their mappings after the store drops them
+  store.clear();
+  EXPECT_EQ(store.stats().diskBytes, 0);
+  std::vector<float> copy;
+  snapshot.copyTo(copy);
+  ASSERT_EQ(copy.size(), 2 * STORE_CHUNK);
+  EXPECT_EQ(copy.front(), static_cast<float>(from));
+  EXPECT_EQ(copy.back(), static_cast<float>(from + 2 * STORE_CHUNK - 1));
+}
+
+TEST(SampleStoreTest, SpillsPackedChunks) {
+  SampleStore store{8 * STORE_CHUNK, STORE_CHUNK * sizeof(float)};
+  store.setQuantum(STEP);
+  const size_t n = 8 * STORE_CHUNK;
+  store.append(codes(0, n));
+  const auto stats = store.stats();
+  ASSERT_FALSE(stats.spillFailed);
+  EXPECT_GT(stats.spilledChunks, 0);
+  // Spilled packed, so the file holds less than the raw samples
+  EXPECT_LT(stats.diskBytes, stats.spilledChunks * STORE_CHUNK * sizeof(float));
+  const auto expected = codes(0, n);
+  size_t next = 0;
+  store.visit(0, n, [&](std::span<const float> piece) {
+    for (float x : piece) {
+      ASSERT_EQ(x, expected[next++]);
+    }
+  });
+  EXPECT_EQ(next, n);
+}
+#endif
@@ -0,0 +1,96 @@
+#include "sweep.hpp"
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr double FS = 50e3;
+
+// One full sweep after `lead` silent samples, with channel A being channel
+// B attenuated by half and delayed by 1 sample
+std::pair<std::vector<float>, std::vector<float>>
+sweepResponse(const SweepSchedule &schedule, size_t lead) {
+  const size_t dwellSamples = schedule.dwell * FS;
+  const size_t total = dwellSamples * schedule.steps();
+  std::vector<float> a(lead + total), b(lead + total);
+  double phase = 0.;
+  for (size_t i = 0; i < total; ++i) {
+    const double f = schedule.frequency(schedule.stepAt(i / dwellSamples));
+    phase += 2 * std::numbers::pi * f / FS;
+    b[lead + i] = std::sin(phase);
+    a[lead + i] = 0.5 * std::sin(phase - 2 * std::numbers::pi * f / FS);
+  }
+  return {std::move(a), std::move(b)};
+}
+
+void expectHalfGainOneSampleDelay(const SweepSchedule &schedule,
+                                  const std::vector<BodePoint> &points) {
+  ASSERT_EQ(points.size(), schedule.steps());
+  for (const auto &p : points) {
+    EXPECT_NEAR(p.magnitude, 20 * std::log10(0.5), 0.05) << p.frequency;
+    EXPECT_NEAR(p.phase, -360 * p.frequency / FS, 0.5) << p.frequency;
+  }
+}
+} // namespace
+
+TEST(SweepTest, ScheduleSteps) {
+  SweepSchedule up{100., 200., 25., 0.02, SweepDirection::Up};
+  EXPECT_EQ(up.steps(), 5);
+  EXPECT_EQ(up.stepAt(0), 0);
+  EXPECT_EQ(up.stepAt(4), 4);
+  EXPECT_EQ(up.stepAt(5), 0);
+
+  SweepSchedule upDown{100., 200., 25., 0.02, SweepDirection::UpDown};
+  EXPECT_EQ(upDown.stepAt(4), 4);
+  EXPECT_EQ(upDown.stepAt(5), 4);
+  EXPECT_EQ(upDown.stepAt(9), 0);
+  EXPECT_EQ(upDown.stepAt(10), 0);
+}
+
+TEST(SweepTest, GoertzelMatchesTone) {
+  const size_t n = 1000;
+  std::vector<float> tone(n), window(n, 1.f);
+  const double f = 0.0123;
+  for (size_t i = 0; i < n; ++i) {
+    tone[i] = std::cos(2 * std::numbers::pi * f * i + 0.3);
+  }
+  // Unwindowed DFT magnitude of a tone with an integer number of cycles is
+  // N / 2; 12.3 cycles is close enough for a loose bound.
+  EXPECT_NEAR(std::abs(goertzel(tone, f, window)), n / 2., n * 0.02);
+}
+
+TEST(SweepTest, TracksGainAndPhaseOfSweep) {
+  SweepSchedule schedule{1000., 5000., 500., 0.02, SweepDirection::Up};
+  auto [a, b] = sweepResponse(schedule, 0);
+
+  SweepTracker tracker{schedule, FS};
+  for (size_t i = 0; i < a.size(); i += 777) {
+    const size_t n = std::min<size_t>(777, a.size() - i);
+    tracker.push(std::span(a).subspan(i, n), std::span(b).subspan(i, n), i);
+  }
+  expectHalfGainOneSampleDelay(schedule, tracker.points());
+}
+
+TEST(SweepTest, StartsWhereTheGeneratorStarted) {
+  // The stream ran for a while, at a gain of 2, before the sweep began
+  constexpr uint64_t STREAMED = 100000;
+  constexpr size_t LEAD = 1234;
+  SweepSchedule schedule{1000., 5000., 500., 0.02, SweepDirection::Up,
+                         STREAMED + LEAD};
+  auto [a, b] = sweepResponse(schedule, LEAD);
+  for (size_t i = 0; i < LEAD; ++i) {
+    b[i] = std::sin(0.1 * i);
+    a[i] = 2 * b[i];
+  }
+
+  SweepTracker tracker{schedule, FS};
+  for (size_t i = 0; i < a.size(); i += 777) {
+    const size_t n = std::min<size_t>(777, a.size() - i);
+    tracker.push(std::span(a).subspan(i, n), std::span(b).subspan(i, n),
+                 STREAMED + i);
+  }
+  expectHalfGainOneSampleDelay(schedule, tracker.points());
+}
@@ -0,0 +1,119 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+std::string readFile(const std::filesystem::path &path) {
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+size_t occurrences(const std::string &text, const std::string &pattern) {
+  size_t n = 0;
+  for (auto at = text.find(pattern); at != std::string::npos;
+       at = text.find(pattern, at + 1)) {
+    ++n;
+  }
+  return n;
+}
+} // namespace
+
+TEST(TraceTest, RecordsNothingWhileStopped) {
+  TraceRecorder trace;
+  const auto now = TraceRecorder::Clock::now();
+  trace.instant("idle");
+  trace.complete("idle", now, now);
+  const auto path = std::filesystem::temp_directory_path() / "trace-idle.json";
+  ASSERT_TRUE(trace.write(path));
+  const auto json = readFile(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(occurrences(json, "\"name\":\"idle\""), 0);
+}
+
+TEST(TraceTest, WritesLaterOnATask) {
+  TraceRecorder trace;
+  trace.start();
+  trace.instant("saved");
+  const auto path =
+      std::filesystem::temp_directory_path() / "trace-later.json";
+  auto written = trace.writeLater(path);
+  // Events recorded after the call are not part of the copy
+  trace.instant("late");
+  ASSERT_EQ(written.wait_for(5s), std::future_status::ready);
+  ASSERT_TRUE(written.get());
+  const auto json = readFile(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(occurrences(json, "\"name\":\"saved\""), 1);
+  EXPECT_EQ(json.find("late"), std::string::npos);
+}
+
+TEST(TraceTest, WritesChromeTraceEvents) {
+  TraceRecorder trace;
+  trace.start();
+  trace.nameThread("test");
+  const auto start = TraceRecorder::Clock::now();
+  trace.flow("block", true, 4096);
+  std::thread([&trace, start] {
+    trace.flow("block", false, 4096);
+    trace.complete("ingest", start, start + 2ms, 4096, 1024);
+  }).join();
+  trace.instant("restart stream", 5120);
+  trace.stop();
+  trace.instant("ignored");
+
+  const auto path = std::filesystem::temp_directory_path() / "trace-test.json";
+  ASSERT_TRUE(trace.write(path));
+  const auto json = readFile(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(json.find("ignored"), std::string::npos);
+  EXPECT_EQ(occurrences(json, "\"ph\":\"M\""), 2);
+  EXPECT_NE(json.find("\"args\":{\"name\":\"test\"}"), std::string::npos);
+  EXPECT_NE(json.find("\"ph\":\"s\",\"name\":\"block\""), std::string::npos);
+  EXPECT_NE(json.find("\"id\":4096,\"bp\":\"e\""), std::string::npos);
+  EXPECT_NE(json.find("\"dur\":2000.000,\"args\":{\"first\":4096,"
+                      "\"count\":1024}"),
+            std::string::npos);
+  EXPECT_NE(json.find("\"s\":\"t\",\"args\":{\"first\":5120"),
+            std::string::npos);
+  // The receiving end was recorded on the second thread
+  EXPECT_NE(json.find("\"ph\":\"f\",\"name\":\"block\",\"cat\":\"pipeline\","
+                      "\"pid\":1,\"tid\":2"),
+            std::string::npos);
+}
+
+TEST(TraceTest, DumpsOnStalledFrames) {
+  TraceRecorder trace;
+  const auto directory = std::filesystem::temp_directory_path();
+  trace.setStallDump(5ms, directory);
+  trace.start();
+  const auto now = TraceRecorder::Clock::now();
+  trace.frame(now - 1ms, now);
+  EXPECT_TRUE(trace.lastStallDump().empty());
+  trace.frame(now - 20ms, now);
+  const auto path = trace.lastStallDump();
+  ASSERT_FALSE(path.empty());
+  EXPECT_EQ(path.parent_path(), directory);
+  // A second stall within the interval is not dumped again
+  trace.frame(now - 20ms, now + 1ms);
+  EXPECT_EQ(trace.lastStallDump(), path);
+
+  // The file is written by a background task
+  for (int i = 0; i < 200 && readFile(path).find("]}") == std::string::npos;
+       ++i) {
+    std::this_thread::sleep_for(10ms);
+  }
+  const auto json = readFile(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(occurrences(json, "\"name\":\"frame\""), 2);
+}
@@ -0,0 +1,93 @@
+#include "zoom.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numbers>
+#include <random>
+#include <vector>
+
+namespace {
+constexpr double FS = 50e3;
+}
+
+TEST(ZoomTest, DecimationIsSmoothAndBounded) {
+  EXPECT_EQ(zoomDecimation(FS, 100.), 250);
+  // 50000 / (2 * 3000) = 8.33 -> 8
+  EXPECT_EQ(zoomDecimation(FS, 3000.), 8);
+  // 50000 / (2 * 45) = 555 -> 540 = 2^2 3^3 5
+  EXPECT_EQ(zoomDecimation(FS, 45.), 540);
+  EXPECT_EQ(zoomDecimation(FS, FS), 1);
+}
+
+TEST(ZoomTest, ResolvesToneInsideBand) {
+  std::vector<float> tone(1 << 20);
+  const double frequency = 1000.3;
+  for (size_t i = 0; i < tone.size(); ++i) {
+    tone[i] = std::sin(2 * std::numbers::pi * frequency * i / FS);
+  }
+  CrossSpectrum spectrum;
+  const double rate =
+      zoomCrossSpectrum(tone, tone, FS, 950., 1050., spectrum, 1024);
+  const double binWidth = rate / spectrum.windowSize;
+  EXPECT_DOUBLE_EQ(rate, FS / 250);
+  EXPECT_LT(binWidth, 0.2);
+  ASSERT_GT(spectrum.segments, 0);
+  EXPECT_GE(spectrum.startFrequency, 950.);
+  EXPECT_LE(spectrum.startFrequency + spectrum.saa.size() * binWidth,
+            1050. + binWidth);
+
+  const auto peak = std::ranges::max_element(spectrum.saa) -
+                    spectrum.saa.begin();
+  EXPECT_NEAR(spectrum.startFrequency + peak * binWidth, frequency, binWidth);
+}
+
+TEST(ZoomTest, TransferFunctionInBand) {
+  std::mt19937 gen(1);
+  std::normal_distribution<float> dist;
+  std::vector<float> b(1 << 19), a(b.size());
+  for (auto &e : b) {
+    e = dist(gen);
+  }
+  for (size_t i = 2; i < a.size(); ++i) {
+    a[i] = 0.5f * b[i - 2];
+  }
+  CrossSpectrum spectrum;
+  const double rate =
+      zoomCrossSpectrum(a, b, FS, 4000., 4400., spectrum, 256);
+  auto tf = transferFunction(spectrum, rate);
+  ASSERT_FALSE(tf.h1.empty());
+  EXPECT_DOUBLE_EQ(tf.startFrequency, spectrum.startFrequency);
+  for (size_t i = 0; i < tf.h1.size(); ++i) {
+    EXPECT_NEAR(tf.h1[i], 20 * std::log10(0.5), 0.2);
+    EXPECT_GT(tf.coherence[i], 0.95);
+  }
+  // A two sample delay is 2 / FS seconds at every frequency
+  EXPECT_NEAR(tf.groupDelay[tf.h1.size() / 2], 2 / FS, 1e-6);
+}
+
+TEST(ZoomTest, ProgressPassesAddUpToTheWholeSpectrum) {
+  std::mt19937 gen(2);
+  std::normal_distribution<float> dist;
+  std::vector<float> a(1 << 18), b(a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    a[i] = dist(gen);
+    b[i] = dist(gen);
+  }
+  CrossSpectrum whole, refined;
+  zoomCrossSpectrum(a, b, FS, 2000., 2500., whole, 256);
+  std::vector<size_t> previews;
+  zoomCrossSpectrum(a, b, FS, 2000., 2500., refined, 256, hann, {},
+                    [&](const CrossSpectrum &partial) {
+                      previews.push_back(partial.segments);
+                    });
+  EXPECT_EQ(previews.size(), SPECTRUM_PASSES - 1);
+  EXPECT_TRUE(std::ranges::is_sorted(previews));
+  EXPECT_EQ(refined.segments, whole.segments);
+  ASSERT_EQ(refined.saa.size(), whole.saa.size());
+  for (size_t i = 0; i < whole.saa.size(); ++i) {
+    EXPECT_NEAR(refined.saa[i], whole.saa[i], whole.saa[i] * 1e-4);
+    EXPECT_NEAR(std::abs(refined.sab[i] - whole.sab[i]), 0.,
+                whole.saa[i] * 1e-4);
+  }
+}
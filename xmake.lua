@@ -3,9 +3,8 @@ add_rules("mode.debug", "mode.release")
 add_requires("imgui", { configs = { glfw_opengl3 = true } })
 add_requires("gtest", { configs = { main = true } })
 add_requires("opengl", "implot", "fftw", "range-v3")
-if is_os("windows") then
-  add_requires("openmp")
-end
+add_requires("fftw", { alias = "fftwf", configs = { precision = "float" } })
+add_requires("benchmark")
 
 set_languages("c++23")
 
@@ -13,19 +12,17 @@ target("imgui-test")
   set_kind("binary")
   add_files("src/*.cpp")
   add_includedirs("include", "mpsc")
-  add_cxflags("-fopenmp")
-  add_ldflags("-fopenmp")
+  add_cxflags("-fopenmp-simd")
   if is_os("windows") then
     add_includedirs(".")
     add_linkdirs("libps2000")
-    add_packages("openmp")
   end
   if is_os("macosx") then
     add_includedirs("/Library/Frameworks/PicoSDK.framework/Headers")
     add_linkdirs("/Library/Frameworks/PicoSDK.framework/Libraries/libps2000")
   end
   add_links("ps2000")
-  add_packages("imgui", "opengl", "implot", "fftw", "range-v3")
+  add_packages("imgui", "opengl", "implot", "fftw", "fftwf", "range-v3")
 target_end()
 
 target("tests")
@@ -38,6 +35,56 @@ target("tests")
   -- add_syslinks("gtest_main")
 target_end()
 
+target("processing-tests")
+  set_kind("binary")
+  set_default(false)
+  add_files("test/*.cpp", "src/processing.cpp", "src/spectrogram.cpp", "src/resample.cpp",
+            "src/filters.cpp", "src/measure.cpp", "src/sweep.cpp",
+            "src/correlation.cpp", "src/average.cpp", "src/scheduler.cpp",
+            "src/zoom.cpp", "src/envelope.cpp", "src/store.cpp", "src/codec.cpp",
+            "src/profiler.cpp", "src/trace.cpp", "src/ingest.cpp",
+            "src/persistence.cpp")
+  add_tests("default")
+  add_includedirs("include", "mpsc")
+  add_cxflags("-fopenmp-simd")
+  add_packages("gtest", "fftw", "fftwf", "range-v3")
+target_end()
+
+target("processing-bench")
+  set_kind("binary")
+  set_default(false)
+  add_files("bench/processing.cpp", "bench/scope.cpp", "src/processing.cpp",
+            "src/resample.cpp", "src/correlation.cpp", "src/scheduler.cpp",
+            "src/envelope.cpp", "src/codec.cpp", "src/profiler.cpp",
+            "src/persistence.cpp")
+  add_includedirs("include")
+  add_cxflags("-fopenmp-simd")
+  add_packages("benchmark", "fftw", "fftwf", "range-v3")
+target_end()
+
+target("ui-bench")
+  set_kind("binary")
+  set_default(false)
+  -- The driver is stubbed, so only its headers are needed
+  add_files("bench/ui.cpp", "bench/ps2000_stub.cpp", "src/ui.cpp",
+            "src/pico.cpp", "src/processing.cpp",
+            "src/spectrogram.cpp", "src/resample.cpp", "src/filters.cpp",
+            "src/measure.cpp", "src/sweep.cpp", "src/correlation.cpp",
+            "src/average.cpp", "src/scheduler.cpp", "src/zoom.cpp",
+            "src/envelope.cpp", "src/store.cpp", "src/codec.cpp",
+            "src/profiler.cpp", "src/trace.cpp", "src/ingest.cpp",
+            "src/persistence.cpp")
+  add_includedirs("include", "mpsc")
+  add_cxflags("-fopenmp-simd")
+  if is_os("windows") then
+    add_includedirs(".")
+  end
+  if is_os("macosx") then
+    add_includedirs("/Library/Frameworks/PicoSDK.framework/Headers")
+  end
+  add_packages("benchmark", "imgui", "implot", "fftw", "fftwf", "range-v3")
+target_end()
+
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --